@@ -17,77 +17,499 @@ How to read this file
 2) “LE helpers”: safe macros to read/write unaligned Little-Endian fields (PDOs).
 3) “Process Image structs”: how we map PDOs into tight C structs.
 4) “Integration layer (TODO)”: the places you must connect to *your* EtherCAT master.
-5) Init(): mapping + (optional) SDOs for CSP.
-6) Run(): CiA-402 enable sequence + set-point producer (+ dwell, ramp, FE monitor).
+   4b–4e) Instrumentation: cycle histograms, per-phase profile, per-tick binary trace,
+   shared-memory telemetry.
+   4f) Simulated drives behind the integration layer (offline soak / profiling harness).
+   4g) Record/replay of the process image (bit-exact regression of the tick).
+   4h) Distributed-clock lock: keeps the host cycle in phase with SYNC0.
+5) Axis context: per-drive state, so one process can drive a whole cell.
+6) Init(): mapping + (optional) SDOs for CSP.
+7) Run()/RunBatch(): CiA-402 enable sequence + set-point producer (+ dwell, ramp, FE monitor).
+9) Optional reference cyclic task (absolute deadlines, SCHED_FIFO, pinning, mlockall),
+   and multi-core sharding of a cell across several of them.
 */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE   /* clock_nanosleep, pthread affinity (glibc); harmless elsewhere */
+#endif
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <math.h>      /* S-curve planner (init/refill only); link with -lm */
+#if defined(__AVX2__) || defined(__SSE4_1__)
+# include <immintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
 
 /* =========================
    1) USER CONFIG “KNOBS”
    ========================= */
-#define LOOP_PERIOD_MS         1      /* CSP period (ms). Must match 0x60C2:1 if you set it.          */
-#define INC_STEP               300    /* Counts added per loop (1ms → 300k cnt/s).                     */
-#define LIMIT_POS              200000 /* Software ±limit (counts).                                     */
-#define DWELL_MS               500    /* Hold at limits before reversing (ms).                         */
-#define RAMP_MS                300    /* Soft ramp on enable / after dwell (ms).                       */
-#define FE_WINDOW_COUNTS       20000  /* Example following-error window (counts).                      */
-#define FE_WARN_PCT            80     /* Warn at % of window (clear at ~40%).                          */
-#define FAULT_COOLDOWN_MS      250    /* After fault clears, stay in Shutdown (CW=0x0006) for ms.      */
-#define COMM_COOLDOWN_MS       0      /* Optional: cooldown after comm restore (usually 0 if unused).  */
+/* Every knob is a default: override it with -DNAME=value (a build matrix, bench/). */
+#ifndef LOOP_PERIOD_US
+# define LOOP_PERIOD_US        1000   /* CSP period (µs): 1000, 500, 250, 125 … Must match 0x60C2:1.   */
+#endif
+#ifndef INC_STEP
+# define INC_STEP              300    /* Counts added per loop (at 1 ms → 300k cnt/s).                 */
+#endif
+#ifndef LIMIT_POS
+# define LIMIT_POS             200000 /* Software ±limit (counts).                                     */
+#endif
+#ifndef DWELL_MS
+# define DWELL_MS              500    /* Hold at limits before reversing (ms).                         */
+#endif
+#ifndef RAMP_MS
+# define RAMP_MS               300    /* Soft ramp on enable / after dwell (ms).                       */
+#endif
+#ifndef RAMP_SHAPE
+# define RAMP_SHAPE            0      /* 0=linear, 1=smoothstep (S), 2=smootherstep (jerk-softer S).   */
+#endif
+
+/* Jerk-limited S-curve generator (per axis, opt-in with ServoTraj_Attach). Rest-to-rest
+   moves between ±LIMIT_POS with DWELL_MS holds, planned as 7-segment profiles. Defaults
+   reproduce the triangle's cruise speed and a RAMP_MS-long acceleration. */
+#ifndef TRAJ_VMAX
+# define TRAJ_VMAX             ((double)INC_STEP * 1e6 / LOOP_PERIOD_US)  /* counts/s            */
+#endif
+#ifndef TRAJ_AMAX
+# define TRAJ_AMAX             (TRAJ_VMAX * 1000.0 / (RAMP_MS > 0 ? RAMP_MS : 1)) /* counts/s²   */
+#endif
+#ifndef TRAJ_JMAX
+# define TRAJ_JMAX             (TRAJ_AMAX * 20.0)                        /* counts/s³ (50 ms)   */
+#endif
+#ifndef SETPOINT_RING
+# define SETPOINT_RING         512    /* look-ahead / stream queue per axis (power of two)      */
+#endif
+#ifndef TRAJ_BLOCK
+# define TRAJ_BLOCK            64     /* set-points per ServoTraj_Service() pass (producer)      */
+#endif
+#ifndef FE_WINDOW_COUNTS
+# define FE_WINDOW_COUNTS      20000  /* Example following-error window (counts).                      */
+#endif
+#ifndef FE_WARN_PCT
+# define FE_WARN_PCT           80     /* Warn at % of window (clear at half of that).                  */
+#endif
+#ifndef FAULT_COOLDOWN_MS
+# define FAULT_COOLDOWN_MS     250    /* After fault clears, stay in Shutdown (CW=0x0006) for ms.      */
+#endif
+#ifndef COMM_COOLDOWN_MS
+# define COMM_COOLDOWN_MS      0      /* Optional: cooldown after comm restore (usually 0 if unused).  */
+#endif
+
+/* Fault recovery (CiA-402 engine, 7b). A fault that recurs within CSP_402_RETRY_WINDOW_MS of
+   reaching OperationEnabled counts as a retry: its cooldown doubles (≤ CSP_402_BACKOFF_MAX_MS),
+   and after CSP_402_RETRY_MAX retries the axis locks out until ServoAxis_ClearFault()
+   (0 = retry forever). CSP_402_FAST_REENABLE=1 makes the first attempt after a fault skip
+   the cooldown and the separate SwitchOn step (CW 0x000F straight from ReadyToSwitchOn,
+   transitions 3+4; check the drive supports it). CSP_402_STEP_TIMEOUT_MS: give up on a
+   Shutdown/SwitchOn/Enable step that long and retry it after a backoff (0 = wait forever). */
+#ifndef CSP_402_FAST_REENABLE
+# define CSP_402_FAST_REENABLE   0
+#endif
+#ifndef CSP_402_RETRY_MAX
+# define CSP_402_RETRY_MAX       0
+#endif
+#ifndef CSP_402_RETRY_WINDOW_MS
+# define CSP_402_RETRY_WINDOW_MS 2000
+#endif
+#ifndef CSP_402_BACKOFF_MAX_MS
+# define CSP_402_BACKOFF_MAX_MS  4000
+#endif
+#ifndef CSP_402_STEP_TIMEOUT_MS
+# define CSP_402_STEP_TIMEOUT_MS 0
+#endif
+
+/* Derived timebase. The *_MS knobs above are converted to whole ticks once at init
+   (rounded up), so the cyclic path only counts ticks down. */
+#define LOOP_PERIOD_NS         ((int64_t)LOOP_PERIOD_US * 1000)
+#define LOOP_SLACK_NS          (LOOP_PERIOD_NS / 4)   /* a call ≤¼ period early still counts  */
+#define CSP_MS_TO_TICKS(ms)    ((int)(((int64_t)(ms) * 1000 + LOOP_PERIOD_US - 1) / LOOP_PERIOD_US))
+#if LOOP_PERIOD_US <= 0
+# error "LOOP_PERIOD_US must be > 0"
+#endif
 
 /* New-setpoint edge policy on CW bit4 (Omron CSP expects an *edge*):
    0 = ON_TICK   (toggle bit4 every loop)
    1 = ON_CHANGE (toggle bit4 only when target_position changes)  ← baseline-friendly */
-#define SETPOINT_EDGE_POLICY   1
+#ifndef SETPOINT_EDGE_POLICY
+# define SETPOINT_EDGE_POLICY  1
+#endif
+
+/* What the producer does when Run() is called one or more periods late (host starved):
+   0 = SKIP        (one step; missed periods are dropped → commanded velocity sags)
+   1 = CATCHUP     (replay up to OVERRUN_MAX_CATCHUP steps now, bounded by OVERRUN_MAX_DELTA;
+                    the rest stays as backlog for the next ticks)
+   2 = EXTRAPOLATE (one step of k× the current delta for k due periods, bounded the same way)
+   Missed periods, overrun events and worst lateness are counted per axis in all modes. */
+#ifndef OVERRUN_POLICY
+# define OVERRUN_POLICY        0
+#endif
+#ifndef OVERRUN_MAX_CATCHUP
+# define OVERRUN_MAX_CATCHUP   4               /* CATCHUP: steps per tick                    */
+#endif
+#ifndef OVERRUN_MAX_DELTA
+# define OVERRUN_MAX_DELTA     (4*INC_STEP)    /* |Δtarget| per tick while catching up       */
+#endif
+#ifndef OVERRUN_MAX_BACKLOG
+# define OVERRUN_MAX_BACKLOG   100             /* periods of backlog before resync (drop)    */
+#endif
 
 /* Keep the Omron example ON (1) to document SDOs and IDs used in the field. */
-#define OMRON_R88D_EXAMPLE     1
+#ifndef OMRON_R88D_EXAMPLE
+# define OMRON_R88D_EXAMPLE    1
+#endif
 
 #if OMRON_R88D_EXAMPLE
   #define DRIVE_VENDOR_ID      0x00000083   /* Omron */
   #define DRIVE_PRODUCT_ID     0x00000002   /* R88D-1SN */
   #define WRITE_6060_MODE_CSP  1            /* 6060:0 = 8 (CSP) */
-  #define WRITE_60C2_1_US      1            /* 60C2:1 = 1000 us (match LOOP_PERIOD_MS) */
+  #define WRITE_60C2_1_US      1            /* 60C2:1 = LOOP_PERIOD_US (µs)        */
   #define WRITE_6065_FE_WIN    1            /* 6065:0 = FE_WINDOW_COUNTS */
   #define WRITE_10F1_1_WDT     0            /* 10F1:1 (ms) — vendor-specific; leave 0 unless required */
 #endif
 
+/* Platform / real-time knobs (override with -D...) */
+#ifndef CSP_CACHE_LINE
+# define CSP_CACHE_LINE        64     /* Typical L1 line (x86, Cortex-A). Keep a power of two.     */
+#endif
+#ifndef CSP_LOG_DEFERRED
+# define CSP_LOG_DEFERRED      0      /* 1 = logs go to a lock-free ring, printed by a drain thread */
+#endif
+#ifndef CSP_LOG_RING_SIZE
+# define CSP_LOG_RING_SIZE     1024   /* Records per ring (power of two), 64 bytes each.            */
+#endif
+#ifndef CSP_CYCLE_STATS
+# define CSP_CYCLE_STATS       1      /* 1 = time every Run()/RunBatch() into lock-free histograms */
+#endif
+/* Image capabilities: what YOUR master guarantees for the pointers map_io() returns.
+   The template then picks single-load accessors where a field is aligned, and a batched
+   byte swap on big-endian hosts; anything not guaranteed uses the unaligned helpers. */
+#ifndef CSP_IMAGE_ALIGN
+# define CSP_IMAGE_ALIGN       1      /* base alignment (bytes) of each slave's in/out block       */
+#endif
+#if CSP_IMAGE_ALIGN <= 0 || (CSP_IMAGE_ALIGN & (CSP_IMAGE_ALIGN - 1))
+# error "CSP_IMAGE_ALIGN must be a power of two"
+#endif
+#ifndef CSP_IMAGE_HOST_ORDER
+# define CSP_IMAGE_HOST_ORDER  0      /* 1 = master converts the image to host byte order          */
+#endif
+#ifndef CSP_PI_SNAPSHOT
+# define CSP_PI_SNAPSHOT       1      /* 1 = tick on local PDO copies (snapshot in, block publish)  */
+#endif
+#ifndef CSP_WITH_RUNNER
+# define CSP_WITH_RUNNER       0      /* 1 = build the reference cyclic task (section 9, -pthread)  */
+#endif
+#ifndef CSP_FEED_FORWARD
+# define CSP_FEED_FORWARD      0      /* 1 = map 60B1 velocity / 60B2 torque offset (section 3)     */
+#endif
+#ifndef CSP_DC_SHIFT_US
+# define CSP_DC_SHIFT_US       (LOOP_PERIOD_US / 2) /* DC lock: frame this long before SYNC0 (4h) */
+#endif
+#ifndef CSP_SIM_MAIN
+# define CSP_SIM_MAIN          0      /* 1 = offline soak/profiling main() on simulated drives (4f) */
+#endif
+#ifndef CSP_SIM_DRIVE
+# define CSP_SIM_DRIVE         CSP_SIM_MAIN /* 1 = simulated CiA-402 drives behind section 4 (4f) */
+#endif
+#ifndef CSP_REPLAY_MAIN
+# define CSP_REPLAY_MAIN       0      /* 1 = main() that replays a recording and diffs outputs (10)  */
+#endif
+#ifndef CSP_RECORD
+# define CSP_RECORD            CSP_REPLAY_MAIN /* 1 = record/replay of the process image (4g)   */
+#endif
+#if CSP_SIM_MAIN && CSP_REPLAY_MAIN
+# error "CSP_SIM_MAIN and CSP_REPLAY_MAIN each provide main(): pick one"
+#endif
+
 /* ================================
    2) LITTLE-ENDIAN SAFE HELPERS
    ================================ */
-static inline uint16_t le_get_u16(const uint8_t *p){ uint16_t v; memcpy(&v,p,2); return v; }
-static inline void     le_set_u16(uint8_t *p, uint16_t v){ memcpy(p,&v,2); }
-static inline uint32_t le_get_u32(const uint8_t *p){ uint32_t v; memcpy(&v,p,4); return v; }
-static inline void     le_set_u32(uint8_t *p, uint32_t v){ memcpy(p,&v,4); }
+/* The EtherCAT image is little-endian on the wire. A big-endian host swaps every
+   multi-byte field once; masters that already hand out a host-order image say so with
+   CSP_IMAGE_HOST_ORDER=1 (section 1 capability knobs). */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define CSP_HOST_BE           1
+#else
+# define CSP_HOST_BE           0
+#endif
+#define CSP_IMAGE_SWAP         (CSP_HOST_BE && !CSP_IMAGE_HOST_ORDER)  /* image bytes ≠ host order */
+
+#if defined(__GNUC__)
+# define csp_bswap16(v)        __builtin_bswap16(v)
+# define csp_bswap32(v)        __builtin_bswap32(v)
+# define CSP_ASSUME_ALIGNED(p, n)  __builtin_assume_aligned((p), (n))
+#else
+static inline uint16_t csp_bswap16(uint16_t v){ return (uint16_t)((v >> 8) | (v << 8)); }
+static inline uint32_t csp_bswap32(uint32_t v){
+    return (v >> 24) | ((v >> 8) & 0xFF00u) | ((v << 8) & 0xFF0000u) | (v << 24);
+}
+# define CSP_ASSUME_ALIGNED(p, n)  (p)
+#endif
+
+/* Host-order access: any alignment (h_*) or naturally aligned (h_*a). The aligned form
+   tells the compiler so, and it emits one load/store even on targets where it must
+   assume a packed field is misaligned. */
+static inline uint16_t h_get_u16 (const uint8_t *p){ uint16_t v; memcpy(&v,p,2); return v; }
+static inline void     h_set_u16 (uint8_t *p, uint16_t v){ memcpy(p,&v,2); }
+static inline uint32_t h_get_u32 (const uint8_t *p){ uint32_t v; memcpy(&v,p,4); return v; }
+static inline void     h_set_u32 (uint8_t *p, uint32_t v){ memcpy(p,&v,4); }
+static inline uint16_t h_get_u16a(const uint8_t *p){ uint16_t v; memcpy(&v,CSP_ASSUME_ALIGNED(p,2),2); return v; }
+static inline void     h_set_u16a(uint8_t *p, uint16_t v){ memcpy(CSP_ASSUME_ALIGNED(p,2),&v,2); }
+static inline uint32_t h_get_u32a(const uint8_t *p){ uint32_t v; memcpy(&v,CSP_ASSUME_ALIGNED(p,4),4); return v; }
+static inline void     h_set_u32a(uint8_t *p, uint32_t v){ memcpy(CSP_ASSUME_ALIGNED(p,4),&v,4); }
+
+/* Little-endian (wire order) access, any alignment, any host. */
+static inline uint16_t le_get_u16(const uint8_t *p){ uint16_t v = h_get_u16(p); return CSP_HOST_BE ? csp_bswap16(v) : v; }
+static inline void     le_set_u16(uint8_t *p, uint16_t v){ h_set_u16(p, CSP_HOST_BE ? csp_bswap16(v) : v); }
+static inline uint32_t le_get_u32(const uint8_t *p){ uint32_t v = h_get_u32(p); return CSP_HOST_BE ? csp_bswap32(v) : v; }
+static inline void     le_set_u32(uint8_t *p, uint32_t v){ h_set_u32(p, CSP_HOST_BE ? csp_bswap32(v) : v); }
 
 /* Fallback macros if your master doesn’t provide EC_GET/SET (unaligned + LE safe) */
 #ifndef EC_GETWORD
+# define CSP_EC_FALLBACK      1
 # define EC_GETWORD(p)        le_get_u16((const uint8_t*)(p))
 # define EC_SETWORD(p,v)      le_set_u16((uint8_t*)(p),(uint16_t)(v))
 # define EC_GETUINT32(p)      le_get_u32((const uint8_t*)(p))
 # define EC_SETUINT32(p,v)    le_set_u32((uint8_t*)(p),(uint32_t)(v))
+#else
+# define CSP_EC_FALLBACK      0      /* master macros win; the fast paths in section 5 are off   */
 #endif
 
 /* Simple logs (replace with your logger if needed) */
 #ifndef LOG_TAG
 # define LOG_TAG "CSP_TEMPLATE"
 #endif
+#if !CSP_LOG_DEFERRED
 #define LOGF(fmt, ...)   printf("[%s] " fmt "\n", LOG_TAG, ##__VA_ARGS__)
 #define DBGF(fmt, ...)   printf("[%s][DBG] " fmt "\n", LOG_TAG, ##__VA_ARGS__)
 #define WARNF(fmt, ...)  printf("[%s][WRN] " fmt "\n", LOG_TAG, ##__VA_ARGS__)
 #define ERRF(fmt, ...)   printf("[%s][ERR] " fmt "\n", LOG_TAG, ##__VA_ARGS__)
+#define CSP_LOG_TICK()   ((void)0)
+#else
+/* Deferred logs: printf() may block for hundreds of µs, so the cyclic task never calls it.
+   Each call stores a fixed 64-byte record (format pointer = format id, up to
+   CSP_LOG_MAX_ARGS integer args, cycle stamp) into a wait-free SPSC ring; a non-RT drain
+   thread formats and writes them. A full ring drops the record and counts it.
+
+   Rules: arguments must be integer-valued (%d %u %x %zu %ld %c … — pointers/doubles are
+   not captured), LOG_TAG must be a string literal, and each ring has ONE producer thread
+   (bind extra RT threads to their own ring with ServoLog_BindRing()). */
+#include <pthread.h>
+
+#define CSP_LOG_MAX_ARGS       4
+#define CSP_LOG_MAX_RINGS      8
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    uint64_t    cycle;                 /* producer cycle counter at log time                   */
+    const char *fmt;                   /* static format string (its address is the format id)  */
+    uint32_t    nargs;
+    long long   arg[CSP_LOG_MAX_ARGS];
+} Servo_LogRecord;
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t head;             /* written by the producer only                         */
+    uint32_t         tail_cache;       /* producer's last view of tail                         */
+    uint64_t         cycle;            /* producer's cycle stamp (CSP_LOG_TICK)                */
+    _Atomic uint64_t dropped;          /* records lost to a full ring                          */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t tail;             /* written by the drain only                            */
+    uint64_t         dropped_seen;     /* drain's last reported drop count                     */
+    Servo_LogRecord  rec[CSP_LOG_RING_SIZE];
+} Servo_LogRing;
+
+static Servo_LogRing                 g_log_ring;                    /* default ring            */
+static _Thread_local Servo_LogRing  *tls_log_ring = &g_log_ring;    /* ring of this thread     */
+static Servo_LogRing * _Atomic       g_log_rings[CSP_LOG_MAX_RINGS] = { &g_log_ring };
+
+static void servo_log_push(const char *fmt, size_t nargs, const long long *args)
+{
+    Servo_LogRing *r = tls_log_ring;
+    const uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h - r->tail_cache >= CSP_LOG_RING_SIZE){
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (h - r->tail_cache >= CSP_LOG_RING_SIZE){
+            atomic_store_explicit(&r->dropped,
+                atomic_load_explicit(&r->dropped, memory_order_relaxed) + 1, memory_order_relaxed);
+            return;
+        }
+    }
+    Servo_LogRecord *rec = &r->rec[h & (CSP_LOG_RING_SIZE - 1)];
+    rec->cycle = r->cycle;
+    rec->fmt   = fmt;
+    rec->nargs = (uint32_t)(nargs < CSP_LOG_MAX_ARGS ? nargs : CSP_LOG_MAX_ARGS);
+    memcpy(rec->arg, args, sizeof rec->arg);
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+#define CSP_LOG_ARGV(...)    ((const long long[CSP_LOG_MAX_ARGS + 1]){ 0, ##__VA_ARGS__ } + 1)
+#define CSP_LOG_ARGC(...)    (sizeof((long long[]){ 0, ##__VA_ARGS__ }) / sizeof(long long) - 1u)
+/* A fifth argument would not fit the record (the compound literal above only warns and
+   drops it): make it a compile error at the call site instead. */
+#define CSP_LOG_ARGS_OK(...) ((void)sizeof(struct { _Static_assert(CSP_LOG_ARGC(__VA_ARGS__) <= CSP_LOG_MAX_ARGS, \
+                                  "deferred log call with more than CSP_LOG_MAX_ARGS arguments"); int ok_; }))
+#define CSP_LOG_PUSH(pfx, fmt, ...) \
+    (CSP_LOG_ARGS_OK(__VA_ARGS__), \
+     servo_log_push("[" LOG_TAG "]" pfx " " fmt "\n", CSP_LOG_ARGC(__VA_ARGS__), CSP_LOG_ARGV(__VA_ARGS__)))
+#define LOGF(fmt, ...)   CSP_LOG_PUSH("",      fmt, ##__VA_ARGS__)
+#define DBGF(fmt, ...)   CSP_LOG_PUSH("[DBG]", fmt, ##__VA_ARGS__)
+#define WARNF(fmt, ...)  CSP_LOG_PUSH("[WRN]", fmt, ##__VA_ARGS__)
+#define ERRF(fmt, ...)   CSP_LOG_PUSH("[ERR]", fmt, ##__VA_ARGS__)
+#define CSP_LOG_TICK()   ((void)tls_log_ring->cycle++)
+
+/* Use `r` for logs of the calling thread and register it with the drain. Call once at
+   thread start (before its first log). Returns 0, or -1 when all slots are taken. */
+int ServoLog_BindRing(Servo_LogRing *r)
+{
+    for (int i = 0; i < CSP_LOG_MAX_RINGS; i++){
+        Servo_LogRing *expect = NULL;
+        if (atomic_load(&g_log_rings[i]) == r ||
+            atomic_compare_exchange_strong(&g_log_rings[i], &expect, r)){
+            tls_log_ring = r;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Records lost to a full ring, summed over all rings (readable from any thread). */
+uint64_t ServoLog_Dropped(void)
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < CSP_LOG_MAX_RINGS; i++){
+        Servo_LogRing *r = atomic_load(&g_log_rings[i]);
+        if (r) sum += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+    }
+    return sum;
+}
+
+/* Format one record. Each conversion is re-issued with an explicit `ll` length so the
+   stored long long is passed with the type printf expects. */
+static void servo_log_format(FILE *f, const Servo_LogRecord *rec)
+{
+    const char *p = rec->fmt;
+    uint32_t a = 0;
+    while (*p){
+        if (*p != '%'){ fputc(*p++, f); continue; }
+        if (p[1] == '%'){ fputc('%', f); p += 2; continue; }
+
+        char spec[32]; size_t k = 0;
+        spec[k++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && k < sizeof spec - 4) spec[k++] = *p++;
+        while (*p && strchr("hljztL", *p)) p++;         /* drop the original length modifier */
+        const char conv = *p ? *p++ : 'd';
+        const long long v = (a < rec->nargs) ? rec->arg[a++] : 0;
+        if (strchr("di", conv)){
+            spec[k++] = 'l'; spec[k++] = 'l'; spec[k++] = conv; spec[k] = 0;
+            fprintf(f, spec, v);
+        } else if (strchr("uxXo", conv)){
+            spec[k++] = 'l'; spec[k++] = 'l'; spec[k++] = conv; spec[k] = 0;
+            fprintf(f, spec, (unsigned long long)v);
+        } else if (conv == 'c'){
+            spec[k++] = 'c'; spec[k] = 0;
+            fprintf(f, spec, (int)v);
+        } else {
+            fputc('?', f);                               /* not capturable: see rules above   */
+        }
+    }
+}
+
+/* Each ring has ONE consumer: either your own ServoLog_Drain() calls or the drain thread
+   below. While the thread runs (StartDrainThread … StopDrainThread returned) it owns the
+   rings and ServoLog_Drain() does nothing. */
+static atomic_int  g_log_run;          /* drain thread owns the rings                          */
+static atomic_int  g_log_quit;
+
+static size_t servo_log_drain(FILE *f)
+{
+    size_t n = 0;
+    for (int i = 0; i < CSP_LOG_MAX_RINGS; i++){
+        Servo_LogRing *r = atomic_load(&g_log_rings[i]);
+        if (!r) continue;
+        uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        const uint32_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (; t != h; t++, n++){
+            servo_log_format(f, &r->rec[t & (CSP_LOG_RING_SIZE - 1)]);
+            atomic_store_explicit(&r->tail, t + 1, memory_order_release);
+        }
+        const uint64_t d = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        if (d != r->dropped_seen){
+            fprintf(f, "[%s][WRN] log ring %d overflowed: %llu records dropped (total %llu)\n",
+                    LOG_TAG, i, (unsigned long long)(d - r->dropped_seen), (unsigned long long)d);
+            r->dropped_seen = d;
+        }
+    }
+    if (n) fflush(f);
+    return n;
+}
+
+/* Drain every registered ring into `f`. Call from a non-RT thread only. Returns the number
+   of records written; 0 without touching the rings while the drain thread runs. */
+size_t ServoLog_Drain(FILE *f)
+{
+    if (atomic_load(&g_log_run)) return 0;
+    return servo_log_drain(f);
+}
+
+/* Optional drain thread: polls the rings every `poll_ms` and prints to stdout. */
+static pthread_t   g_log_thread;
+static unsigned    g_log_poll_ms;
+
+static void *servo_log_thread(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&g_log_quit)){
+        if (servo_log_drain(stdout) == 0){
+            struct timespec req = { g_log_poll_ms/1000, (long)(g_log_poll_ms%1000)*1000000L };
+            nanosleep(&req, NULL);
+        }
+    }
+    servo_log_drain(stdout);
+    return NULL;
+}
+
+/* -1 if it could not start or already runs (one consumer per ring). */
+int ServoLog_StartDrainThread(unsigned poll_ms)
+{
+    if (atomic_exchange(&g_log_run, 1)) return -1;
+    g_log_poll_ms = poll_ms ? poll_ms : 1;
+    atomic_store(&g_log_quit, 0);
+    if (pthread_create(&g_log_thread, NULL, servo_log_thread, NULL) != 0){ atomic_store(&g_log_run, 0); return -1; }
+    return 0;
+}
+
+/* Stops and joins the thread (after a last drain); ServoLog_Drain() works again after. */
+void ServoLog_StopDrainThread(void)
+{
+    if (!atomic_load(&g_log_run)) return;
+    atomic_store(&g_log_quit, 1);
+    pthread_join(g_log_thread, NULL);
+    atomic_store(&g_log_run, 0);
+}
+#endif
 
 /* =======================================
    3) PROCESS IMAGE (PDO) → C STRUCTS
    =======================================
 
    WHY structs? They make the process image readable and type-safe.
-   Make sure sizes and order match your ESI/ENI PDO mapping exactly. */
+   Make sure sizes and order match your ESI/ENI PDO mapping exactly — or generate them:
+   tools/pdo_gen.py reads the ENI/ESI and writes a header with these two structs in the
+   bus order, constant offsets, static asserts and per-field alignment flags; build with
+   -DCSP_PDO_LAYOUT_HEADER='"pdo_layout.h"' and the hand-written pair below is skipped.
+   Fields the template uses: status_word, position_actual_value, following_error_actual,
+   control_word, target_position (the generator refuses a mapping without them).
+   Optional fields are used when the layout has them (CSP_PDO_HAS_<field>): error_code
+   (603F, trace/telemetry), velocity_offset (60B1) and torque_offset (60B2) for
+   feed-forward — CSP_FEED_FORWARD=1 adds those two to the hand-written outputs; the
+   drive must map them too (custom RxPDO, e.g. 0x1600). */
+#ifdef CSP_PDO_LAYOUT_HEADER
+# include CSP_PDO_LAYOUT_HEADER
+#else
 #pragma pack(push,1)
 typedef struct {
     /* Typical minimal inputs for CSP: */
@@ -100,9 +522,56 @@ typedef struct {
 typedef struct {
     uint16_t control_word;             /* 0x6040:0 — CiA-402 commands                          */
     int32_t  target_position;          /* 0x607A:0 — desired position (counts)                 */
+#if CSP_FEED_FORWARD
+    int32_t  velocity_offset;          /* 0x60B1:0 — velocity feed-forward (command units/s)   */
+    int16_t  torque_offset;            /* 0x60B2:0 — torque feed-forward (0.1 % rated torque)  */
+#endif
 } Drive_Outputs;
 #pragma pack(pop)
 
+/* Multi-byte fields as X(name, bytes): the big-endian batch swap walks these. */
+#define CSP_PDO_IN_FIELDS(X)  X(status_word, 2) X(position_actual_value, 4) \
+                              X(following_error_actual, 4) X(error_code, 2)
+#if CSP_FEED_FORWARD
+# define CSP_PDO_OUT_FIELDS(X) X(control_word, 2) X(target_position, 4) \
+                               X(velocity_offset, 4) X(torque_offset, 2)
+#else
+# define CSP_PDO_OUT_FIELDS(X) X(control_word, 2) X(target_position, 4)
+#endif
+
+/* Optional fields present in this layout. */
+#define CSP_PDO_HAS_error_code                     1
+#if CSP_FEED_FORWARD
+# define CSP_PDO_HAS_velocity_offset               1
+# define CSP_PDO_HAS_torque_offset                 1
+#endif
+
+/* Natural alignment of each field inside its struct (…_ALIGNED_) and in the master image
+   (…_IMG_ALIGNED_, unknown here → 0). 1 lets the accessors in section 5 use one load. */
+#define CSP_PDO_ALIGNED_status_word                1
+#define CSP_PDO_ALIGNED_position_actual_value      0
+#define CSP_PDO_ALIGNED_following_error_actual     0
+#define CSP_PDO_ALIGNED_error_code                 1
+#define CSP_PDO_ALIGNED_control_word               1
+#define CSP_PDO_ALIGNED_target_position            0
+#define CSP_PDO_IMG_ALIGNED_status_word            0
+#define CSP_PDO_IMG_ALIGNED_position_actual_value  0
+#define CSP_PDO_IMG_ALIGNED_following_error_actual 0
+#define CSP_PDO_IMG_ALIGNED_error_code             0
+#define CSP_PDO_IMG_ALIGNED_control_word           0
+#define CSP_PDO_IMG_ALIGNED_target_position        0
+#define CSP_PDO_ALIGNED_velocity_offset            0
+#define CSP_PDO_ALIGNED_torque_offset              1
+#define CSP_PDO_IMG_ALIGNED_velocity_offset        0
+#define CSP_PDO_IMG_ALIGNED_torque_offset          0
+#endif /* CSP_PDO_LAYOUT_HEADER */
+
+#if defined(CSP_PDO_HAS_velocity_offset) || defined(CSP_PDO_HAS_torque_offset)
+# define CSP_FF_MAPPED         1      /* producer emits feed-forward (7b)                      */
+#else
+# define CSP_FF_MAPPED         0
+#endif
+
 #define DRIVE_INPUTS_BITS   (sizeof(Drive_Inputs)*8u)
 #define DRIVE_OUTPUTS_BITS  (sizeof(Drive_Outputs)*8u)
 
@@ -119,22 +588,62 @@ typedef struct {
 typedef void* EcDevice;
 typedef void* EcSlave;
 
-/* Monotonic time and sleep */
-static inline long now_ms(void){
+/* Injectable clock, for the simulated drives (4f) and replay (4g): while injected,
+   now_ns() returns g_clock_ns and sleep_ms() advances it instead of sleeping. */
+#define CSP_CLOCK_INJECT       (CSP_SIM_DRIVE || CSP_RECORD)
+#if CSP_CLOCK_INJECT
+static int64_t g_clock_ns;             /* injected time (ns)                                   */
+static int     g_clock_injected;       /* 1 = now_ns()/sleep_ms() use it                       */
+#endif
+
+#if CSP_SIM_DRIVE
+/* Simulated drives (4f) stand behind every stub below. */
+static int  servo_sim_map(int slave, Drive_Inputs **in, Drive_Outputs **out);
+static int  servo_sim_sdo_write(int slave, uint16_t idx, uint8_t sub, uint32_t v);
+static int  servo_sim_sdo_read(int slave, uint16_t idx, uint8_t sub, uint8_t data[4]);
+static int  servo_sim_sdo_async_start(int slave, uint16_t idx, uint8_t sub, int write, const uint8_t *data, size_t len);
+static int  servo_sim_sdo_async_poll(int handle, uint8_t data[4], uint32_t *abort_code);
+static void servo_sim_state_request(EcSlave s, int state);
+static int  servo_sim_state_get(EcSlave s);
+static int  servo_sim_dc_time(int64_t *dc_ns);
+#endif
+
+/* Monotonic time (ns) and sleep */
+static inline int64_t now_ns(void){
+#if CSP_CLOCK_INJECT
+    if (g_clock_injected) return g_clock_ns;
+#endif
     struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (long)(ts.tv_sec*1000L + ts.tv_nsec/1000000L);
+    return (int64_t)ts.tv_sec*1000000000LL + ts.tv_nsec;
 }
 static inline void sleep_ms(unsigned ms){
+#if CSP_CLOCK_INJECT
+    if (g_clock_injected){ g_clock_ns += (int64_t)ms * 1000000; return; }
+#endif
     struct timespec req = { ms/1000, (ms%1000)*1000000L };
     nanosleep(&req, NULL);
 }
 
+#if CSP_CLOCK_INJECT
+/* 1: now_ns() returns ServoClock_Set() time (starting from the real clock); 0: back to
+   CLOCK_MONOTONIC. ServoClock_Set() from the thread that runs the tick, between ticks. */
+void ServoClock_Inject(int on)
+{
+    if (on && !g_clock_injected) g_clock_ns = now_ns();
+    g_clock_injected = on;
+}
+void ServoClock_Set(int64_t ns){ g_clock_ns = ns; }
+#endif
+
 /* Map your process image pointers from ENI bit offsets. Return 0 on success. */
 static int map_io(EcDevice dev, int slave_index,
                   size_t in_off_bits, size_t out_off_bits,
                   Drive_Inputs **in, Drive_Outputs **out)
 {
     (void)dev; (void)slave_index; (void)in_off_bits; (void)out_off_bits;
+#if CSP_SIM_DRIVE
+    return servo_sim_map(slave_index, in, out);
+#endif
     /* TODO:
        - Get image handle from the master
        - Translate bit offsets → byte offsets
@@ -146,215 +655,4900 @@ static int map_io(EcDevice dev, int slave_index,
 }
 
 /* CoE SDO writes. Return 0 on success. */
-static int sdo_write_u8 (EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint8_t  v){ (void)dev;(void)slave;(void)idx;(void)sub;(void)v; /* TODO */ return 0; }
-static int sdo_write_u32(EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint32_t v){ (void)dev;(void)slave;(void)idx;(void)sub;(void)v; /* TODO */ return 0; }
+#if CSP_SIM_DRIVE
+# define CSP_SIM_SDO(call)    return (call)
+#else
+# define CSP_SIM_SDO(call)    ((void)0)
+#endif
+static int sdo_write_u8 (EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint8_t  v){ CSP_SIM_SDO(servo_sim_sdo_write(slave, idx, sub, v)); (void)dev;(void)slave;(void)idx;(void)sub;(void)v; /* TODO */ return 0; }
+static int sdo_write_u16(EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint16_t v){ CSP_SIM_SDO(servo_sim_sdo_write(slave, idx, sub, v)); (void)dev;(void)slave;(void)idx;(void)sub;(void)v; /* TODO */ return 0; }
+static int sdo_write_u32(EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint32_t v){ CSP_SIM_SDO(servo_sim_sdo_write(slave, idx, sub, v)); (void)dev;(void)slave;(void)idx;(void)sub;(void)v; /* TODO */ return 0; }
+/* Mask of a `len`-byte (1, 2 or 4) CoE value. */
+static inline uint32_t servo_sdo_mask(size_t len)
+{
+    return len >= 4 ? 0xFFFFFFFFu : ((1u << (8*len)) - 1u);
+}
 
-/* Optional: drive state control (PREOP/OP). Often handled elsewhere in your app. */
-static void state_request(EcSlave s, int state){ (void)s; (void)state; /* TODO */ }
-static int  state_get    (EcSlave s){ (void)s; return 0; /* TODO: DEVICE_STATE_* */ }
+/* CoE SDO read of up to 4 bytes (little-endian into data). Return 0 on success. */
+static int sdo_read(EcDevice dev, int slave, uint16_t idx, uint8_t sub, uint8_t *data, size_t len){ (void)dev;(void)slave;(void)idx;(void)sub;(void)len; memset(data, 0, 4); CSP_SIM_SDO(servo_sim_sdo_read(slave, idx, sub, data)); /* TODO */ return -1; }
 
-/* ===================================
-   5) GLOBAL POINTERS + BYTE HELPERS
-   =================================== */
-static Drive_Inputs  *g_in  = NULL;
-static Drive_Outputs *g_out = NULL;
+/* Asynchronous CoE (optional, used by the batched SDO plan in 6a). start() queues one
+   upload (write=0) or download (write=1) of `len` little-endian bytes (copy `data`
+   before returning) and returns a handle ≥ 0, or -1 when your master has no async CoE
+   (the plan then uses the blocking calls above). poll() returns 1 while pending, 0 when
+   done (reads: data in `data`), < 0 on failure with the SDO abort code in *abort_code. */
+static int sdo_async_start(EcDevice dev, int slave, uint16_t idx, uint8_t sub, int write, const uint8_t *data, size_t len)
+{ CSP_SIM_SDO(servo_sim_sdo_async_start(slave, idx, sub, write, data, len)); (void)dev;(void)slave;(void)idx;(void)sub;(void)write;(void)data;(void)len; /* TODO */ return -1; }
+static int sdo_async_poll(EcDevice dev, int handle, uint8_t data[4], uint32_t *abort_code)
+{ CSP_SIM_SDO(servo_sim_sdo_async_poll(handle, data, abort_code)); (void)dev;(void)handle;(void)data; *abort_code = 0; /* TODO */ return -1; }
 
-#define IN_PTR(field)   (((uint8_t*)g_in)  + offsetof(Drive_Inputs,  field))
-#define OUT_PTR(field)  (((uint8_t*)g_out) + offsetof(Drive_Outputs, field))
+/* EtherCAT AL states (AL control 0x0120 / AL status 0x0130, low nibble) and the error
+   bit (status: error indicator; control: error acknowledge). */
+#define EC_AL_INIT     0x01
+#define EC_AL_PREOP    0x02
+#define EC_AL_BOOT     0x03
+#define EC_AL_SAFEOP   0x04
+#define EC_AL_OP       0x08
+#define EC_AL_MASK     0x0F
+#define EC_AL_ERROR    0x10
 
-/* ===================================
-   6) INITIALIZATION (map + SDOs)
-   ===================================
+/* Optional: slave state control (PREOP/OP). Often handled elsewhere in your app.
+   state_request() writes AL control (EC_AL_* | EC_AL_ERROR to acknowledge an error);
+   state_get() returns AL status (EC_AL_* | EC_AL_ERROR); state_al_code() the AL status
+   code 0x0134 (e.g. 0x001D invalid output configuration) of a slave in error. */
+#if CSP_SIM_DRIVE
+static void     state_request(EcSlave s, int state){ servo_sim_state_request(s, state); }
+static int      state_get    (EcSlave s){ return servo_sim_state_get(s); }
+#else
+static void     state_request(EcSlave s, int state){ (void)s; (void)state; /* TODO */ }
+static int      state_get    (EcSlave s){ (void)s; return 0; /* TODO: EC_AL_* */ }
+#endif
+static uint16_t state_al_code(EcSlave s){ (void)s; return 0; /* TODO */ }
+/* AL status of n slaves. The default reads them one by one; if your master can read the
+   AL status of many slaves in one frame (a burst of FPRDs), do that here: the group
+   transition (6c) polls the whole group through this call once per sweep. */
+static void state_get_group(EcSlave const s[], size_t n, uint16_t al[])
+{
+    for (size_t i = 0; i < n; i++) al[i] = (uint16_t)state_get(s[i]);
+}
 
-   WHAT: Map PDOs and (optionally) program SDOs for CSP.
-   WHY: Keep wiring + drive setup explicit and in one place.
-*/
-int ServoTemplate_Init(EcDevice dev,
-                       int slave_index,
-                       size_t eni_in_bits, size_t eni_out_bits,
-                       size_t eni_in_off_bits, size_t eni_out_off_bits)
+/* Optional: distributed clock (DC lock of the cycle, 4h). DC system time (ns) at which the
+   reference clock saw the last cyclic frame — SOEM: ec_DCtime after ec_receive_processdata;
+   IgH: ecrt_master_reference_clock_time() (32-bit: extend it). Return 0, or -1 when the
+   master has no DC time for this cycle. */
+static int dc_time(EcDevice dev, int64_t *dc_ns)
 {
-    if (eni_in_bits != DRIVE_INPUTS_BITS || eni_out_bits != DRIVE_OUTPUTS_BITS){
-        WARNF("PDO size mismatch: ENI in=%zu out=%zu, struct in=%u out=%u",
-              eni_in_bits, eni_out_bits,
-              (unsigned)DRIVE_INPUTS_BITS, (unsigned)DRIVE_OUTPUTS_BITS);
-        /* In a real app: abort here. For teaching: continue so code is readable. */
-    }
+    (void)dev;
+#if CSP_SIM_DRIVE
+    return servo_sim_dc_time(dc_ns);
+#endif
+    *dc_ns = 0; /* TODO */
+    return -1;
+}
 
-    if (map_io(dev, slave_index, eni_in_off_bits, eni_out_off_bits, &g_in, &g_out) != 0){
-        WARNF("map_io() not implemented yet — template stays no-op until you wire it.");
-        g_in = g_out = NULL;
-    } else {
-        DBGF("PI mapped OK (bits in=%zu out=%zu)", eni_in_bits, eni_out_bits);
-    }
+/* ==========================================
+   4b) CYCLE INSTRUMENTATION (tail latency)
+   ==========================================
 
-#if OMRON_R88D_EXAMPLE
-    /* Omron R88D-1SN (CSP) example SDOs. Check your manual:
-       6060:0 = 8 (CSP), 60C2:1 = 1000 us (1 ms), 6065:0 = FE window.
-       10F1:1 watchdog is vendor-specific; keep off unless needed. */
-  #if WRITE_6060_MODE_CSP
-    (void)sdo_write_u8 (dev, slave_index, 0x6060, 0, 8);
-  #endif
-  #if WRITE_60C2_1_US
-    (void)sdo_write_u32(dev, slave_index, 0x60C2, 1, (uint32_t)(LOOP_PERIOD_MS*1000u));
-  #endif
-  #if WRITE_6065_FE_WIN
-    (void)sdo_write_u32(dev, slave_index, 0x6065, 0, (uint32_t)FE_WINDOW_COUNTS);
-  #endif
-  #if WRITE_10F1_1_WDT
-    (void)sdo_write_u32(dev, slave_index, 0x10F1, 1, 150);
-  #endif
-#endif
-    return 0;
+   WHAT: every Run()/RunBatch() records its execution time (CLOCK_MONOTONIC_RAW, not
+   slewed by NTP) and its start lateness vs. the expected tick start into log2 histograms.
+   WHY: the mean says nothing about the one tick in 10^5 that misses the frame.
+   Allocation-free; one writer (the cyclic thread) and any number of lock-free readers:
+   counters are relaxed atomics written with plain load+store (no locked RMW on the RT side),
+   so a reader may see a sample in `count` a moment before its bucket — fine for stats.
+   Lateness: when a runner passes its deadline (ServoStats_ExpectStart) that is the
+   reference; otherwise the previous expected start + LOOP_PERIOD_NS, re-anchored after a
+   gap of a whole period. Bucket i holds [2^i, 2^(i+1)) ns; percentiles are bucket upper bounds. */
+#define CSP_HIST_BUCKETS       40     /* 2^40 ns ≈ 18 min: plenty */
+
+typedef struct {
+    _Atomic uint64_t bucket[CSP_HIST_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic int64_t  min_ns;
+    _Atomic int64_t  max_ns;
+} Servo_Hist;
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    Servo_Hist exec;                   /* time spent inside Run()/RunBatch()                   */
+    Servo_Hist late;                   /* how late the call started vs. its expected start     */
+    int64_t    expect_ns;              /* writer only: expected start of the next call          */
+    int64_t    deadline_ns;            /* writer only: explicit deadline from the runner (0=none)*/
+    int64_t    last_late_ns;           /* writer only: lateness of the current call (trace)     */
+    int64_t    dc_offset_ns;           /* writer only: DC phase error of the last tick (4h)     */
+    int64_t    dc_shift_ns;            /* writer only: frame → SYNC0 distance held (4h)         */
+    int32_t    dc_drift_ppb;           /* writer only: reference clock vs. host rate (4h)       */
+    uint32_t   dc_flags;               /* writer only: CSP_DC_F_* (0 = no DC lock)              */
+} Servo_CycleStats;
+#define CSP_DC_F_ACTIVE        1u      /* a DC controller updates this thread's stats           */
+#define CSP_DC_F_LOCKED        2u      /* … and the phase is within lock_ns                     */
+
+typedef struct {
+    uint64_t count;
+    int64_t  min_ns, max_ns, mean_ns;
+    int64_t  p50_ns, p99_ns, p999_ns;
+} Servo_HistSummary;
+
+static inline int64_t now_raw_ns(void){
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (int64_t)ts.tv_sec*1000000000LL + ts.tv_nsec;
 }
 
-/* =========================================================
-   7) RUNTIME LOOP (CiA-402 + CSP set-point producer)
-   ========================================================= */
-void ServoTemplate_Run(EcDevice dev)
+#define CSP_RELAXED_ADD(a, v) \
+    atomic_store_explicit(&(a), atomic_load_explicit(&(a), memory_order_relaxed) + (v), memory_order_relaxed)
+
+static inline void servo_hist_add(Servo_Hist *h, int64_t v)
 {
-    (void)dev;
-    if (!g_in || !g_out) return; /* Not mapped yet → nothing to do */
-
-    /* State machine bookkeeping */
-    static int   st = 0;                   /* 0=Shutdown,1=SwitchOn,2=EnableOp aligning,3=Running */
-    static long  t0 = 0;                   /* loop scheduler reference (ms)                       */
-    static int32_t pos_tgt = 0;            /* current target position                             */
-    static int   dir = 1;                  /* +1 forward, -1 backward, 0 stopped (dwell)         */
-    static int   dwell_rem = 0;            /* ms remaining in dwell                               */
-    static int   ramp_rem  = 0;            /* ms remaining in ramp                                */
-    static int   fe_warn   = 0;            /* FE warning latched                                  */
-    static int   fault_cool_rem = 0;       /* post-fault cooldown (ms in Shutdown)                */
-    static int   comm_cool_rem  = COMM_COOLDOWN_MS; /* optional comm cooldown                        */
-    static uint16_t edge = 0;              /* bit4 toggler for “new set-point”                    */
+    if (v < 0) v = 0;
+    unsigned b = v < 2 ? 0u : (unsigned)(63 - __builtin_clzll((unsigned long long)v));
+    if (b >= CSP_HIST_BUCKETS) b = CSP_HIST_BUCKETS - 1;
+    CSP_RELAXED_ADD(h->bucket[b], 1);
+    CSP_RELAXED_ADD(h->sum_ns, (uint64_t)v);
+    const uint64_t c = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (c == 0 || v < atomic_load_explicit(&h->min_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->min_ns, v, memory_order_relaxed);
+    if (v > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+        atomic_store_explicit(&h->max_ns, v, memory_order_relaxed);
+    atomic_store_explicit(&h->count, c + 1, memory_order_release);
+}
 
-    /* Always read StatusWord safely; 0 means comm/state down → do nothing. */
-    const uint16_t SW = EC_GETWORD(IN_PTR(status_word));
-    if (SW == 0){
-        t0 = now_ms(); /* avoid backlog when link returns */
-        return;
-    }
+/* Reader side (any thread): min/max/mean and p50/p99/p99.9 from the buckets. */
+void ServoStats_Summarize(const Servo_Hist *h, Servo_HistSummary *out)
+{
+    memset(out, 0, sizeof *out);
+    const uint64_t n = atomic_load_explicit(&h->count, memory_order_acquire);
+    if (!n) return;
+    out->count   = n;
+    out->min_ns  = atomic_load_explicit(&h->min_ns, memory_order_relaxed);
+    out->max_ns  = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+    out->mean_ns = (int64_t)(atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / n);
 
-    /* Fault handling (SW bit3): send 0x0080 pulse; when cleared, keep FAULT_COOLDOWN_MS in Shutdown. */
-    if (SW & 0x0008){
-        /* Pulse Fault Reset: set 0x0080, then immediately release to 0x0006 on next tick. */
-        static int need_release = 0;
-        if (!need_release){
-            EC_SETWORD(OUT_PTR(control_word), 0x0080);
-            need_release = 1;
-            return;
-        } else {
-            EC_SETWORD(OUT_PTR(control_word), 0x0006); /* release pulse */
-            need_release = 0;
-            return;
-        }
-    } else {
-        /* If we just cleared a fault, enforce a cooldown in Shutdown. */
-        if (fault_cool_rem > 0){
-            EC_SETWORD(OUT_PTR(control_word), 0x0006); /* keep Shutdown */
-            long now = now_ms();
-            if (now - t0 >= 1){ fault_cool_rem--; t0 = now; }
-            return;
+    const uint64_t want[3] = { (n*500 + 999)/1000, (n*990 + 999)/1000, (n*999 + 999)/1000 };
+    int64_t *dst[3] = { &out->p50_ns, &out->p99_ns, &out->p999_ns };
+    uint64_t cum = 0; int q = 0;
+    for (unsigned b = 0; b < CSP_HIST_BUCKETS && q < 3; b++){
+        cum += atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+        while (q < 3 && cum >= want[q]){
+            const int64_t upper = (int64_t)((2ull << b) - 1);
+            *dst[q++] = upper < out->max_ns ? upper : out->max_ns;
         }
     }
+    while (q < 3) *dst[q++] = out->max_ns;
+}
 
-    /* Optional: cooldown after comm restore (kept simple) */
-    if (comm_cool_rem > 0){
-        EC_SETWORD(OUT_PTR(control_word), 0x0006);
-        long now = now_ms();
-        if (now - t0 >= 1){ comm_cool_rem--; t0 = now; }
-        return;
-    }
+static Servo_CycleStats                 g_cycle_stats;
+static _Thread_local Servo_CycleStats  *tls_cycle_stats = &g_cycle_stats;
 
-    /* Switch-on disabled? Go back to Shutdown. */
-    if (SW & 0x0040){
-        st = 0;
-        EC_SETWORD(OUT_PTR(control_word), 0x0006);
-        return;
-    }
+/* Stats of the default cyclic thread; other threads (shards) bind their own. */
+Servo_CycleStats *ServoStats_Default(void){ return &g_cycle_stats; }
+void ServoStats_Bind(Servo_CycleStats *s){ tls_cycle_stats = s; }
 
-    /* CiA-402 gating */
-    switch (st){
-        case 0: /* Want ReadyToSwitchOn (SW&0x006F)==0x0021 */
-            EC_SETWORD(OUT_PTR(control_word), 0x0006); /* Shutdown */
-            if ((SW & 0x006F) == 0x0021){ st = 1; DBGF("ReadyToSwitchOn"); }
-            return;
+/* Called by a runner right before the tick: the start lateness is measured vs. this. */
+void ServoStats_ExpectStart(int64_t deadline_ns){ tls_cycle_stats->deadline_ns = deadline_ns; }
 
-        case 1: /* Want SwitchedOn (SW&0x006F)==0x0023 */
-            EC_SETWORD(OUT_PTR(control_word), 0x0007); /* Switch on */
-            if ((SW & 0x006F) == 0x0023){ st = 2; DBGF("SwitchedOn"); }
-            return;
+#if CSP_CYCLE_STATS
+static inline int64_t servo_stats_begin(int64_t now)
+{
+    Servo_CycleStats *cs = tls_cycle_stats;
+    int64_t late = 0;
+    if (cs->deadline_ns){ late = now - cs->deadline_ns; cs->deadline_ns = 0; }
+    else if (cs->expect_ns){ late = now - cs->expect_ns; }
+    servo_hist_add(&cs->late, late);
+    cs->last_late_ns = late;
+    cs->expect_ns = (cs->expect_ns && late >= 0 && late < LOOP_PERIOD_NS)
+                  ? cs->expect_ns + LOOP_PERIOD_NS : now + LOOP_PERIOD_NS;
+    return now_raw_ns();
+}
+static inline void servo_stats_end(int64_t t_raw)
+{
+    servo_hist_add(&tls_cycle_stats->exec, now_raw_ns() - t_raw);
+}
+#else
+static inline int64_t servo_stats_begin(int64_t now){ (void)now; return 0; }
+static inline void    servo_stats_end(int64_t t_raw){ (void)t_raw; }
+#endif
 
-        case 2: { /* Align targets to avoid a jump, then EnableOperation */
-            int32_t pos_act = (int32_t)EC_GETUINT32(IN_PTR(position_actual_value));
-            pos_tgt = pos_act;
-            EC_SETUINT32(OUT_PTR(target_position), (uint32_t)pos_tgt);
-            EC_SETWORD(OUT_PTR(control_word), 0x000F); /* Enable operation */
-            if ((SW & 0x006F) == 0x0027){
-                st = 3; t0 = now_ms(); ramp_rem = RAMP_MS; DBGF("OperationEnabled (CSP)");
-            }
-            return;
-        }
-        default: break;
-    }
+/* ==========================================
+   4c) PER-PHASE PROFILING (opt-in)
+   ==========================================
 
-    /* CSP producer (only at OperationEnabled) */
-    if (st == 3){
-        long now = now_ms();
-        if (now - t0 >= LOOP_PERIOD_MS){
-            int32_t pos_prev = pos_tgt;
+   WHAT: cycle counts and call counts per phase of a tick: SW read, fault/cooldown gating,
+   CiA-402 sequence, set-point producer, limit/FE kernel (incl. its input gather) and
+   publish (target + CW writes). Use it to see *where* the tick goes before optimizing.
+   One call = one axis through the phase, on every path: the limit/FE and publish phases
+   run per SoA block (scalar or SIMD kernel) and count the block's lanes, and the gather
+   into the block adds its cycles to limit/FE without a call of its own.
+   Counter: TSC (x86) / CNTVCT (AArch64) / CLOCK_MONOTONIC_RAW ns elsewhere — units are
+   "ticks of that counter"; compare phases against each other, not across machines.
+   With CSP_PROFILE_PHASES=0 (default) the macros expand to nothing: zero cost. */
+#ifndef CSP_PROFILE_PHASES
+# define CSP_PROFILE_PHASES    0
+#endif
 
-            if (dwell_rem > 0){
-                dwell_rem--;
-                if (dwell_rem == 0){ ramp_rem = RAMP_MS; dir = (dir==0 ? -1 : dir); /* resume */ }
-            } else {
-                /* Mini-ramp: scale INC_STEP during the first RAMP_MS */
-                int delta = dir * INC_STEP;
-                if (ramp_rem > 0){
-                    int ramp_total = (RAMP_MS>0 ? RAMP_MS : 1);
-                    int ramp_used  = (ramp_total - ramp_rem + 1);
-                    delta = (delta * ramp_used) / ramp_total;
-                    if (delta == 0 && dir) delta = (dir>0)?1:-1;
-                    ramp_rem--;
-                }
-                pos_tgt += delta;
+enum { CSP_PH_READ, CSP_PH_GATING, CSP_PH_STATE, CSP_PH_PRODUCER, CSP_PH_FE, CSP_PH_PUBLISH, CSP_PH_COUNT };
 
-                /* Clamp and start dwell at limits */
-                if (pos_tgt >  LIMIT_POS){ pos_tgt =  LIMIT_POS; dwell_rem = DWELL_MS; dir = 0; }
-                if (pos_tgt < -LIMIT_POS){ pos_tgt = -LIMIT_POS; dwell_rem = DWELL_MS; dir = 0; }
-            }
+#if CSP_PROFILE_PHASES
+static const char *const csp_phase_name[CSP_PH_COUNT] = {
+    "read SW", "gating", "cia402", "producer", "limit+FE", "publish"
+};
 
-            /* Write target (unaligned + LE safe) */
-            EC_SETUINT32(OUT_PTR(target_position), (uint32_t)pos_tgt);
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint64_t cycles[CSP_PH_COUNT];
+    _Atomic uint64_t calls[CSP_PH_COUNT];
+} Servo_PhaseProfile;
 
-            /* New set-point edge on CW bit4 */
-#if SETPOINT_EDGE_POLICY == 0 /* ON_TICK */
-            edge ^= 0x0010;
-            EC_SETWORD(OUT_PTR(control_word), 0x000F | edge);
-#else                         /* ON_CHANGE — baseline friendly */
-            if (pos_tgt != pos_prev){ edge ^= 0x0010; }
-            EC_SETWORD(OUT_PTR(control_word), 0x000F | edge);
+static inline uint64_t csp_cycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v; __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v)); return v;
+#else
+    return (uint64_t)now_raw_ns();
 #endif
+}
 
-            /* Following-error monitor with hysteresis */
-            const int32_t fe = (int32_t)EC_GETUINT32(IN_PTR(following_error_actual));
-            const int fe_warn_th = (FE_WINDOW_COUNTS * FE_WARN_PCT)/100;
-            const int fe_ok_th   = (FE_WINDOW_COUNTS * 40)/100;
-            if (!fe_warn && (fe > fe_warn_th || fe < -fe_warn_th)){ WARNF("FE high: %d", fe); fe_warn = 1; }
-            else if (fe_warn && (fe < fe_ok_th && fe > -fe_ok_th)){ DBGF("FE back: %d", fe); fe_warn = 0; }
+static Servo_PhaseProfile                g_phase_prof;
+static _Thread_local Servo_PhaseProfile *tls_phase_prof = &g_phase_prof;
 
-            t0 = now;
-        }
+Servo_PhaseProfile *ServoProfile_Default(void){ return &g_phase_prof; }
+void ServoProfile_Bind(Servo_PhaseProfile *p){ tls_phase_prof = p; }
+
+static inline void servo_phase_add(int ph, uint64_t dt, uint64_t axes){
+    CSP_RELAXED_ADD(tls_phase_prof->cycles[ph], dt);
+    CSP_RELAXED_ADD(tls_phase_prof->calls[ph], axes);
+}
+
+/* Non-RT: print the table (cycles/call per phase, share of the total). */
+void ServoProfile_Print(const Servo_PhaseProfile *p, FILE *f)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < CSP_PH_COUNT; i++) total += atomic_load_explicit(&p->cycles[i], memory_order_relaxed);
+    for (int i = 0; i < CSP_PH_COUNT; i++){
+        const uint64_t c = atomic_load_explicit(&p->cycles[i], memory_order_relaxed);
+        const uint64_t n = atomic_load_explicit(&p->calls[i],  memory_order_relaxed);
+        fprintf(f, "%-10s calls=%-12llu cycles=%-14llu per-call=%-8llu %5.1f%%\n", csp_phase_name[i],
+                (unsigned long long)n, (unsigned long long)c, (unsigned long long)(n ? c/n : 0),
+                total ? 100.0*(double)c/(double)total : 0.0);
     }
 }
 
-/* ==============================================================
-   8) WHERE TO HOOK FAULT COOLDOWN
-   ==============================================================
+# define CSP_PHASE_BEGIN()     uint64_t csp_ph_t = csp_cycles()
+# define CSP_PHASE_MARK_N(ph, n) do { const uint64_t t_ = csp_cycles(); servo_phase_add((ph), t_ - csp_ph_t, (n)); csp_ph_t = t_; } while (0)
+# define CSP_PHASE_MARK(ph)    CSP_PHASE_MARK_N((ph), 1)   /* one axis */
+#else
+# define CSP_PHASE_BEGIN()     ((void)0)
+# define CSP_PHASE_MARK_N(ph, n) ((void)0)
+# define CSP_PHASE_MARK(ph)    ((void)0)
+#endif
 
-   In your main loop, when you detect that Fault just cleared (SW bit3 went from 1 to 0),
-   set fault_cool_rem = FAULT_COOLDOWN_MS. In this template we keep it simple by
-   enforcing FAULT_COOLDOWN_MS right after any fault reset pulse clears (see Run()).
+/* ==========================================
+   4d) PER-TICK BINARY TRACE (opt-in)
+   ==========================================
 
-   In a real app you may add retries/backoff logic; this file shows the *places* to add it.
-*/
+   WHAT: one fixed 32-byte record per mapped axis per tick (SW, CW, target, actual, FE,
+   603F, state `st`, tick lateness), pushed by the cyclic thread into a wait-free SPSC
+   ring and copied by a background thread into a memory-mapped ring file that holds the
+   last N minutes at full rate.
+   WHY: DBGF at 1 kHz × many axes is a syscall storm; a record push is ~10 stores.
+   Trigger-freeze: a rising fault (SW bit3) or FE warning (trig_mask) marks the record,
+   keeps recording CSP_TRACE_POST_PCT % of the file, then stops so the history before the
+   event survives. The header gets trig_seq/trig_flags with the first flush after the
+   trigger and `frozen` once the window is full. ServoTrace_Rearm() resumes recording.
+   Decode with tools/trace2csv.py. Like the log ring, one producer per tracer: bind each
+   cyclic thread (shard) to its own with ServoTrace_Bind(). With CSP_TRACE=0 (default)
+   the hook compiles to nothing. */
+#ifndef CSP_TRACE
+# define CSP_TRACE             0
+#endif
+#ifndef CSP_TRACE_RING_SIZE
+# define CSP_TRACE_RING_SIZE   8192   /* records buffered in RAM per tracer (power of two)    */
+#endif
+#define CSP_TRACE_POST_PCT     25     /* share of the file recorded after a trigger           */
+#define CSP_TRACE_VERSION      1
+#define CSP_TRACE_DATA_OFF     4096   /* records start one page into the file                  */
+
+enum { CSP_TRACE_F_FAULT = 1, CSP_TRACE_F_FE_WARN = 2, CSP_TRACE_F_TRIGGER = 4 };
+
+typedef struct {
+    uint32_t tick;                     /* tick number since ServoTrace_Open (wraps)            */
+    uint16_t axis;                     /* slave_index                                          */
+    uint8_t  st;                       /* CSP_ST_* (7b): 0 Shutdown, 1 SwitchOn, 2 Enabling,
+                                          3 Running, 4 FaultReset, 5 Cooldown, 6 Locked        */
+    uint8_t  flags;                    /* CSP_TRACE_F_*                                        */
+    uint16_t sw, cw;                   /* 0x6041 / 0x6040 as sent this tick                    */
+    uint16_t err;                      /* 0x603F (0 when not mapped)                           */
+    uint16_t reserved;
+    int32_t  target, actual, fe;       /* 0x607A / 0x6064 / 0x60F4                             */
+    int32_t  late_ns;                  /* tick start lateness (saturated; 0 w/o CSP_CYCLE_STATS)*/
+} Servo_TraceRecord;
+_Static_assert(sizeof(Servo_TraceRecord) == 32, "trace record layout is part of the file format");
+
+/* File header (little-endian host layout; tools/trace2csv.py mirrors it). */
+typedef struct {
+    char             magic[8];         /* "CSPTRACE"                                           */
+    uint32_t         version;          /* CSP_TRACE_VERSION                                    */
+    uint32_t         record_size;      /* sizeof(Servo_TraceRecord)                            */
+    uint64_t         capacity;         /* records in the file ring                             */
+    uint32_t         period_us;        /* LOOP_PERIOD_US                                       */
+    uint32_t         axes;             /* axes per tick the file was sized for                 */
+    int64_t          t_open_ns;        /* CLOCK_MONOTONIC at open                              */
+    _Atomic uint64_t written;          /* records flushed; record s lives in slot s % capacity */
+    _Atomic uint32_t frozen;           /* 1 = trigger hit and post-trigger part complete      */
+    uint32_t         trig_flags;       /* CSP_TRACE_F_* that fired (0 = none yet); set as soon
+                                          as the trigger record is flushed                     */
+    uint64_t         trig_seq;         /* record number of the trigger                         */
+    uint64_t         dropped;          /* records lost to a full RAM ring                      */
+} Servo_TraceFileHeader;
+
+#if CSP_TRACE
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint64_t head;             /* written by the producer only                         */
+    uint64_t         tail_cache;       /* producer's last view of tail                         */
+    uint32_t         tick;             /* producer tick counter                                */
+    uint32_t         trig_mask;        /* CSP_TRACE_F_FAULT | CSP_TRACE_F_FE_WARN              */
+    uint64_t         post;             /* records kept after a trigger                         */
+    _Atomic uint64_t freeze_at;        /* record number where recording stops (0 = armed)      */
+    _Atomic uint64_t trig_seq;
+    _Atomic uint32_t trig_flags;
+    _Atomic int      rearm;            /* set by ServoTrace_Rearm(), consumed by the producer  */
+    _Atomic uint64_t dropped;
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint64_t tail;             /* written by the flusher only                          */
+    Servo_TraceFileHeader *hdr;
+    Servo_TraceRecord     *file;
+    uint64_t         cap;
+    size_t           map_len;
+    int              fd;
+    unsigned         poll_ms;
+    _Atomic int      running;
+    pthread_t        thread;
+    Servo_TraceRecord rec[CSP_TRACE_RING_SIZE];
+} Servo_Trace;
+
+static _Thread_local Servo_Trace *tls_trace;   /* NULL = this thread does not trace */
+
+void ServoTrace_Bind(Servo_Trace *t){ tls_trace = t; }
+
+static inline void servo_trace_push(Servo_Trace *t, const Servo_TraceRecord *r)
+{
+    const uint64_t h = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (h - t->tail_cache >= CSP_TRACE_RING_SIZE){
+        t->tail_cache = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (h - t->tail_cache >= CSP_TRACE_RING_SIZE){ CSP_RELAXED_ADD(t->dropped, 1); return; }
+    }
+    t->rec[h & (CSP_TRACE_RING_SIZE - 1)] = *r;
+    atomic_store_explicit(&t->head, h + 1, memory_order_release);
+}
+
+/* Producer side of trigger-freeze: returns the record's flags with CSP_TRACE_F_TRIGGER
+   added when `rise` fires while armed. */
+static inline uint8_t servo_trace_trigger(Servo_Trace *t, uint8_t flags, uint8_t rise)
+{
+    if (!(rise & t->trig_mask) || atomic_load_explicit(&t->freeze_at, memory_order_relaxed)) return flags;
+    const uint64_t h = atomic_load_explicit(&t->head, memory_order_relaxed);
+    atomic_store_explicit(&t->trig_seq, h, memory_order_relaxed);
+    atomic_store_explicit(&t->trig_flags, rise & t->trig_mask, memory_order_relaxed);
+    atomic_store_explicit(&t->freeze_at, h + 1 + t->post, memory_order_release);
+    return (uint8_t)(flags | CSP_TRACE_F_TRIGGER);
+}
+
+static inline int servo_trace_frozen(const Servo_Trace *t)
+{
+    const uint64_t f = atomic_load_explicit(&t->freeze_at, memory_order_relaxed);
+    return f && atomic_load_explicit(&t->head, memory_order_relaxed) >= f;
+}
+
+/* Create/truncate `path` sized for `minutes` at full rate with `axes` records per tick,
+   and map it. trig_mask: CSP_TRACE_F_FAULT | CSP_TRACE_F_FE_WARN (0 = never freeze).
+   Non-RT. Returns 0, or -1 (errno from open/ftruncate/mmap). */
+int ServoTrace_Open(Servo_Trace *t, const char *path, unsigned minutes, unsigned axes, unsigned trig_mask)
+{
+    memset(t, 0, sizeof *t);
+    t->fd = -1;
+    t->cap = (uint64_t)minutes * 60u * (1000000u / LOOP_PERIOD_US) * (axes ? axes : 1);
+    if (!t->cap) t->cap = CSP_TRACE_RING_SIZE;
+    t->post = t->cap * CSP_TRACE_POST_PCT / 100;
+    t->trig_mask = trig_mask & (CSP_TRACE_F_FAULT | CSP_TRACE_F_FE_WARN);
+    t->map_len = CSP_TRACE_DATA_OFF + (size_t)t->cap * sizeof(Servo_TraceRecord);
+
+    t->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (t->fd < 0) return -1;
+    void *m = MAP_FAILED;
+    if (ftruncate(t->fd, (off_t)t->map_len) == 0)
+        m = mmap(NULL, t->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+    if (m == MAP_FAILED){ close(t->fd); t->fd = -1; return -1; }
+
+    t->hdr  = (Servo_TraceFileHeader*)m;
+    t->file = (Servo_TraceRecord*)((uint8_t*)m + CSP_TRACE_DATA_OFF);
+    memcpy(t->hdr->magic, "CSPTRACE", 8);
+    t->hdr->version     = CSP_TRACE_VERSION;
+    t->hdr->record_size = sizeof(Servo_TraceRecord);
+    t->hdr->capacity    = t->cap;
+    t->hdr->period_us   = LOOP_PERIOD_US;
+    t->hdr->axes        = axes;
+    t->hdr->t_open_ns   = now_ns();
+    return 0;
+}
+
+/* Copy what the producer pushed into the file ring and update the header. Non-RT (the
+   flush thread below calls it). Returns the number of records copied. */
+size_t ServoTrace_Flush(Servo_Trace *t)
+{
+    uint64_t tl = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    const uint64_t h = atomic_load_explicit(&t->head, memory_order_acquire);
+    const size_t n = (size_t)(h - tl);
+    for (; tl != h; tl++)
+        t->file[tl % t->cap] = t->rec[tl & (CSP_TRACE_RING_SIZE - 1)];
+    atomic_store_explicit(&t->tail, h, memory_order_release);
+    atomic_store_explicit(&t->hdr->written, h, memory_order_release);
+    t->hdr->dropped = atomic_load_explicit(&t->dropped, memory_order_relaxed);
+
+    const uint64_t f = atomic_load_explicit(&t->freeze_at, memory_order_acquire);
+    if (!f){
+        atomic_store_explicit(&t->hdr->frozen, 0, memory_order_relaxed);
+        return n;
+    }
+    /* The trigger goes into the header as soon as its record is in the file, not when the
+       post-trigger window is full: a process that dies after the fault still leaves it. */
+    const uint64_t ts = atomic_load_explicit(&t->trig_seq, memory_order_relaxed);
+    if (h > ts && (!t->hdr->trig_flags || t->hdr->trig_seq != ts)){
+        t->hdr->trig_seq   = ts;
+        t->hdr->trig_flags = atomic_load_explicit(&t->trig_flags, memory_order_relaxed);
+        msync(t->hdr, CSP_TRACE_DATA_OFF, MS_ASYNC);
+        WARNF("trace trigger 0x%X at record %llu", (unsigned)t->hdr->trig_flags,
+              (unsigned long long)ts);
+    }
+    if (h >= f && !atomic_load_explicit(&t->hdr->frozen, memory_order_relaxed)){
+        atomic_store_explicit(&t->hdr->frozen, 1, memory_order_release);
+        msync(t->hdr, t->map_len, MS_ASYNC);
+        WARNF("trace frozen at record %llu", (unsigned long long)h);
+    }
+    return n;
+}
+
+/* Resume recording after a freeze (any thread; the producer applies it next tick). */
+void ServoTrace_Rearm(Servo_Trace *t){ atomic_store_explicit(&t->rearm, 1, memory_order_release); }
+
+static void *servo_trace_thread(void *arg)
+{
+    Servo_Trace *t = (Servo_Trace*)arg;
+    const struct timespec req = { t->poll_ms/1000, (long)(t->poll_ms%1000)*1000000L };
+    while (atomic_load(&t->running)){
+        ServoTrace_Flush(t);
+        nanosleep(&req, NULL);
+    }
+    ServoTrace_Flush(t);
+    return NULL;
+}
+
+/* Flush thread (non-RT): poll every `poll_ms`. Size CSP_TRACE_RING_SIZE for at least two
+   polls of records (axes × poll_ms / period), or records are dropped and counted. */
+int ServoTrace_Start(Servo_Trace *t, unsigned poll_ms)
+{
+    t->poll_ms = poll_ms ? poll_ms : 10;
+    atomic_store(&t->running, 1);
+    return pthread_create(&t->thread, NULL, servo_trace_thread, t) == 0 ? 0 : -1;
+}
+
+/* Stop the flush thread (if started), flush, and unmap/close the file. */
+void ServoTrace_Close(Servo_Trace *t)
+{
+    if (atomic_exchange(&t->running, 0)) pthread_join(t->thread, NULL);
+    if (!t->hdr) return;
+    ServoTrace_Flush(t);
+    msync(t->hdr, t->map_len, MS_SYNC);
+    munmap(t->hdr, t->map_len);
+    close(t->fd);
+    t->hdr = NULL; t->file = NULL; t->fd = -1;
+}
+#endif /* CSP_TRACE */
+
+/* ==========================================
+   4e) SHARED-MEMORY TELEMETRY (opt-in)
+   ==========================================
+
+   WHAT: a POSIX shared-memory segment (/dev/shm/<name>) that every tick overwrites
+   with the live state of each axis (st, SW, CW, target, actual, FE, fe_warn, 603F,
+   overrun counters, FE window statistics) and a summary of the cycle histograms (4b).
+   WHY: HMIs and exporters need live values without printf, sockets or locks. The
+   writer never waits: one seqlock for the whole segment (sequence odd while writing,
+   even when done), so a reader in another process copies the payload and retries if
+   the sequence moved — consistent snapshots across all axes of a tick, no syscalls.
+   The cycle percentiles are refreshed every CSP_TELEMETRY_STATS_EVERY ticks (a bucket
+   scan); everything else every tick.
+   Layout: versioned header at offset 0 (magic "CSPTELEM", version, sizes, offsets);
+   readers must check magic/version and use the offsets/strides from the header, so
+   additions at the end of a block stay compatible. tools/telemetry.py is a reader.
+   One segment per cyclic thread (ServoTelemetry_Bind), slot i = ctx[i] of its tick. */
+#ifndef CSP_TELEMETRY
+# define CSP_TELEMETRY         0
+#endif
+#define CSP_TELEMETRY_VERSION      3      /* 2: FE statistics appended to the axis slot;
+                                             3: DC lock appended to the cycle block          */
+#define CSP_TELEMETRY_STATS_EVERY  64     /* ticks between cycle percentile refreshes        */
+
+typedef struct {
+    uint32_t slave;                    /* slave_index                                          */
+    int32_t  st;                       /* CSP_ST_* (7b): 0 Shutdown, 1 SwitchOn, 2 Enabling,
+                                          3 Running, 4 FaultReset, 5 Cooldown, 6 Locked        */
+    uint16_t sw, cw, err;              /* 0x6041 / 0x6040 / 0x603F                             */
+    uint8_t  fe_warn;                  /* FE warning latched                                   */
+    uint8_t  mapped;                   /* 0 = axis not mapped (other fields stale)             */
+    int32_t  target, actual, fe;       /* 0x607A / 0x6064 / 0x60F4                             */
+    int32_t  reserved;
+    uint64_t ovr_events, ovr_missed, ovr_dropped;
+    int64_t  ovr_worst_late_ns;
+    /* v2: FE statistics (5e) — last complete window, and the window in progress */
+    uint64_t fe_windows;               /* 0 = no window completed yet (or CSP_FE_STATS=0)      */
+    int32_t  fe_min, fe_max, fe_mean, fe_rms;
+    int32_t  fe_p50, fe_p90, fe_p99, fe_p999;
+    uint32_t fe_cur_n;                 /* samples in the window in progress                    */
+    int32_t  fe_cur_min, fe_cur_max;
+    uint32_t reserved2[3];
+} Servo_TelemetryAxis;
+_Static_assert(sizeof(Servo_TelemetryAxis) == 128, "telemetry axis slot is part of the layout");
+
+typedef struct {
+    uint64_t          tick;            /* ticks published                                      */
+    int64_t           t_ns;            /* CLOCK_MONOTONIC of the tick                          */
+    Servo_HistSummary exec, late;      /* 4b histograms (refreshed every …_STATS_EVERY)        */
+    /* v3: DC lock (4h) of the publishing thread — all 0 while no controller runs there */
+    int64_t           dc_offset_ns;    /* phase error: + = frame later than shift before SYNC0 */
+    int64_t           dc_shift_ns;     /* frame → SYNC0 distance held                         */
+    int32_t           dc_drift_ppb;    /* reference clock rate − host rate (ppb)               */
+    uint32_t          dc_flags;        /* CSP_DC_F_ACTIVE | CSP_DC_F_LOCKED                    */
+} Servo_TelemetryCycle;
+
+typedef struct {
+    char             magic[8];         /* "CSPTELEM"                                           */
+    uint32_t         version;          /* CSP_TELEMETRY_VERSION                                */
+    uint32_t         header_size;      /* sizeof(Servo_TelemetryHeader)                        */
+    uint32_t         cycle_off;        /* offset of Servo_TelemetryCycle                       */
+    uint32_t         cycle_size;
+    uint32_t         axes_off;         /* offset of Servo_TelemetryAxis[axes_cap]              */
+    uint32_t         axis_size;        /* stride of one axis slot                              */
+    uint32_t         axes_cap;         /* slots in the segment                                 */
+    _Atomic uint32_t axes_live;        /* slots written by the last tick                       */
+    uint32_t         period_us;        /* LOOP_PERIOD_US                                       */
+    uint32_t         pid;              /* writer process                                       */
+    uint32_t         seq_off;          /* offset of `seq` below                                */
+    int64_t          t_open_ns;
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t seq;              /* seqlock: odd = write in progress                     */
+} Servo_TelemetryHeader;
+
+#if CSP_TELEMETRY
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct {
+    Servo_TelemetryHeader *hdr;
+    Servo_TelemetryCycle  *cycle;
+    Servo_TelemetryAxis   *axis;
+    size_t                 len;
+    char                   name[64];
+} Servo_Telemetry;
+
+static _Thread_local Servo_Telemetry *tls_telem;   /* NULL = this thread does not publish */
+
+void ServoTelemetry_Bind(Servo_Telemetry *tm){ tls_telem = tm; }
+
+/* Create (or take over) the segment `name` ("/csp_cell0") with `axes` slots. Non-RT.
+   Returns 0, or -1 (errno from shm_open/ftruncate/mmap). Link with -lrt on old glibc. */
+int ServoTelemetry_Open(Servo_Telemetry *tm, const char *name, unsigned axes)
+{
+    memset(tm, 0, sizeof *tm);
+    snprintf(tm->name, sizeof tm->name, "%s", name);
+    const size_t cyc_off  = (sizeof(Servo_TelemetryHeader) + CSP_CACHE_LINE - 1) & ~(size_t)(CSP_CACHE_LINE - 1);
+    const size_t axes_off = (cyc_off + sizeof(Servo_TelemetryCycle) + CSP_CACHE_LINE - 1) & ~(size_t)(CSP_CACHE_LINE - 1);
+    tm->len = axes_off + (size_t)axes * sizeof(Servo_TelemetryAxis);
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    void *m = MAP_FAILED;
+    if (ftruncate(fd, (off_t)tm->len) == 0)
+        m = mmap(NULL, tm->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -1;
+    memset(m, 0, tm->len);
+
+    Servo_TelemetryHeader *h = (Servo_TelemetryHeader*)m;
+    h->version     = CSP_TELEMETRY_VERSION;
+    h->header_size = sizeof *h;
+    h->cycle_off   = (uint32_t)cyc_off;
+    h->cycle_size  = sizeof(Servo_TelemetryCycle);
+    h->axes_off    = (uint32_t)axes_off;
+    h->axis_size   = sizeof(Servo_TelemetryAxis);
+    h->axes_cap    = axes;
+    h->period_us   = LOOP_PERIOD_US;
+    h->pid         = (uint32_t)getpid();
+    h->seq_off     = (uint32_t)offsetof(Servo_TelemetryHeader, seq);
+    h->t_open_ns   = now_ns();
+    tm->hdr   = h;
+    tm->cycle = (Servo_TelemetryCycle*)((uint8_t*)m + cyc_off);
+    tm->axis  = (Servo_TelemetryAxis*)((uint8_t*)m + axes_off);
+    atomic_thread_fence(memory_order_release);
+    memcpy(h->magic, "CSPTELEM", 8);                   /* last: readers attach after this */
+    return 0;
+}
+
+/* Unmap; `unlink` = 1 also removes the segment (readers keep their mapping). */
+void ServoTelemetry_Close(Servo_Telemetry *tm, int unlink)
+{
+    if (!tm->hdr) return;
+    munmap(tm->hdr, tm->len);
+    if (unlink) shm_unlink(tm->name);
+    tm->hdr = NULL;
+}
+
+/* Writer side of the seqlock (cyclic thread). */
+static inline void servo_telem_begin(Servo_TelemetryHeader *h)
+{
+    const uint32_t s = atomic_load_explicit(&h->seq, memory_order_relaxed);
+    atomic_store_explicit(&h->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+static inline void servo_telem_end(Servo_TelemetryHeader *h)
+{
+    const uint32_t s = atomic_load_explicit(&h->seq, memory_order_relaxed);
+    atomic_store_explicit(&h->seq, s + 1, memory_order_release);
+}
+
+/* Reader side, for a process that maps the segment (any thread, never blocks the
+   writer): copy the cycle block and up to `max_axes` slots. Returns the number of
+   axes copied, or -1 after `tries` torn reads / a layout it does not know. */
+int ServoTelemetry_Read(const Servo_TelemetryHeader *h, Servo_TelemetryCycle *cyc,
+                        Servo_TelemetryAxis *axes, unsigned max_axes, int tries)
+{
+    if (memcmp(h->magic, "CSPTELEM", 8) != 0 || h->version < CSP_TELEMETRY_VERSION ||
+        h->axis_size < sizeof *axes || h->cycle_size < sizeof *cyc) return -1;
+    const uint8_t *base = (const uint8_t*)h;
+    while (tries-- > 0){
+        const uint32_t s0 = atomic_load_explicit(&h->seq, memory_order_acquire);
+        if (s0 & 1u) continue;
+        unsigned n = atomic_load_explicit(&h->axes_live, memory_order_relaxed);
+        if (n > h->axes_cap) n = h->axes_cap;
+        if (n > max_axes)    n = max_axes;
+        memcpy(cyc, base + h->cycle_off, sizeof *cyc);
+        for (unsigned i = 0; i < n; i++)
+            memcpy(&axes[i], base + h->axes_off + (size_t)i * h->axis_size, sizeof *axes);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&h->seq, memory_order_relaxed) == s0) return (int)n;
+    }
+    return -1;
+}
+#endif /* CSP_TELEMETRY */
+
+/* ==========================================
+   4f) SIMULATED DRIVE (opt-in, CSP_SIM_DRIVE=1)
+   ==========================================
+
+   WHAT: CiA-402 drive models behind the section-4 stubs. map_io() hands out the images of
+   simulated slaves, the SDO calls land in their object dictionary, state_*() moves their
+   AL state. ServoSim_Exchange() is the bus: after each tick it takes every slave's
+   outputs, steps its state machine and position loop by one period and writes its inputs
+   (a real master exchanges the frame at the same point).
+   WHY: Run()/RunBatch() cannot be exercised while map_io() returns -1. With the model the
+   whole loop runs offline, for thousands of axes and — on the virtual clock
+   (ServoSim_UseVirtualClock: now_ns() returns simulated time, sleep_ms() advances it) —
+   as fast as the CPU allows: soak tests and profiles before a change meets a machine.
+   Model of one slave:
+   • state machine: SwitchOnDisabled → ReadyToSwitchOn (CW 0x06) → SwitchedOn (0x07) →
+     OperationEnabled (0x0F; also straight from ReadyToSwitchOn with allow_3_4); disable
+     voltage / quick stop → SwitchOnDisabled; Fault → rising bit 7 (accepted after
+     hold_ticks) → SwitchOnDisabled. SW also carries 0x0010 (voltage), 0x0200 (remote) and
+     0x1000 (following the target in CSP). Targets are followed only with 6060 = 8.
+   • position loop: the target reaches the drive delay_ticks late; velocity command =
+     kp·(target − pos) + kff·(target velocity), limited to vmax, through a first-order
+     velocity loop (tau_s); disabled, the axis coasts down. 6064 = pos + noise and 60F4 =
+     target at the drive − 6064, both sampled when SYNC0 latches that target (before the
+     period's motion), as a drive reports them.
+   • faults: ServoSim_InjectFault(), random ones at fault_ppm per tick, |60F4| above the
+     6065 window (0x8611), comm loss via ServoSim_DropLink() (SW reads 0). Below SAFEOP
+     inputs read 0; in SAFEOP the outputs are ignored.
+   • mailbox: SDO writes are stored and read back (6060 and 6065 also act); with
+     sdo_polls > 0 the slave has async CoE (sdo_async_start/poll, 6a/6b): a transfer
+     completes on its sdo_polls-th poll, and g_sim_coe counts what is in flight.
+   Single-threaded: call ServoSim_Exchange() from the thread that runs the tick. */
+#if CSP_SIM_DRIVE
+#include <stdlib.h>
+#ifndef CSP_SIM_MAX_SLAVES
+# define CSP_SIM_MAX_SLAVES    4096
+#endif
+
+typedef struct {
+    double   kp;                       /* position gain (1/s)                                  */
+    double   kff;                      /* velocity feed-forward of the drive (0..1)            */
+    double   tau_s;                    /* velocity loop time constant (s)                      */
+    double   vmax;                     /* velocity limit (counts/s)                            */
+    double   noise;                    /* 6064 noise, uniform ± (counts)                       */
+    int      delay_ticks;              /* target transport delay (0..7 ticks)                  */
+    int      allow_3_4;                /* accept CW 0x000F straight from ReadyToSwitchOn       */
+    uint32_t fault_ppm;                /* random faults per million ticks                      */
+    uint32_t hold_ticks;               /* a fault ignores resets for this many ticks           */
+    uint16_t fault_code;               /* 603F of random / injected faults                     */
+    uint32_t sdo_polls;                /* async CoE: polls per transfer (0 = blocking SDO only,
+                                          UINT32_MAX = the mailbox never answers)              */
+} Servo_SimParams;
+
+enum { CSP_SIM_SOD, CSP_SIM_RTSO, CSP_SIM_SO, CSP_SIM_OE, CSP_SIM_FAULT };
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    Drive_Inputs  in;                  /* image the master reads                               */
+    _Alignas(8) Drive_Outputs out;     /* image the master writes                              */
+    Servo_SimParams p;
+    double   pos, vel;                 /* plant (counts, counts/s)                             */
+    int32_t  tgt_hist[8];              /* targets by tick, for delay_ticks                     */
+    int32_t  tgt_prev;                 /* target seen by the drive last tick                   */
+    uint32_t tick;
+    uint64_t rng;                      /* xorshift64 state                                     */
+    uint32_t hold;                     /* fault: ticks until a reset is accepted               */
+    uint32_t link_drop;                /* ticks left in a simulated comm loss                  */
+    uint32_t fe_window;                /* 6065 (0 = no FE trip)                                */
+    uint32_t faults;                   /* faults raised so far                                 */
+    struct { uint16_t idx; uint8_t sub; uint32_t v; } od[8];   /* other objects written  */
+    uint8_t  od_n;
+    uint16_t coe_busy, coe_peak;       /* async CoE transfers in flight, and the most at once  */
+    uint16_t cw_prev;
+    uint16_t err;                      /* 603F                                                 */
+    uint16_t al;                       /* AL status (EC_AL_*)                                  */
+    uint8_t  st;                       /* CSP_SIM_*                                            */
+    uint8_t  mode;                     /* 6060                                                 */
+    uint8_t  used;
+} Servo_SimDrive;
+
+static Servo_SimDrive  g_sim[CSP_SIM_MAX_SLAVES];
+static size_t          g_sim_n;        /* highest mapped slave + 1                             */
+static Servo_SimParams g_sim_defaults;
+static int             g_sim_defaults_set;
+
+/* Image order, as the accessors in section 5 expect it. */
+static inline void sim_put16(uint8_t *p, uint16_t v){ h_set_u16(p, CSP_IMAGE_SWAP ? csp_bswap16(v) : v); }
+static inline void sim_put32(uint8_t *p, uint32_t v){ h_set_u32(p, CSP_IMAGE_SWAP ? csp_bswap32(v) : v); }
+static inline uint16_t sim_get16(const uint8_t *p){ uint16_t v = h_get_u16(p); return CSP_IMAGE_SWAP ? csp_bswap16(v) : v; }
+static inline uint32_t sim_get32(const uint8_t *p){ uint32_t v = h_get_u32(p); return CSP_IMAGE_SWAP ? csp_bswap32(v) : v; }
+#define SIM_IN(d, f)   ((uint8_t*)&(d)->in  + offsetof(Drive_Inputs,  f))
+#define SIM_OUT(d, f)  ((uint8_t*)&(d)->out + offsetof(Drive_Outputs, f))
+
+void ServoSim_Defaults(Servo_SimParams *p)
+{
+    p->kp          = 150.0;
+    p->kff         = 0.95;
+    p->tau_s       = 0.002;
+    p->vmax        = 4.0 * TRAJ_VMAX;
+    p->noise       = 1.0;
+    p->delay_ticks = 1;
+    p->allow_3_4   = 1;
+    p->fault_ppm   = 0;
+    p->hold_ticks  = 2;
+    p->fault_code  = 0x7500;           /* communication error (CiA-402 class 75xx) */
+    p->sdo_polls   = 0;
+}
+
+static inline uint64_t sim_rand(Servo_SimDrive *d)
+{
+    uint64_t x = d->rng;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    return d->rng = x;
+}
+
+static void sim_fault(Servo_SimDrive *d, uint16_t code)
+{
+    d->st = CSP_SIM_FAULT; d->err = code; d->hold = d->p.hold_ticks; d->faults++;
+}
+
+/* `pos` is the position at the SYNC0 instant that latched `demand`: 6064 and 60F4 are
+   sampled together, before the period's motion. */
+static void sim_write_inputs(Servo_SimDrive *d, int32_t demand, double pos)
+{
+    static const uint16_t sw_of[] = { 0x0040, 0x0021, 0x0023, 0x0027, 0x0008 };
+    const int pd = (d->al & EC_AL_MASK) >= EC_AL_SAFEOP && !d->link_drop;
+    uint16_t sw = (uint16_t)(sw_of[d->st] | 0x0210);     /* + voltage enabled, remote */
+    if (d->st == CSP_SIM_OE && d->mode == 8) sw |= 0x1000;
+    const double  n   = d->p.noise > 0 ? d->p.noise * ((double)(sim_rand(d) >> 11) * (2.0 / 9007199254740992.0) - 1.0) : 0.0;
+    const int32_t act = (int32_t)llround(pos + n);
+    sim_put16(SIM_IN(d, status_word), pd ? sw : 0);
+    sim_put32(SIM_IN(d, position_actual_value), (uint32_t)act);
+    sim_put32(SIM_IN(d, following_error_actual),
+              (uint32_t)(d->st == CSP_SIM_OE ? (int32_t)((uint32_t)demand - (uint32_t)act) : 0));
+#ifdef CSP_PDO_HAS_error_code
+    sim_put16(SIM_IN(d, error_code), d->err);
+#endif
+}
+
+static void sim_reset(Servo_SimDrive *d, int slave)
+{
+    memset(d, 0, sizeof *d);
+    if (!g_sim_defaults_set){ ServoSim_Defaults(&g_sim_defaults); g_sim_defaults_set = 1; }
+    d->p    = g_sim_defaults;
+    d->rng  = 0x9E3779B97F4A7C15ull ^ ((uint64_t)(slave + 1) * 0xBF58476D1CE4E5B9ull);
+    d->st   = CSP_SIM_SOD;
+    d->mode = 8;                       /* powers up in CSP: a plan that skips 6060 still runs */
+    d->al   = EC_AL_OP;                /* the bus is up unless a group transition moves it    */
+    d->used = 1;
+    sim_write_inputs(d, 0, d->pos);
+}
+
+static Servo_SimDrive *sim_slave(int slave)
+{
+    if (slave < 0 || slave >= CSP_SIM_MAX_SLAVES) return NULL;
+    Servo_SimDrive *d = &g_sim[slave];
+    if (!d->used){
+        sim_reset(d, slave);
+        if ((size_t)slave >= g_sim_n) g_sim_n = (size_t)slave + 1;
+    }
+    return d;
+}
+
+/* One bus cycle for one slave: outputs in, state machine + plant, inputs out. */
+static void sim_step(Servo_SimDrive *d)
+{
+    const double   dt  = (double)LOOP_PERIOD_US * 1e-6;
+    const int      op  = (d->al & EC_AL_MASK) == EC_AL_OP;
+    const uint16_t cw  = op ? sim_get16(SIM_OUT(d, control_word)) : 0;
+    const int32_t  tgt = (int32_t)sim_get32(SIM_OUT(d, target_position));
+    const int      dly = d->p.delay_ticks < 0 ? 0 : (d->p.delay_ticks > 7 ? 7 : d->p.delay_ticks);
+    d->tick++;
+    d->tgt_hist[d->tick & 7] = tgt;
+    const int32_t demand = d->tgt_hist[(d->tick - (uint32_t)dly) & 7];
+    if (d->link_drop) d->link_drop--;
+
+    if (d->st != CSP_SIM_FAULT){
+        const int32_t fe = (int32_t)((uint32_t)demand - (uint32_t)llround(d->pos));
+        if (d->p.fault_ppm && sim_rand(d) % 1000000u < d->p.fault_ppm) sim_fault(d, d->p.fault_code);
+        else if (d->st == CSP_SIM_OE && d->fe_window && (uint32_t)(fe < 0 ? -(int64_t)fe : fe) > d->fe_window)
+            sim_fault(d, 0x8611);      /* following error */
+    }
+
+    /* Drive state machine (quick stop folded into "disable voltage") */
+    if (d->st == CSP_SIM_FAULT){
+        if (d->hold) d->hold--;
+        else if ((cw & 0x0080) && !(d->cw_prev & 0x0080)){ d->st = CSP_SIM_SOD; d->err = 0; }
+    } else if (!(cw & 0x0002) || (cw & 0x0006) == 0x0002){
+        d->st = CSP_SIM_SOD;
+    } else if ((cw & 0x0087) == 0x0006){
+        d->st = CSP_SIM_RTSO;
+    } else if ((cw & 0x008F) == 0x0007){
+        if (d->st != CSP_SIM_SOD) d->st = CSP_SIM_SO;
+    } else if ((cw & 0x008F) == 0x000F){
+        if (d->st == CSP_SIM_SO || d->st == CSP_SIM_OE || (d->st == CSP_SIM_RTSO && d->p.allow_3_4))
+            d->st = CSP_SIM_OE;
+    }
+    d->cw_prev = cw;
+
+    /* Plant (inputs report the position sampled with the demand, before this step) */
+    const double pos0 = d->pos;
+    if (d->st == CSP_SIM_OE && d->mode == 8){
+        const double v_ff = (double)(int32_t)((uint32_t)demand - (uint32_t)d->tgt_prev) / dt;
+        double vcmd = d->p.kp * ((double)demand - d->pos) + d->p.kff * v_ff;
+        if (vcmd >  d->p.vmax) vcmd =  d->p.vmax;
+        if (vcmd < -d->p.vmax) vcmd = -d->p.vmax;
+        d->vel += (vcmd - d->vel) * (dt / (d->p.tau_s + dt));
+    } else {
+        d->vel -= d->vel * (dt / (0.05 + dt));          /* coast down (~50 ms) */
+    }
+    d->pos += d->vel * dt;
+    d->tgt_prev = demand;
+    sim_write_inputs(d, demand, pos0);
+}
+
+static int servo_sim_map(int slave, Drive_Inputs **in, Drive_Outputs **out)
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (!d){ *in = NULL; *out = NULL; return -1; }
+    *in = &d->in; *out = &d->out;
+    return 0;
+}
+
+static int servo_sim_sdo_write(int slave, uint16_t idx, uint8_t sub, uint32_t v)
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (!d) return -1;
+    if (idx == 0x6060 && sub == 0){ d->mode = (uint8_t)v; return 0; }
+    if (idx == 0x6065 && sub == 0){ d->fe_window = v; return 0; }
+    int i = 0;                         /* everything else is stored and read back */
+    while (i < d->od_n && !(d->od[i].idx == idx && d->od[i].sub == sub)) i++;
+    if (i == d->od_n){
+        if (d->od_n == sizeof d->od / sizeof d->od[0]) return 0;
+        d->od[i].idx = idx; d->od[i].sub = sub; d->od_n++;
+    }
+    d->od[i].v = v;
+    return 0;
+}
+
+static int servo_sim_sdo_read(int slave, uint16_t idx, uint8_t sub, uint8_t data[4])
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (!d) return -1;
+    uint32_t v = 0;
+    (void)sub;
+    switch (idx){
+        case 0x603F: v = d->err; break;
+        case 0x6041: v = sim_get16(SIM_IN(d, status_word)); break;
+        case 0x6060: case 0x6061: v = d->mode; break;
+        case 0x6064: v = sim_get32(SIM_IN(d, position_actual_value)); break;
+        case 0x6065: v = d->fe_window; break;
+        default:
+            for (int i = 0; i < d->od_n; i++)
+                if (d->od[i].idx == idx && d->od[i].sub == sub) v = d->od[i].v;
+            break;
+    }
+    le_set_u32(data, v);
+    return 0;
+}
+
+/* Async CoE: one slot per transfer in flight, handle = slot. The transfer takes effect
+   (write) or samples the object (read) when it completes. */
+#define CSP_SIM_COE_SLOTS      64
+
+static struct {
+    struct { int slave; uint16_t idx; uint8_t sub, len, write, used; uint32_t value, left; } t[CSP_SIM_COE_SLOTS];
+    unsigned busy, peak;               /* transfers in flight on the bus, and the most at once */
+    uint64_t started;
+} g_sim_coe;
+
+static int servo_sim_sdo_async_start(int slave, uint16_t idx, uint8_t sub, int write, const uint8_t *data, size_t len)
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (!d || !d->p.sdo_polls) return -1;
+    int h = 0;
+    while (h < CSP_SIM_COE_SLOTS && g_sim_coe.t[h].used) h++;
+    if (h == CSP_SIM_COE_SLOTS) return -1;
+    g_sim_coe.t[h].slave = slave; g_sim_coe.t[h].idx = idx; g_sim_coe.t[h].sub = sub;
+    g_sim_coe.t[h].len = (uint8_t)len; g_sim_coe.t[h].write = (uint8_t)write; g_sim_coe.t[h].used = 1;
+    g_sim_coe.t[h].value = write ? le_get_u32(data) & servo_sdo_mask(len) : 0;
+    g_sim_coe.t[h].left  = d->p.sdo_polls;
+    if (++g_sim_coe.busy > g_sim_coe.peak) g_sim_coe.peak = g_sim_coe.busy;
+    if (++d->coe_busy > d->coe_peak) d->coe_peak = d->coe_busy;
+    g_sim_coe.started++;
+    return h;
+}
+
+static int servo_sim_sdo_async_poll(int handle, uint8_t data[4], uint32_t *abort_code)
+{
+    *abort_code = 0;
+    if (handle < 0 || handle >= CSP_SIM_COE_SLOTS || !g_sim_coe.t[handle].used){
+        *abort_code = 0x08000000;      /* general error */
+        return -1;
+    }
+    if (g_sim_coe.t[handle].left == UINT32_MAX || --g_sim_coe.t[handle].left) return 1;
+    const int slave = g_sim_coe.t[handle].slave;
+    const int rc = g_sim_coe.t[handle].write
+        ? servo_sim_sdo_write(slave, g_sim_coe.t[handle].idx, g_sim_coe.t[handle].sub, g_sim_coe.t[handle].value)
+        : servo_sim_sdo_read(slave, g_sim_coe.t[handle].idx, g_sim_coe.t[handle].sub, data);
+    g_sim_coe.t[handle].used = 0;
+    g_sim_coe.busy--;
+    g_sim[slave].coe_busy--;
+    if (rc != 0) *abort_code = 0x08000000;
+    return rc;
+}
+
+/* AL control: a slave with the error bit set ignores requests until one carries the
+   acknowledge, which clears the bit (set g_sim[i].al |= EC_AL_ERROR to raise it). */
+static void servo_sim_state_request(EcSlave s, int state)
+{
+    Servo_SimDrive *d = (Servo_SimDrive*)s;
+    if (!d || ((d->al & EC_AL_ERROR) && !(state & EC_AL_ERROR))) return;
+    d->al = (uint16_t)(state & EC_AL_MASK);
+}
+static int servo_sim_state_get(EcSlave s)
+{
+    const Servo_SimDrive *d = (const Servo_SimDrive*)s;
+    return d ? d->al : 0;
+}
+
+/* Slave handle for the group transitions (6c) and the sim calls below. */
+EcSlave ServoSim_Slave(int slave){ return (EcSlave)sim_slave(slave); }
+
+/* Model parameters of one slave, or of every slave (current and future) with -1. */
+void ServoSim_Configure(int slave, const Servo_SimParams *p)
+{
+    if (slave >= 0){ Servo_SimDrive *d = sim_slave(slave); if (d) d->p = *p; return; }
+    g_sim_defaults = *p; g_sim_defaults_set = 1;
+    for (size_t i = 0; i < g_sim_n; i++) if (g_sim[i].used) g_sim[i].p = *p;
+}
+
+/* Fault the drive now (603F = code), as a transient the engine should recover from. */
+void ServoSim_InjectFault(int slave, uint16_t code)
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (d) sim_fault(d, code);
+}
+
+/* Comm loss: the slave's SW reads 0 for `ticks` bus cycles. */
+void ServoSim_DropLink(int slave, unsigned ticks)
+{
+    Servo_SimDrive *d = sim_slave(slave);
+    if (d) d->link_drop = ticks;
+}
+
+/* 1: now_ns() returns simulated time (starting from the real clock) and every
+   ServoSim_Exchange() advances it by one period; 0: back to CLOCK_MONOTONIC. */
+void ServoSim_UseVirtualClock(int on){ ServoClock_Inject(on); }
+
+/* Reference clock for the DC lock (4h): from now on dc_time() reports
+   offset_ns + (now_ns() − now)·(1 + ppm·1e-6) — a crystal `ppm` off the host's, read when
+   the frame goes out (right after the tick). Before the first call dc_time() fails. */
+static struct { int on; double rate; int64_t t0, offset; } g_sim_dc;
+
+void ServoSim_SetDc(double ppm, int64_t offset_ns)
+{
+    g_sim_dc.rate = ppm * 1e-6; g_sim_dc.t0 = now_ns(); g_sim_dc.offset = offset_ns;
+    g_sim_dc.on = 1;
+}
+
+static int servo_sim_dc_time(int64_t *dc_ns)
+{
+    if (!g_sim_dc.on){ *dc_ns = 0; return -1; }
+    const int64_t t = now_ns() - g_sim_dc.t0;
+    *dc_ns = g_sim_dc.offset + t + (int64_t)llround((double)t * g_sim_dc.rate);
+    return 0;
+}
+
+/* The bus cycle: step every mapped slave once, then advance the virtual clock. */
+void ServoSim_Exchange(void)
+{
+    for (size_t i = 0; i < g_sim_n; i++) if (g_sim[i].used) sim_step(&g_sim[i]);
+    if (g_clock_injected) g_clock_ns += LOOP_PERIOD_NS;
+}
+
+const Servo_SimDrive *ServoSim_Drive(int slave)
+{
+    return (slave >= 0 && slave < CSP_SIM_MAX_SLAVES && g_sim[slave].used) ? &g_sim[slave] : NULL;
+}
+#endif /* CSP_SIM_DRIVE */
+
+/* ==========================================
+   4g) RECORD / REPLAY OF THE PROCESS IMAGE (opt-in, CSP_RECORD=1)
+   ==========================================
+
+   WHAT: the recorder stores, per tick, the tick time and the raw bytes of every mapped
+   axis' Drive_Inputs (as the tick found them) and Drive_Outputs (as it published them).
+   The replay driver maps the axes onto its own images, injects the recorded time
+   (ServoClock_Set), feeds the inputs back through the same tick entry (Run or RunBatch)
+   as fast as it can, and compares each published output byte with the recording.
+   WHY: a timing-dependent fault in the field becomes a file that reproduces the control
+   behaviour bit for bit on a desk, and a regression check for any change to the tick.
+   File (little-endian host layout): Servo_RecHeader; per axis {int32 slave, uint32
+   mapped, initial output image}; then one frame per tick:
+     varint zigzag(Δt − LOOP_PERIOD_NS),
+     per mapped axis the inputs delta, then per mapped axis the outputs delta,
+   where a delta of an image of S bytes is ⌈S/8⌉ mask bytes (bit j = byte j changed since
+   the axis' previous frame) followed by the changed bytes: an axis whose only change is
+   6064 costs 2 + 4 bytes.
+   Cyclic side: frames are built in a scratch buffer and copied into a wait-free SPSC
+   byte ring; a non-RT thread (ServoRecord_Start) or your own loop (ServoRecord_Flush)
+   appends them to the file. If the ring is full the recording stops there (a delta chain
+   has no gaps): the file stays valid up to the last complete frame and `stopped` says
+   so. Size CSP_RECORD_RING_SIZE for two flush periods of frames.
+   Replay is exact when the recording starts right after ServoAxis_Init (before the first
+   tick), the build has the same knobs (checked through a hash in the header) and the
+   same things are attached to the axes (config buffers, trajectory sources, dead time:
+   attach them between ServoReplay_Open and ServoReplay_Run). Runtime config commits and
+   SDO results are not recorded. */
+#ifndef CSP_RECORD_RING_SIZE
+# define CSP_RECORD_RING_SIZE  (1u << 20)  /* bytes buffered in RAM (power of two)            */
+#endif
+#define CSP_REC_VERSION        1
+#define CSP_REC_F_SINGLE       1u     /* recorded from ServoTemplate_Run (g_axis)             */
+#define CSP_REC_MASK_BYTES(s)  (((s) + 7) / 8)
+
+typedef struct {
+    char     magic[8];                 /* "CSPRECRD"                                           */
+    uint32_t version;                  /* CSP_REC_VERSION                                      */
+    uint32_t header_size;              /* bytes before the first frame (this + axis table)     */
+    uint32_t axes;
+    uint32_t in_size, out_size;        /* sizeof(Drive_Inputs) / sizeof(Drive_Outputs)         */
+    uint32_t period_us;                /* LOOP_PERIOD_US                                       */
+    uint32_t flags;                    /* CSP_REC_F_*                                          */
+    uint32_t build_hash;               /* knobs that change the tick's outputs (replay checks) */
+    int64_t  t_open_ns;                /* now_ns() at ServoRecord_Open                         */
+} Servo_RecHeader;
+_Static_assert(sizeof(Servo_RecHeader) == 48, "recording header layout is part of the file format");
+
+#if CSP_RECORD
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint64_t head;             /* written by the producer only                         */
+    uint64_t         tail_cache;       /* producer's last view of tail                         */
+    int64_t          prev_ns;          /* time of the previous recorded tick                   */
+    const void      *ctx;              /* axes array the file describes                        */
+    size_t           axes;
+    size_t           fpos;             /* bytes of the frame being built                       */
+    uint8_t         *frame;            /* scratch, worst-case frame                            */
+    uint8_t         *prev_in, *prev_out; /* axes × image: last recorded bytes                  */
+    uint8_t         *mapped;           /* per axis                                             */
+    _Atomic uint64_t frames;           /* frames pushed                                        */
+    _Atomic int      stopped;          /* 1 = ring full or axes changed: no more frames        */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint64_t tail;             /* written by the flusher only                          */
+    FILE            *f;
+    uint64_t         bytes;            /* frame bytes written to the file                      */
+    unsigned         poll_ms;
+    _Atomic int      running;
+    pthread_t        thread;
+    uint8_t          ring[CSP_RECORD_RING_SIZE];
+} Servo_Recorder;
+
+static _Thread_local Servo_Recorder *tls_rec;  /* NULL = this thread does not record */
+
+/* Cyclic thread: record its ticks into `r` (after ServoRecord_Open; NULL = stop). */
+void ServoRecord_Bind(Servo_Recorder *r){ tls_rec = r; }
+
+static inline size_t servo_rec_varint(uint8_t *p, int64_t v)
+{
+    uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);        /* zigzag */
+    size_t n = 0;
+    while (z >= 0x80){ p[n++] = (uint8_t)(z | 0x80); z >>= 7; }
+    p[n++] = (uint8_t)z;
+    return n;
+}
+
+/* Changed-byte delta of `cur` against `prev` (updated to `cur`). Returns bytes written. */
+static inline size_t servo_rec_delta(uint8_t *dst, uint8_t *prev, const uint8_t *cur, size_t len)
+{
+    const size_t mb = CSP_REC_MASK_BYTES(len);
+    size_t n = mb;
+    memset(dst, 0, mb);
+    for (size_t j = 0; j < len; j++){
+        if (cur[j] == prev[j]) continue;
+        dst[j >> 3] |= (uint8_t)(1u << (j & 7));
+        dst[n++] = prev[j] = cur[j];
+    }
+    return n;
+}
+
+/* Producer: commit the frame in the scratch buffer, or stop recording for good. */
+static inline void servo_rec_push(Servo_Recorder *r)
+{
+    const uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h - r->tail_cache + r->fpos > CSP_RECORD_RING_SIZE){
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (h - r->tail_cache + r->fpos > CSP_RECORD_RING_SIZE){
+            atomic_store_explicit(&r->stopped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    const size_t at = (size_t)(h & (CSP_RECORD_RING_SIZE - 1));
+    const size_t n1 = r->fpos < CSP_RECORD_RING_SIZE - at ? r->fpos : CSP_RECORD_RING_SIZE - at;
+    memcpy(&r->ring[at], r->frame, n1);
+    memcpy(r->ring, r->frame + n1, r->fpos - n1);
+    CSP_RELAXED_ADD(r->frames, 1);
+    atomic_store_explicit(&r->head, h + r->fpos, memory_order_release);
+}
+
+/* Append what the producer committed to the file. Non-RT (the thread below, or your own
+   loop). Returns the bytes written. */
+size_t ServoRecord_Flush(Servo_Recorder *r)
+{
+    const uint64_t tl = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    const uint64_t h  = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (h == tl || !r->f) return 0;
+    const size_t at = (size_t)(tl & (CSP_RECORD_RING_SIZE - 1));
+    const size_t n  = (size_t)(h - tl);
+    const size_t n1 = n < CSP_RECORD_RING_SIZE - at ? n : CSP_RECORD_RING_SIZE - at;
+    if (fwrite(&r->ring[at], 1, n1, r->f) != n1 || fwrite(r->ring, 1, n - n1, r->f) != n - n1){
+        if (!atomic_exchange(&r->stopped, 1)) ERRF("record: write failed after %llu bytes", (unsigned long long)r->bytes);
+    }
+    fflush(r->f);
+    r->bytes += n;
+    atomic_store_explicit(&r->tail, h, memory_order_release);
+    return n;
+}
+
+static void *servo_rec_thread(void *arg)
+{
+    Servo_Recorder *r = (Servo_Recorder*)arg;
+    const struct timespec req = { r->poll_ms/1000, (long)(r->poll_ms%1000)*1000000L };
+    while (atomic_load(&r->running)){
+        ServoRecord_Flush(r);
+        nanosleep(&req, NULL);
+    }
+    ServoRecord_Flush(r);
+    return NULL;
+}
+
+/* Flush thread (non-RT): poll every `poll_ms`. */
+int ServoRecord_Start(Servo_Recorder *r, unsigned poll_ms)
+{
+    r->poll_ms = poll_ms ? poll_ms : 10;
+    atomic_store(&r->running, 1);
+    return pthread_create(&r->thread, NULL, servo_rec_thread, r) == 0 ? 0 : -1;
+}
+
+/* Stop the flush thread (if started), flush and close the file. Unbind the recorder from
+   the cyclic thread (or stop ticking) first. */
+void ServoRecord_Close(Servo_Recorder *r)
+{
+    if (atomic_exchange(&r->running, 0)) pthread_join(r->thread, NULL);
+    ServoRecord_Flush(r);
+    if (r->f) fclose(r->f);
+    free(r->frame); free(r->prev_in); free(r->prev_out); free(r->mapped);
+    r->f = NULL; r->frame = r->prev_in = r->prev_out = r->mapped = NULL;
+    if (atomic_load(&r->stopped))
+        WARNF("record: stopped early after %llu frames (ring full or axes changed)",
+              (unsigned long long)atomic_load(&r->frames));
+}
+#endif /* CSP_RECORD */
+
+/* ==========================================
+   4h) DISTRIBUTED-CLOCK TIMEBASE (DC lock of the cycle)
+   ==========================================
+
+   WHAT: a PI controller that locks the host's cycle to the EtherCAT distributed clock.
+   After each tick the master reports the DC system time at which the reference clock saw
+   that tick's frame (dc_time(), 4); ServoDc_Update() places it in the SYNC0 period and
+   returns a correction for the next deadline, so the frame keeps reaching the drives
+   `shift_ns` before SYNC0 latches the set-point.
+   WHY: the runner (9) holds an exact CLOCK_MONOTONIC grid, but the host crystal and the
+   reference clock differ by tens of ppm. At 250 µs and 50 ppm the frame slides across
+   a whole SYNC0 period every 5 s; each time it crosses the edge, one set-point lands a
+   cycle late (or two land in one), the drive sees a 0 or 2·Δ step and the FE spikes.
+   60C2:1 only tells the drive the nominal period; nothing aligns the phase.
+   HOW: e = (DC time of the frame − sync0_base + shift) wrapped to ±period/2, i.e. how
+   much later than "shift before the next SYNC0" the frame went out. The first sample
+   steps the grid by −e at once, and so do CSP_DC_STEP_TICKS in a row with |e| > step_ns
+   (a DC time jump; the integral is kept); a single one is an outlier (a late wake-up),
+   ignored without touching the lock. Otherwise u = kp·e + Σ ki·e, clamped to
+   ±max_adj_ns per tick, integral clamped too (anti-windup), and the next deadline moves
+   by −u. In steady state the integral is the rate difference per period: drift_ppb
+   (+ = reference clock faster than the host). One ns of integral is 4 ppm at 250 µs, so
+   the gains are very low on purpose: the loop settles in ~1300 ticks (critically
+   damped) and, with 0–5 µs of uniform wake-up jitter, drift_ppb stays within ±2 ppm
+   of the true rate (±1 ppm at 0–2 µs). Locked = |e| ≤ lock_ns for lock_ticks ticks in
+   a row; CSP_DC_LOST_TICKS ticks in a row without a DC time (ServoDc_Lost) unlock.
+   The drives follow the reference clock through the master's DC setup (ref clock = first
+   DC slave, delays measured, SYNC0 cycle = 60C2:1); this only moves the host. Masters
+   that slave the reference clock to the host instead (IgH ecrt_master_sync_reference_clock)
+   need no lock. With shards (9) the grid is shared: lock single runners only.
+   One controller per cyclic thread; it reports into that thread's cycle stats (4b), from
+   where the telemetry (4e, v3) publishes offset, drift and lock. */
+#ifndef CSP_DC_KP
+# define CSP_DC_KP             0.006  /* proportional gain (per tick)                          */
+#endif
+#ifndef CSP_DC_KI
+# define CSP_DC_KI             1e-5   /* integral gain (per tick)                              */
+#endif
+#ifndef CSP_DC_STEP_TICKS
+# define CSP_DC_STEP_TICKS     8      /* ticks in a row beyond step_ns before a phase step    */
+#endif
+#ifndef CSP_DC_LOST_TICKS
+# define CSP_DC_LOST_TICKS     8      /* ticks in a row without a DC time before "unlocked"    */
+#endif
+#ifndef CSP_DC_LOCK_TICKS
+# define CSP_DC_LOCK_TICKS     100    /* in-window ticks in a row before "locked"              */
+#endif
+
+typedef struct {
+    /* Configuration (ServoDc_Init fills the defaults; adjust before the first update) */
+    int64_t  period_ns;                /* DC cycle = SYNC0 cycle = 60C2:1 = tick period       */
+    int64_t  shift_ns;                 /* frame → SYNC0 distance to hold (CSP_DC_SHIFT_US)    */
+    int64_t  sync0_base_ns;            /* DC time of one SYNC0 edge (SYNC0 start time + the
+                                          slave's SYNC0 shift; 0 for edges on period multiples) */
+    double   kp, ki;                   /* PI gains                                             */
+    int64_t  max_adj_ns;               /* |slew| per tick (period/20)                          */
+    int64_t  step_ns;                  /* |e| beyond: outlier; CSP_DC_STEP_TICKS of them in
+                                          a row step the phase (period/4)                      */
+    int64_t  lock_ns;                  /* lock window (period/50)                              */
+    uint32_t lock_ticks;               /* CSP_DC_LOCK_TICKS                                    */
+
+    /* State / outputs (cyclic thread; other threads read them for display only) */
+    int64_t  offset_ns;                /* last phase error e                                   */
+    int32_t  drift_ppb;                /* reference clock rate − host rate                     */
+    int      locked;
+    double   integ;                    /* integral term (ns per tick)                          */
+    uint32_t good;                     /* consecutive ticks within lock_ns                     */
+    uint32_t far;                      /* consecutive ticks beyond step_ns                     */
+    uint32_t miss;                     /* consecutive ticks without a DC time                  */
+    uint64_t samples, steps, lost;     /* updates, phase steps, ticks without a DC time        */
+} Servo_DcSync;
+
+void ServoDc_Init(Servo_DcSync *s, int64_t period_ns)
+{
+    memset(s, 0, sizeof *s);
+    s->period_ns  = period_ns > 0 ? period_ns : LOOP_PERIOD_NS;
+    s->shift_ns   = (int64_t)CSP_DC_SHIFT_US * 1000;
+    s->kp = CSP_DC_KP; s->ki = CSP_DC_KI;
+    s->max_adj_ns = s->period_ns / 20;
+    s->step_ns    = s->period_ns / 4;
+    s->lock_ns    = s->period_ns / 50;
+    s->lock_ticks = CSP_DC_LOCK_TICKS;
+}
+
+/* Feed the DC time of this tick's frame; returns the correction (ns) to add to the next
+   deadline. Call from the cyclic thread, once per tick. */
+int64_t ServoDc_Update(Servo_DcSync *s, int64_t dc_ns)
+{
+    const int64_t P = s->period_ns;
+    int64_t e = (dc_ns - s->sync0_base_ns + s->shift_ns) % P;
+    if (e < 0)      e += P;
+    if (e >= P / 2) e -= P;
+    s->offset_ns = e;
+
+    int64_t adj = 0;
+    const int far = e > s->step_ns || e < -s->step_ns;
+    s->far  = far ? s->far + 1 : 0;
+    s->miss = 0;
+    if (s->samples++ == 0 || s->far >= CSP_DC_STEP_TICKS){
+        if (s->samples > 1) WARNF("DC lock: phase step of %lld ns", (long long)e);
+        s->steps++;
+        s->good = 0;                   /* the integral (the rate) survives a DC time jump */
+        s->far  = 0;
+        adj = -e;
+    } else if (far){
+        /* one late frame (wake-up latency): no correction, lock state untouched */
+    } else {
+        const double lim = (double)s->max_adj_ns;
+        s->integ += s->ki * (double)e;
+        if (s->integ >  lim) s->integ =  lim;
+        if (s->integ < -lim) s->integ = -lim;
+        double u = s->kp * (double)e + s->integ;
+        if (u >  lim) u =  lim;
+        if (u < -lim) u = -lim;
+        adj = -(int64_t)llround(u);
+        s->good = (e <= s->lock_ns && e >= -s->lock_ns) ? s->good + 1 : 0;
+    }
+    s->drift_ppb = (int32_t)llround(s->integ * 1e9 / (double)P);
+
+    const int locked = s->good >= s->lock_ticks;
+    if (locked != s->locked){
+        if (locked) LOGF("DC lock: locked (offset %lld ns, drift %d ppb)", (long long)e, s->drift_ppb);
+        else        WARNF("DC lock: lost (offset %lld ns)", (long long)e);
+        s->locked = locked;
+    }
+
+    Servo_CycleStats *cs = tls_cycle_stats;
+    cs->dc_offset_ns = e;
+    cs->dc_shift_ns  = s->shift_ns;
+    cs->dc_drift_ppb = s->drift_ppb;
+    cs->dc_flags     = CSP_DC_F_ACTIVE | (locked ? CSP_DC_F_LOCKED : 0u);
+    return adj;
+}
+
+/* The master had no DC time for this tick: no correction (the grid coasts at the learned
+   rate); CSP_DC_LOST_TICKS of them in a row drop the lock. Cyclic thread. */
+void ServoDc_Lost(Servo_DcSync *s)
+{
+    s->lost++;
+    if (++s->miss < CSP_DC_LOST_TICKS) return;
+    s->good = 0;
+    if (s->locked){
+        WARNF("DC lock: lost (no DC time for %u ticks)", (unsigned)s->miss);
+        s->locked = 0;
+    }
+    tls_cycle_stats->dc_flags &= ~CSP_DC_F_LOCKED;
+}
+
+/* dc_read for the runner (9): `user` = EcDevice, the time comes from dc_time() (4). */
+int ServoDc_ReadMaster(void *user, int64_t *dc_ns){ return dc_time((EcDevice)user, dc_ns); }
+
+/* ===================================
+   5) AXIS CONTEXT + BYTE HELPERS
+   ===================================
+
+   WHY a context? Everything Run() needs between ticks lives in one Servo_Axis, so a
+   single process can drive many slaves: one Servo_Axis per drive, stepped in a loop.
+   Each context is padded to a cache line, so an array of them is contiguous and two
+   axes never share a line. */
+typedef struct Servo_Traj Servo_Traj;
+
+/* One set-point as a trajectory source produces it: position plus the profile's velocity
+   and acceleration at that sample (kept for diagnostics / feed-forward). */
+typedef struct {
+    int32_t pos;                       /* counts                                               */
+    int32_t vel;                       /* counts/s                                             */
+    int32_t acc;                       /* counts/s²                                            */
+} Servo_Setpoint;
+
+/* Following-error statistics per window (see 5e). Knobs: CSP_FE_STATS (1 = on),
+   CSP_FE_STATS_WINDOW_MS (default window; per axis with ServoAxis_SetFeWindow). */
+#ifndef CSP_FE_STATS
+# define CSP_FE_STATS          1
+#endif
+#ifndef CSP_FE_STATS_WINDOW_MS
+# define CSP_FE_STATS_WINDOW_MS 1000
+#endif
+#define CSP_FE_SKETCH_BUCKETS  248    /* |FE| log-linear buckets: 0..31 exact, then 8 per octave */
+
+/* Transport-delay model (see 5f). CSP_DEADTIME_RING: targets remembered per axis (power
+   of two, 0 = compiled out); CSP_DEADTIME_TICKS: default delay (0 = off, FE from 60F4). */
+#ifndef CSP_DEADTIME_RING
+# define CSP_DEADTIME_RING     16
+#endif
+#ifndef CSP_DEADTIME_TICKS
+# define CSP_DEADTIME_TICKS    0
+#endif
+#if CSP_DEADTIME_RING & (CSP_DEADTIME_RING - 1)
+# error "CSP_DEADTIME_RING must be a power of two (or 0)"
+#endif
+#if CSP_DEADTIME_TICKS >= CSP_DEADTIME_RING && CSP_DEADTIME_TICKS > 0
+# error "CSP_DEADTIME_TICKS must be below CSP_DEADTIME_RING"
+#endif
+
+/* Runtime-tunable motion/monitor knobs (see 5g). The section-1 macros are only the
+   defaults; each axis reads its live copy through one pointer. CSP_CFG_RAMP_MS_MAX bounds
+   RAMP_MS at runtime (it sizes the ramp table held in every copy). */
+#ifndef CSP_CFG_RAMP_MS_MAX
+# define CSP_CFG_RAMP_MS_MAX   (RAMP_MS > 1000 ? RAMP_MS : 1000)
+#endif
+#define CSP_CFG_RAMP_TICKS_MAX CSP_MS_TO_TICKS(CSP_CFG_RAMP_MS_MAX)
+
+typedef struct {
+    /* tunables: what a writer edits (section-1 names in brackets) */
+    int32_t inc_step;                  /* counts per tick at cruise            [INC_STEP]      */
+    int32_t limit_pos;                 /* software ±limit (counts)             [LIMIT_POS]     */
+    int32_t dwell_ms;                  /* hold at the limits                   [DWELL_MS]      */
+    int32_t ramp_ms;                   /* soft ramp on enable / after dwell    [RAMP_MS]       */
+    int32_t fe_window;                 /* FE monitor window (counts)           [FE_WINDOW_COUNTS] */
+    int32_t fe_warn_pct;               /* warn at % of the window (1..100)     [FE_WARN_PCT]   */
+    int32_t edge_policy;               /* CW bit4: 0 = every tick, 1 = on change [SETPOINT_EDGE_POLICY] */
+    int32_t fault_cool_ms;             /* Shutdown hold after a fault clears [FAULT_COOLDOWN_MS] */
+    int32_t comm_cool_ms;              /* Shutdown hold after the link returns [COMM_COOLDOWN_MS] */
+    int32_t fast_reenable;             /* 1 = fast first recovery attempt  [CSP_402_FAST_REENABLE] */
+    int32_t retry_max;                 /* retries before lock-out (0 = never) [CSP_402_RETRY_MAX] */
+    int32_t retry_window_ms;           /* a fault this soon after enabling is a retry          */
+    int32_t backoff_max_ms;            /* cap of the doubled cooldown      [CSP_402_BACKOFF_MAX_MS] */
+    int32_t step_timeout_ms;           /* enable-step timeout (0 = none) [CSP_402_STEP_TIMEOUT_MS] */
+    /* derived by ServoConfig_Commit on the committing thread; the cyclic path only reads */
+    int32_t dwell_ticks, ramp_ticks;
+    int32_t fe_warn_th, fe_ok_th;      /* latch above ±warn, clear below ±ok (half of warn)    */
+    int64_t fault_cool_ns, comm_cool_ns, retry_window_ns, backoff_max_ns, step_timeout_ns;
+    int32_t ramp_lut[CSP_CFG_RAMP_TICKS_MAX > 0 ? CSP_CFG_RAMP_TICKS_MAX : 1];
+} Servo_AxisConfig;
+
+/* Two copies per axis: the live one (gen & 1) and the one being edited. */
+typedef struct {
+    Servo_AxisConfig slot[2];
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t gen;              /* generation published by the writer                   */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t ack;              /* generation the cyclic thread has switched to         */
+    _Atomic int32_t  reach;            /* cyclic: max(|target|, |6064|) at the last tick       */
+} Servo_ConfigBuf;
+
+/* CiA-402 engine states (7b), as `st` in logs, trace (4d) and telemetry (4e): 0..3 keep
+   their historic meaning, 4..6 are the fault / cooldown / lock-out states. */
+enum {
+    CSP_ST_SHUTDOWN = 0,               /* CW 0x0006, want ReadyToSwitchOn                      */
+    CSP_ST_SWITCH_ON,                  /* CW 0x0007, want SwitchedOn                           */
+    CSP_ST_ENABLE,                     /* CW 0x000F + aligned target, want OperationEnabled    */
+    CSP_ST_RUN,                        /* producer owns target and CW                          */
+    CSP_ST_FAULT,                      /* fault-reset pulses until SW bit3 clears              */
+    CSP_ST_COOLDOWN,                   /* CW 0x0006 for a timed hold (fault / link / backoff)  */
+    CSP_ST_LOCKED,                     /* too many retries: Shutdown until ServoAxis_ClearFault */
+    CSP_ST_COUNT
+};
+
+typedef struct { uint32_t n, last_us, max_us; } Servo_402Edge;   /* time spent in `from`  */
+
+typedef struct {
+    Servo_402Edge edge[CSP_ST_COUNT][CSP_ST_COUNT]; /* [from][to]                          */
+    uint32_t faults, retries, timeouts, lockouts;
+    uint32_t drops;                    /* OperationEnabled left without a fault (SW ≠ 0x0027)  */
+    uint32_t recoveries;               /* OperationEnabled reached after a fault               */
+    uint32_t rec_last_us, rec_max_us;  /* first fault of the incident → OperationEnabled       */
+} Servo_402Stats;
+
+typedef struct {                       /* window in progress (cyclic thread only)              */
+    uint32_t n, window;                /* samples so far / window length (ticks, ≤ 65535)      */
+    int32_t  min, max;
+    int64_t  sum;
+    double   sumsq;
+    uint16_t hist[CSP_FE_SKETCH_BUCKETS];
+} Servo_FeAccum;
+
+typedef struct {                       /* last completed window                                */
+    uint64_t windows;                  /* windows completed since init                         */
+    uint32_t n;                        /* samples in it                                        */
+    int32_t  min, max, mean, rms;      /* counts: signed min/max/mean (bias), RMS              */
+    int32_t  p50, p90, p99, p999;      /* |FE| quantiles from the sketch (within ~6 %)         */
+} Servo_FeStats;
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    Drive_Inputs  *in;                 /* mapped input PDOs of this slave (NULL = not mapped)  */
+    Drive_Outputs *out;                /* mapped output PDOs of this slave                     */
+#if CSP_PI_SNAPSHOT
+    Drive_Outputs *out_pair[2];        /* optional ping-pong output images (zero-copy publish) */
+    _Atomic(Drive_Outputs*) out_front; /* image the master sends (ping-pong only)              */
+    _Alignas(8) Drive_Inputs  pi_in;   /* inputs snapshot taken at tick start                  */
+    _Alignas(8) Drive_Outputs pi_out;  /* outputs built during the tick, published at the end  */
+    uint8_t        out_back;           /* ping-pong: index of the buffer written next          */
+#endif
+    int64_t  t0;                       /* loop scheduler reference (ns)                        */
+    int32_t  pos_tgt;                  /* current target position                              */
+    int32_t  pos_prev;                 /* target of the previous producer tick (edge policy)   */
+    int      st;                       /* CSP_ST_*: 0 Shutdown, 1 SwitchOn, 2 Enabling, 3 Running,
+                                          4 FaultReset, 5 Cooldown, 6 Locked                   */
+    int      dir;                      /* +1 forward, -1 backward, 0 stopped (dwell)           */
+    int      dwell_rem;                /* ticks remaining in dwell                             */
+    int      ramp_rem;                 /* ticks remaining in ramp                              */
+    const Servo_AxisConfig *cfg;       /* live knobs (defaults, or a slot of cfg_buf; 5g)      */
+    Servo_ConfigBuf *cfg_buf;          /* runtime config (NULL = section-1 defaults)           */
+    uint32_t cfg_gen;                  /* generation of cfg                                    */
+    Servo_Traj    *traj;               /* S-curve source (NULL = triangle generator)           */
+    struct Servo_Stream *stream;       /* streamed set-points (wins over traj when set)        */
+    struct Servo_Interp *interp;       /* coordinated group (wins over all other sources)      */
+    int      interp_lane;              /* this axis' lane in the group                         */
+    Servo_Setpoint sp;                 /* last set-point taken from a trajectory source        */
+    int64_t  st_t_ns;                  /* entry time of `st` (the engine's own timer)          */
+    int64_t  cool_ns;                  /* length of the current CSP_ST_COOLDOWN                */
+    int64_t  fault_t_ns;               /* first fault of the open incident (0 = none)          */
+    uint32_t st_ticks;                 /* ticks spent in `st`                                  */
+    uint8_t  st_retry;                 /* failed attempts in the open incident                 */
+    uint8_t  link_down;                /* SW was 0 (comm down) since the last engine tick     */
+    _Atomic uint8_t fault_ack;         /* ServoAxis_ClearFault() request                       */
+    Servo_402Stats s402;               /* per-transition timing + recovery counters            */
+    int      slave_index;              /* position on the bus (for logs)                       */
+    uint16_t edge;                     /* bit4 toggler for “new set-point”                     */
+    uint8_t  fe_warn;                  /* FE warning latched                                   */
+    uint8_t  trace_flags;              /* CSP_TRACE_F_* of the last traced tick (edge detect)  */
+#if CSP_FF_MAPPED
+    float    ff_kv;                    /* 60B1 = ff_kv × set-point velocity (counts/s)         */
+    float    ff_ka;                    /* 60B2 = ff_ka × set-point acceleration (counts/s²)    */
+    int32_t  ff_vel_prev;              /* triangle generator: last velocity (→ acceleration)   */
+#endif
+#if CSP_DEADTIME_RING
+    int32_t  cmd_hist[CSP_DEADTIME_RING]; /* targets sent, newest at cmd_n - 1 (5f)            */
+    uint32_t cmd_n;                    /* targets pushed so far                                */
+    uint8_t  dt_ticks;                 /* transport delay (ticks); 0 = FE from 60F4            */
+    uint8_t  dt_predict;               /* 1 = align on the extrapolated actual when enabling   */
+    int32_t  act_prev;                 /* last actual seen (velocity estimate)                 */
+    int32_t  act_pred;                 /* actual extrapolated by dt_ticks (diagnostics)        */
+#endif
+#if CSP_FE_STATS
+    Servo_FeAccum  fe_acc;             /* FE window being accumulated (5e)                     */
+    Servo_FeStats  fe_stats;           /* result of the last complete window                   */
+#endif
+    struct {
+        uint64_t events;               /* producer ticks that found ≥1 whole period missed     */
+        uint64_t missed;               /* periods missed in total                              */
+        uint64_t dropped;              /* periods never produced (skipped or resynced)         */
+        int64_t  worst_late_ns;        /* largest lateness vs. the nominal tick time           */
+    } ovr;
+} Servo_Axis;
+
+/* Field pointers used by the tick. With CSP_PI_SNAPSHOT they address the axis' local
+   copies, so the shared (DMA) image is only touched by one block read at tick start and
+   one block write at the end (see 7c); otherwise they go straight to the master image. */
+#if CSP_PI_SNAPSHOT
+#define IN_PTR(ax, field)   (((uint8_t*)&(ax)->pi_in)  + offsetof(Drive_Inputs,  field))
+#define OUT_PTR(ax, field)  (((uint8_t*)&(ax)->pi_out) + offsetof(Drive_Outputs, field))
+#else
+#define IN_PTR(ax, field)   (((uint8_t*)(ax)->in)  + offsetof(Drive_Inputs,  field))
+#define OUT_PTR(ax, field)  (((uint8_t*)(ax)->out) + offsetof(Drive_Outputs, field))
+#endif
+
+/* Field accessors used by the tick: PDO_GET16(ax, status_word), PDO_SET32(ax,
+   target_position, v) … Each field's access is fixed at compile time:
+     • your master's EC_GET/SET when you provide them (they own the image format);
+     • otherwise a naturally aligned field (CSP_PDO_FAST: the 8-byte aligned local copy with
+       CSP_PI_SNAPSHOT, or the image per the section 3 flags / CSP_IMAGE_ALIGN) is one
+       load/store, any other field goes through the memcpy helpers;
+     • on a big-endian host the snapshot is byte-swapped once per block at tick start and
+       publish (CSP_PDO_SWAP_BATCH), so the tick reads host order; without the snapshot
+       each access swaps. */
+#if CSP_PI_SNAPSHOT
+# define CSP_PDO_FAST(f, n)   CSP_PDO_ALIGNED_##f
+# define CSP_PDO_SWAP_EACH    0
+# define CSP_PDO_SWAP_BATCH   CSP_IMAGE_SWAP
+#else
+# define CSP_PDO_FAST(f, n)   (CSP_PDO_IMG_ALIGNED_##f || (CSP_PDO_ALIGNED_##f && CSP_IMAGE_ALIGN % (n) == 0))
+# define CSP_PDO_SWAP_EACH    CSP_IMAGE_SWAP
+# define CSP_PDO_SWAP_BATCH   0
+#endif
+
+#if CSP_EC_FALLBACK
+static inline uint16_t csp_fix16(uint16_t v){ return CSP_PDO_SWAP_EACH ? csp_bswap16(v) : v; }
+static inline uint32_t csp_fix32(uint32_t v){ return CSP_PDO_SWAP_EACH ? csp_bswap32(v) : v; }
+#define PDO_GET16(ax, f)    csp_fix16(CSP_PDO_FAST(f, 2) ? h_get_u16a(IN_PTR(ax, f)) : h_get_u16(IN_PTR(ax, f)))
+#define PDO_GET32(ax, f)    csp_fix32(CSP_PDO_FAST(f, 4) ? h_get_u32a(IN_PTR(ax, f)) : h_get_u32(IN_PTR(ax, f)))
+#define PDO_SET16(ax, f, v) do { const uint16_t v_ = csp_fix16((uint16_t)(v));                        \
+                                 if (CSP_PDO_FAST(f, 2)) h_set_u16a(OUT_PTR(ax, f), v_);             \
+                                 else                    h_set_u16 (OUT_PTR(ax, f), v_); } while (0)
+#define PDO_SET32(ax, f, v) do { const uint32_t v_ = csp_fix32((uint32_t)(v));                        \
+                                 if (CSP_PDO_FAST(f, 4)) h_set_u32a(OUT_PTR(ax, f), v_);             \
+                                 else                    h_set_u32 (OUT_PTR(ax, f), v_); } while (0)
+#define PDO_OUT16(ax, f)    csp_fix16(h_get_u16(OUT_PTR(ax, f)))   /* read back an output (trace) */
+#define PDO_OUT32(ax, f)    csp_fix32(h_get_u32(OUT_PTR(ax, f)))
+#else
+#undef  CSP_PDO_SWAP_BATCH
+#define CSP_PDO_SWAP_BATCH  0
+#define PDO_GET16(ax, f)    ((uint16_t)EC_GETWORD(IN_PTR(ax, f)))
+#define PDO_GET32(ax, f)    ((uint32_t)EC_GETUINT32(IN_PTR(ax, f)))
+#define PDO_SET16(ax, f, v) EC_SETWORD(OUT_PTR(ax, f), (v))
+#define PDO_SET32(ax, f, v) EC_SETUINT32(OUT_PTR(ax, f), (v))
+#define PDO_OUT16(ax, f)    ((uint16_t)EC_GETWORD(OUT_PTR(ax, f)))
+#define PDO_OUT32(ax, f)    ((uint32_t)EC_GETUINT32(OUT_PTR(ax, f)))
+#endif
+
+#if CSP_PI_SNAPSHOT
+/* Wire ↔ host order for a whole snapshot block; compiles to nothing unless
+   CSP_PDO_SWAP_BATCH. */
+static inline void csp_swap_field(uint8_t *p, size_t n)
+{
+    if (n == 2)      h_set_u16(p, csp_bswap16(h_get_u16(p)));
+    else if (n == 4) h_set_u32(p, csp_bswap32(h_get_u32(p)));
+    else if (n == 8){ const uint32_t lo = h_get_u32(p), hi = h_get_u32(p + 4);
+                      h_set_u32(p, csp_bswap32(hi)); h_set_u32(p + 4, csp_bswap32(lo)); }
+}
+#define CSP_SWAP_IN(f, n)   csp_swap_field((uint8_t*)d + offsetof(Drive_Inputs,  f), (n));
+#define CSP_SWAP_OUT(f, n)  csp_swap_field((uint8_t*)d + offsetof(Drive_Outputs, f), (n));
+static inline void servo_pi_swap_in(Drive_Inputs *d)
+{
+    (void)d;
+#if CSP_PDO_SWAP_BATCH
+    CSP_PDO_IN_FIELDS(CSP_SWAP_IN)
+#endif
+}
+static inline void servo_pi_swap_out(Drive_Outputs *d)
+{
+    (void)d;
+#if CSP_PDO_SWAP_BATCH
+    CSP_PDO_OUT_FIELDS(CSP_SWAP_OUT)
+#endif
+}
+#endif
+
+/* Ramp profile table: |delta| for each tick of the ramp, built with the config it belongs
+   to (5g) so the producer only indexes it (the old per-tick `delta*used/total` division
+   is gone). Entry i is inc_step × shape((i+1)/n), never below 1 count so a ramp always
+   moves. */
+static void servo_ramp_build(int32_t *lut, int n, int32_t inc_step, int shape)
+{
+    for (int i = 0; i < n; i++){
+        int64_t v;
+        if (shape == 0){   /* linear: exactly the previous integer formula */
+            v = ((int64_t)inc_step * (i + 1)) / n;
+        } else {
+            const double x = (double)(i + 1) / (double)n;
+            const double y = (shape == 1) ? x*x*(3.0 - 2.0*x)
+                                          : x*x*x*(x*(x*6.0 - 15.0) + 10.0);
+            v = (int64_t)((double)inc_step * y);
+        }
+        lut[i] = (int32_t)(v < 1 ? 1 : v);
+    }
+}
+
+/* ---- 5b) Set-point ring + jerk-limited S-curve generator ----
+
+   The generator runs ahead of the cyclic task, in a non-RT thread: ServoTraj_Service()
+   tops the per-axis ring up (TRAJ_BLOCK samples per pass, planning the next segment with
+   sqrt/cbrt when one ends), and each tick only dequeues one sample — no profile math on
+   the cyclic thread. The ring is single-producer / single-consumer with acquire/release
+   indices (the same type feeds the stream, 5c). On enable the tick does not touch the
+   generator either: it posts a restart request (position + sequence); the producer
+   re-plans from there and acks with the ring head at the restart, and the tick drops the
+   older samples and holds its target until the fresh ones arrive (`underruns`).
+   The profile is the classic 7-segment rest-to-rest S-curve: jerk ±J, |a| ≤ A, |v| ≤ V;
+   short moves shrink the constant-a / cruise phases.
+   Attach per axis: `static Servo_Traj tr[N]; ServoTraj_Attach(&ax[i], &tr[i], …);`, then
+   call ServoTraj_Service(&tr[i]) from a non-RT thread a few times per ring length
+   (ServoTraj_StartService() in section 9 does that for a cell). */
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t head;             /* producer index                                       */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t tail;             /* consumer index                                       */
+    Servo_Setpoint   sp[SETPOINT_RING];
+} Servo_SetpointRing;
+
+static inline uint32_t servo_ring_level(const Servo_SetpointRing *r){
+    return atomic_load_explicit(&r->head, memory_order_acquire) - atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+static inline int servo_ring_push(Servo_SetpointRing *r, Servo_Setpoint v){
+    const uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (h - atomic_load_explicit(&r->tail, memory_order_acquire) >= SETPOINT_RING) return 0;
+    r->sp[h & (SETPOINT_RING - 1)] = v;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+    return 1;
+}
+
+/* One rest-to-rest S-curve move sampled at k·dt. Shared by the per-axis generator below
+   and by the coordinated interpolator (5d), where it drives the path parameter. */
+typedef struct {
+    double  vmax, amax, jmax;          /* limits: counts/s, counts/s², counts/s³               */
+    double  dt;                        /* sample period (s)                                    */
+    double  t_seg[8];                  /* start of segment i; t_seg[7] = move duration         */
+    double  p_s[7], v_s[7], a_s[7], j_s[7];
+    double  target;
+    int64_t k, n;                      /* sample index / samples in the move (0 = no move)     */
+    int     seg;
+} Servo_Profile;
+
+struct Servo_Traj {
+    /* producer side (ServoTraj_Service) */
+    Servo_Profile pf;                  /* current move                                         */
+    int32_t hold;                      /* dwell samples still to emit                          */
+    int     dir;                       /* direction of the next move                           */
+    /* set by the cyclic side (config switch, 5g), read when the next move is planned */
+    _Atomic int32_t dwell_ticks;       /* hold at each end                                     */
+    _Atomic int32_t limit;             /* moves go to ±limit                                   */
+    /* restart handshake: the cyclic side posts, the producer acks */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t reset_req;        /* cyclic: bumped on enable (0 = never enabled)         */
+    _Atomic int32_t  reset_pos;        /* cyclic: restart from here                            */
+    uint32_t         reset_seen;       /* cyclic: last ack whose stale samples were dropped    */
+    _Atomic uint64_t underruns;        /* cyclic: ticks that found no fresh sample             */
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t reset_ack;        /* producer: reset_req it restarted for                 */
+    _Atomic uint32_t reset_head;       /* producer: ring head at that restart                  */
+    Servo_SetpointRing ring;
+};
+
+static void servo_profile_init(Servo_Profile *p, double vmax, double amax, double jmax)
+{
+    memset(p, 0, sizeof *p);
+    p->vmax = vmax > 0.0 ? vmax : TRAJ_VMAX;
+    p->amax = amax > 0.0 ? amax : TRAJ_AMAX;
+    p->jmax = jmax > 0.0 ? jmax : TRAJ_JMAX;
+    p->dt   = (double)LOOP_PERIOD_US * 1e-6;
+}
+
+/* Plan a rest-to-rest move p_from → p_to (Biagiotti/Melchiorri, v0 = v1 = 0). */
+static void servo_profile_plan(Servo_Profile *pf, double p_from, double p_to)
+{
+    const double D = fabs(p_to - p_from), sgn = (p_to >= p_from) ? 1.0 : -1.0;
+    const double V = pf->vmax, A = pf->amax, J = pf->jmax;
+    double Tj, Ta, Tv;
+
+    if (V*J >= A*A){ Tj = A/J; Ta = Tj + V/A; }       /* a reaches A                      */
+    else           { Tj = sqrt(V/J); Ta = 2.0*Tj; }  /* v reached before a hits A        */
+    Tv = D/V - Ta;
+    if (Tv < 0.0){                                    /* V not reached: no cruise          */
+        Tv = 0.0;
+        Tj = A/J;
+        Ta = (A*A/J + sqrt(A*A*A*A/(J*J) + 4.0*A*D)) / (2.0*A);
+        if (Ta < 2.0*Tj){ Tj = cbrt(D/(2.0*J)); Ta = 2.0*Tj; }
+    }
+    const double dur[7] = { Tj, Ta - 2.0*Tj, Tj, Tv, Tj, Ta - 2.0*Tj, Tj };
+    const double jer[7] = { J, 0.0, -J, 0.0, -J, 0.0, J };
+
+    double t = 0.0, p = p_from, v = 0.0, a = 0.0;
+    for (int i = 0; i < 7; i++){
+        const double d = dur[i] > 0.0 ? dur[i] : 0.0, j = sgn*jer[i];
+        pf->t_seg[i] = t; pf->p_s[i] = p; pf->v_s[i] = v; pf->a_s[i] = a; pf->j_s[i] = j;
+        p += v*d + a*d*d/2.0 + j*d*d*d/6.0;
+        v += a*d + j*d*d/2.0;
+        a += j*d;
+        t += d;
+    }
+    pf->t_seg[7] = t;
+    pf->target   = p_to;
+    pf->seg      = 0;
+    pf->k        = 0;
+    pf->n        = (D > 0.0) ? (int64_t)ceil(t / pf->dt) : 0;
+}
+
+/* Evaluate sample k (k < n; k only grows between calls). out = {pos, vel, acc}. */
+static void servo_profile_at(Servo_Profile *pf, int64_t k, double out[3])
+{
+    const double t = (double)k * pf->dt;
+    while (pf->seg < 6 && t >= pf->t_seg[pf->seg + 1]) pf->seg++;
+    const int i = pf->seg; const double u = t - pf->t_seg[i];
+    out[0] = pf->p_s[i] + pf->v_s[i]*u + pf->a_s[i]*u*u/2.0 + pf->j_s[i]*u*u*u/6.0;
+    out[1] = pf->v_s[i] + pf->a_s[i]*u + pf->j_s[i]*u*u/2.0;
+    out[2] = pf->a_s[i] + pf->j_s[i]*u;
+}
+
+/* Producer: generate up to `count` samples into the ring (stops early when it is full).
+   Returns the samples pushed. */
+static int servo_traj_fill(Servo_Traj *tr, int count)
+{
+    Servo_Profile *pf = &tr->pf;
+    int pushed = 0;
+    while (count-- > 0 && servo_ring_level(&tr->ring) < SETPOINT_RING){
+        Servo_Setpoint sp = { (int32_t)lrint(pf->target), 0, 0 };
+        if (pf->k < pf->n){
+            if (++pf->k >= pf->n){
+                pf->n = 0;                                /* landed exactly on target → dwell */
+                tr->hold = atomic_load_explicit(&tr->dwell_ticks, memory_order_relaxed);
+            } else {
+                double s[3];
+                servo_profile_at(pf, pf->k, s);
+                sp.pos = (int32_t)lrint(s[0]);
+                sp.vel = (int32_t)lrint(s[1]);
+                sp.acc = (int32_t)lrint(s[2]);
+            }
+        } else if (tr->hold > 0){
+            tr->hold--;
+        } else {
+            const int32_t lim = atomic_load_explicit(&tr->limit, memory_order_relaxed);
+            servo_profile_plan(pf, pf->target, (double)(tr->dir * lim));
+            tr->dir = -tr->dir;
+            if (pf->n == 0) tr->hold = atomic_load_explicit(&tr->dwell_ticks, memory_order_relaxed);
+            continue;
+        }
+        pushed += servo_ring_push(&tr->ring, sp);
+    }
+    return pushed;
+}
+
+/* Producer (non-RT thread): restart if the axis (re)enabled since the last call, then top
+   the ring up by up to TRAJ_BLOCK samples. Nothing is generated before the first enable.
+   Returns the samples pushed. One producer per Servo_Traj. */
+int ServoTraj_Service(Servo_Traj *tr)
+{
+    const uint32_t req = atomic_load_explicit(&tr->reset_req, memory_order_acquire);
+    if (req == 0) return 0;
+    if (req != atomic_load_explicit(&tr->reset_ack, memory_order_relaxed)){
+        tr->pf.target = atomic_load_explicit(&tr->reset_pos, memory_order_relaxed);
+        tr->pf.n = 0; tr->pf.k = 0; tr->hold = 0; tr->dir = 1;
+        atomic_store_explicit(&tr->reset_head, atomic_load_explicit(&tr->ring.head, memory_order_relaxed),
+                              memory_order_relaxed);
+        atomic_store_explicit(&tr->reset_ack, req, memory_order_release);
+    }
+    return servo_traj_fill(tr, TRAJ_BLOCK);
+}
+
+/* Cyclic side, on enable: ask the producer to restart from `pos`. */
+static void servo_traj_reset(Servo_Traj *tr, int32_t pos)
+{
+    atomic_store_explicit(&tr->reset_pos, pos, memory_order_relaxed);
+    atomic_store_explicit(&tr->reset_req, atomic_load_explicit(&tr->reset_req, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/* Use the S-curve generator for `ax` (call after ServoAxis_Init, before Run). Any limit
+   ≤ 0 takes the TRAJ_* default. Returns 0. */
+int ServoTraj_Attach(Servo_Axis *ax, Servo_Traj *tr, double vmax, double amax, double jmax)
+{
+    memset(tr, 0, sizeof *tr);
+    servo_profile_init(&tr->pf, vmax, amax, jmax);
+    atomic_store(&tr->dwell_ticks, ax->cfg->dwell_ticks);
+    atomic_store(&tr->limit, ax->cfg->limit_pos);
+    tr->dir = 1;
+    ax->traj = tr;
+    return 0;
+}
+
+/* Cyclic side: take up to `want` owed samples from a ring (catch-up/extrapolate may ask
+   for more than one). Stops before a sample that would move more than `max_delta` from
+   the previous target (the first one is always taken). Returns the samples consumed. */
+static int64_t servo_ring_take(Servo_Axis *ax, Servo_SetpointRing *r, int64_t want, int32_t max_delta)
+{
+    const uint32_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    int64_t used = 0;
+    while (used < want && t != h){
+        const Servo_Setpoint *sp = &r->sp[t & (SETPOINT_RING - 1)];
+        const int64_t d = (int64_t)sp->pos - ax->pos_prev;
+        if (used > 0 && (d > max_delta || d < -max_delta)) break;
+        ax->sp = *sp;
+        ax->pos_tgt = sp->pos;
+        t++; used++;
+    }
+    atomic_store_explicit(&r->tail, t, memory_order_release);
+    return used;
+}
+
+/* S-curve source: wait for the producer's restart ack (dropping the samples planned
+   before it once), then take. No sample: hold the last target. */
+static int64_t servo_traj_take(Servo_Axis *ax, int64_t want, int32_t max_delta)
+{
+    Servo_Traj *tr = ax->traj;
+    const uint32_t req = atomic_load_explicit(&tr->reset_req, memory_order_relaxed);
+    int64_t used = 0;
+    if (atomic_load_explicit(&tr->reset_ack, memory_order_acquire) == req){
+        if (tr->reset_seen != req){
+            atomic_store_explicit(&tr->ring.tail, atomic_load_explicit(&tr->reset_head, memory_order_relaxed),
+                                  memory_order_release);
+            tr->reset_seen = req;
+        }
+        used = servo_ring_take(ax, &tr->ring, want, max_delta);
+    }
+    if (used) return used;
+    CSP_RELAXED_ADD(tr->underruns, 1);
+    ax->sp.vel = 0; ax->sp.acc = 0;
+    return 1;
+}
+
+/* ---- 5c) Streamed set-points from a non-RT planner ----
+
+   The planner (another thread, or a process feeding a thread) pushes set-points in bulk
+   with ServoStream_Push(); it never blocks and never touches the cyclic thread — a full
+   queue just accepts fewer. Each tick consumes one sample (more when catching up).
+   Underrun (queue empty at a tick) is counted and handled by policy:
+     STREAM_UNDERRUN_HOLD  keep the last target (velocity step to 0),
+     STREAM_UNDERRUN_DECEL keep moving at the last per-tick delta and brake it with
+                           `decel` counts/s² until stopped (smooth, overshoots a little).
+   Watermarks: high = fullest level seen by the planner after a push, low = emptiest level
+   seen by the cyclic side after a take — size the planner's push cadence with them.
+   Stale samples left from before a fault are flushed when the axis (re)enables: start
+   streaming once ax->st == CSP_ST_RUN, from the current ax->pos_tgt. */
+enum { STREAM_UNDERRUN_HOLD = 0, STREAM_UNDERRUN_DECEL = 1 };
+
+typedef struct Servo_Stream {
+    Servo_SetpointRing ring;
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t high_water;       /* planner side                                         */
+    _Atomic uint64_t pushed;
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic uint32_t low_water;        /* cyclic side                                          */
+    _Atomic uint64_t consumed;
+    _Atomic uint64_t underruns;        /* ticks without a sample                               */
+    _Atomic uint64_t flushed;          /* stale samples dropped on enable                      */
+    int     policy;
+    double  dec_step;                  /* DECEL: |Δdelta| per tick (counts/tick²)              */
+    double  coast;                     /* DECEL: current per-tick delta while coasting         */
+    int32_t last_delta;                /* per-tick delta of the last streamed sample           */
+} Servo_Stream;
+
+/* Attach a stream to `ax` (after ServoAxis_Init). `decel` (counts/s²) is used by
+   STREAM_UNDERRUN_DECEL. */
+void ServoStream_Attach(Servo_Axis *ax, Servo_Stream *st, int policy, double decel)
+{
+    memset(st, 0, sizeof *st);
+    st->policy   = policy;
+    st->dec_step = decel * (double)LOOP_PERIOD_US * 1e-6 * (double)LOOP_PERIOD_US * 1e-6;
+    atomic_store(&st->low_water, SETPOINT_RING);
+    ax->stream = st;
+}
+
+/* Planner side: queue up to `n` set-points; returns how many were accepted. Wait-free. */
+size_t ServoStream_Push(Servo_Stream *st, const Servo_Setpoint *sp, size_t n)
+{
+    Servo_SetpointRing *r = &st->ring;
+    const uint32_t h    = atomic_load_explicit(&r->head, memory_order_relaxed);
+    const uint32_t room = SETPOINT_RING - (h - atomic_load_explicit(&r->tail, memory_order_acquire));
+    if (n > room) n = room;
+    for (size_t i = 0; i < n; i++) r->sp[(h + (uint32_t)i) & (SETPOINT_RING - 1)] = sp[i];
+    atomic_store_explicit(&r->head, h + (uint32_t)n, memory_order_release);
+
+    const uint32_t level = SETPOINT_RING - room + (uint32_t)n;
+    if (level > atomic_load_explicit(&st->high_water, memory_order_relaxed))
+        atomic_store_explicit(&st->high_water, level, memory_order_relaxed);
+    CSP_RELAXED_ADD(st->pushed, n);
+    return n;
+}
+
+/* Planner side: room left in the queue. */
+size_t ServoStream_Space(const Servo_Stream *st){ return SETPOINT_RING - servo_ring_level(&st->ring); }
+
+/* Cyclic side: flush stale samples (on enable). */
+static void servo_stream_reset(Servo_Stream *st)
+{
+    const uint32_t h = atomic_load_explicit(&st->ring.head, memory_order_acquire);
+    const uint32_t t = atomic_load_explicit(&st->ring.tail, memory_order_relaxed);
+    CSP_RELAXED_ADD(st->flushed, h - t);
+    atomic_store_explicit(&st->ring.tail, h, memory_order_release);
+    st->last_delta = 0; st->coast = 0.0;
+}
+
+static int64_t servo_stream_take(Servo_Axis *ax, int64_t want, int32_t max_delta)
+{
+    Servo_Stream *st = ax->stream;
+    const int64_t used = servo_ring_take(ax, &st->ring, want, max_delta);
+    if (used){
+        st->last_delta = ax->pos_tgt - ax->pos_prev;
+        st->coast = (double)st->last_delta;
+        CSP_RELAXED_ADD(st->consumed, used);
+        const uint32_t level = servo_ring_level(&st->ring);
+        if (level < atomic_load_explicit(&st->low_water, memory_order_relaxed))
+            atomic_store_explicit(&st->low_water, level, memory_order_relaxed);
+        return used;
+    }
+
+    /* Underrun */
+    CSP_RELAXED_ADD(st->underruns, 1);
+    atomic_store_explicit(&st->low_water, 0, memory_order_relaxed);
+    ax->sp.vel = 0; ax->sp.acc = 0;
+    if (st->policy == STREAM_UNDERRUN_DECEL && st->coast != 0.0){
+        const double c = fabs(st->coast) > st->dec_step ? fabs(st->coast) - st->dec_step : 0.0;
+        st->coast = st->coast > 0.0 ? c : -c;
+        ax->pos_tgt += (int32_t)lrint(st->coast);
+    }
+    return 1;
+}
+
+/* ---- 5d) Coordinated interpolation (linear / circular / gantry) ----
+
+   Axes of one group follow ONE path on ONE timebase: a single S-curve profile drives the
+   path parameter s (counts along the path, 0 → L) and every member's set-point is a
+   function of s, so all axes start, accelerate and arrive together. The group is evaluated
+   once per tick, by whichever member's producer runs first, for all lanes in one pass (a
+   dense double loop the compiler vectorizes); each member then just copies its lane into
+   pos_tgt, and the clamp/FE kernel + publish write target_position as for any source.
+     linear  every path lane moves p0 + u·(p1 - p0), u = s/L,
+     arc     lanes 0/1 (the XY plane) follow a circle about (cx, cy); other path lanes move
+             linearly with u (helix). End radius ≠ start radius blends linearly (spiral),
+     gantry  a follower lane copies its leader lane plus the offset found at move start.
+   Start moves from the cyclic thread between ticks (after RunBatch), with every member at
+   OperationEnabled. If a member drops out of OperationEnabled mid-move the move aborts and
+   the others hold their last set-point. Idle members hold their target.
+   Setup: `Servo_Axis *xyz[3] = {&ax[0], &ax[1], &ax[2]}; ServoInterp_Init(&g, xyz, 3);` */
+#define INTERP_MAX_AXES        8      /* lanes per group                                        */
+
+enum { INTERP_IDLE = 0, INTERP_LINEAR = 1, INTERP_ARC = 2 };
+
+typedef struct Servo_Interp {
+    Servo_Axis *ax[INTERP_MAX_AXES];
+    int      n;
+    int      leader[INTERP_MAX_AXES];  /* gantry leader lane, -1 = path lane                   */
+    int32_t  gantry_off[INTERP_MAX_AXES];
+    int      kind;                     /* INTERP_* of the active move                          */
+    Servo_Profile pf;                  /* path parameter s(t), 0 → len                         */
+    double   len;                      /* path length (counts)                                 */
+    double   p0[INTERP_MAX_AXES];      /* start point                                          */
+    double   dp[INTERP_MAX_AXES];      /* end - start (arc: 0 on lanes 0/1)                    */
+    double   cx, cy, r0, dr, th0, dth; /* arc: center, radius start/change, angle start/sweep  */
+    Servo_Setpoint sp[INTERP_MAX_AXES];/* this tick's set-points                              */
+    int64_t  stamp;                    /* `now` of the tick that evaluated sp[]                */
+    int64_t  adv;                      /* samples advanced at that tick                        */
+    int      live;                     /* sp[] moved this tick (else members hold)             */
+    uint64_t moves, aborts;
+} Servo_Interp;
+
+/* Bind `n` axes (lanes 0..n-1, in this order) to the group. Call after ServoAxis_Init. */
+int ServoInterp_Init(Servo_Interp *g, Servo_Axis *const axes[], int n)
+{
+    if (n <= 0 || n > INTERP_MAX_AXES) return -1;
+    memset(g, 0, sizeof *g);
+    g->n = n;
+    for (int i = 0; i < n; i++){
+        g->ax[i] = axes[i];
+        g->leader[i] = -1;
+        axes[i]->interp = g;
+        axes[i]->interp_lane = i;
+    }
+    servo_profile_init(&g->pf, 0.0, 0.0, 0.0);
+    g->stamp = INT64_MIN;
+    return 0;
+}
+
+/* Make lane `follower` copy lane `leader` (plus their offset at move start). */
+int ServoInterp_Gantry(Servo_Interp *g, int follower, int leader)
+{
+    if (follower < 0 || follower >= g->n || leader < 0 || leader >= g->n ||
+        follower == leader || g->leader[leader] >= 0 || g->kind != INTERP_IDLE) return -1;
+    g->leader[follower] = leader;
+    return 0;
+}
+
+int ServoInterp_Busy(const Servo_Interp *g){ return g->kind != INTERP_IDLE; }
+
+/* A member may move when it runs its producer: sequenced and the drive reports
+   OperationEnabled (a fault shows up in SW before the sequencer reacts). */
+static int servo_interp_member_ok(const Servo_Axis *ax)
+{
+    return ax->st == CSP_ST_RUN && ax->in && (PDO_GET16(ax, status_word) & 0x006F) == 0x0027;
+}
+
+/* Common move setup: all members enabled, nothing active. Fills p0/dp from `target`. */
+static int servo_interp_begin(Servo_Interp *g, const int32_t target[],
+                              double feed, double amax, double jmax)
+{
+    if (g->kind != INTERP_IDLE) return -1;
+    for (int i = 0; i < g->n; i++) if (!servo_interp_member_ok(g->ax[i])) return -1;
+    servo_profile_init(&g->pf, feed, amax, jmax);
+    for (int i = 0; i < g->n; i++){
+        g->p0[i] = (double)g->ax[i]->pos_tgt;
+        g->dp[i] = g->leader[i] < 0 ? (double)target[i] - g->p0[i] : 0.0;
+        if (g->leader[i] >= 0)
+            g->gantry_off[i] = g->ax[i]->pos_tgt - g->ax[g->leader[i]]->pos_tgt;
+    }
+    return 0;
+}
+
+static void servo_interp_start(Servo_Interp *g, int kind, double len)
+{
+    g->len = len;
+    servo_profile_plan(&g->pf, 0.0, len);
+    if (g->pf.n == 0) return;          /* zero-length move: nothing to do */
+    g->kind = kind;
+    g->moves++;
+}
+
+/* Straight line to `target[lane]` (follower lanes ignored) at path speed ≤ feed (counts/s),
+   path acceleration ≤ amax, jerk ≤ jmax; ≤ 0 takes the TRAJ_* default. 0 ok, -1 busy or a
+   member not enabled. */
+int ServoInterp_Linear(Servo_Interp *g, const int32_t target[], double feed, double amax, double jmax)
+{
+    if (servo_interp_begin(g, target, feed, amax, jmax) != 0) return -1;
+    double l2 = 0.0;
+    for (int i = 0; i < g->n; i++) l2 += g->dp[i] * g->dp[i];
+    servo_interp_start(g, INTERP_LINEAR, sqrt(l2));
+    return 0;
+}
+
+/* Arc in lanes 0/1 about (cx, cy) to target[0..1], counter-clockwise when `ccw`; end = start
+   sweeps a full circle. Remaining path lanes move linearly to their targets (helix). */
+int ServoInterp_Arc(Servo_Interp *g, const int32_t target[], int32_t cx, int32_t cy, int ccw,
+                    double feed, double amax, double jmax)
+{
+    if (g->n < 2 || g->leader[0] >= 0 || g->leader[1] >= 0) return -1;
+    if (servo_interp_begin(g, target, feed, amax, jmax) != 0) return -1;
+    const double x0 = g->p0[0] - cx, y0 = g->p0[1] - cy;
+    const double x1 = (double)target[0] - cx, y1 = (double)target[1] - cy;
+    const double r1 = sqrt(x1*x1 + y1*y1);
+    g->cx = cx; g->cy = cy;
+    g->r0 = sqrt(x0*x0 + y0*y0); g->dr = r1 - g->r0;
+    g->th0 = atan2(y0, x0);
+    double dth = atan2(y1, x1) - g->th0;
+    if (ccw){ while (dth <= 0.0) dth += 2.0*M_PI; }
+    else    { while (dth >= 0.0) dth -= 2.0*M_PI; }
+    g->dth = dth;
+    g->dp[0] = g->dp[1] = 0.0;
+
+    const double arc = fabs(dth) * (g->r0 + 0.5*g->dr);
+    double l2 = arc * arc;
+    for (int i = 2; i < g->n; i++) l2 += g->dp[i] * g->dp[i];
+    servo_interp_start(g, INTERP_ARC, sqrt(l2));
+    return 0;
+}
+
+/* All lanes at sample k of the path. */
+static void servo_interp_eval(Servo_Interp *g, int64_t k)
+{
+    double s[3] = { g->len, 0.0, 0.0 };
+    if (k < g->pf.n) servo_profile_at(&g->pf, k, s);
+    const double inv = 1.0 / g->len;
+    const double u = s[0]*inv, du = s[1]*inv, ddu = s[2]*inv;
+
+    double pos[INTERP_MAX_AXES], vel[INTERP_MAX_AXES], acc[INTERP_MAX_AXES];
+    for (int i = 0; i < INTERP_MAX_AXES; i++){       /* fixed trip count → vectorized */
+        pos[i] = g->p0[i] + u   * g->dp[i];
+        vel[i] =            du  * g->dp[i];
+        acc[i] =            ddu * g->dp[i];
+    }
+    if (g->kind == INTERP_ARC){
+        const double r  = g->r0 + u*g->dr,   th  = g->th0 + u*g->dth;
+        const double r1 = du*g->dr,          th1 = du*g->dth;
+        const double r2 = ddu*g->dr,         th2 = ddu*g->dth;
+        const double c = cos(th), sn = sin(th);
+        pos[0] = g->cx + r*c;
+        pos[1] = g->cy + r*sn;
+        vel[0] = r1*c  - r*sn*th1;
+        vel[1] = r1*sn + r*c*th1;
+        acc[0] = (r2 - r*th1*th1)*c  - (2.0*r1*th1 + r*th2)*sn;
+        acc[1] = (r2 - r*th1*th1)*sn + (2.0*r1*th1 + r*th2)*c;
+    }
+    for (int i = 0; i < g->n; i++){
+        const int l = g->leader[i] < 0 ? i : g->leader[i];
+        g->sp[i].pos = (int32_t)lrint(pos[l]) + (g->leader[i] < 0 ? 0 : g->gantry_off[i]);
+        g->sp[i].vel = (int32_t)lrint(vel[l]);
+        g->sp[i].acc = (int32_t)lrint(acc[l]);
+    }
+}
+
+/* Advance the group by up to `want` samples (once per tick; later members reuse it). The
+   first caller's lateness decides; CATCHUP backs off while any lane would exceed max_delta. */
+static void servo_interp_tick(Servo_Interp *g, int64_t now, int64_t want, int32_t max_delta)
+{
+    g->stamp = now;
+    g->adv   = 1;
+    g->live  = 0;
+    if (g->kind == INTERP_IDLE) return;
+
+    for (int i = 0; i < g->n; i++){
+        if (!servo_interp_member_ok(g->ax[i])){
+            WARNF("interp: slave %d not OperationEnabled, move aborted", g->ax[i]->slave_index);
+            g->kind = INTERP_IDLE; g->aborts++;
+            for (int j = 0; j < g->n; j++){ g->sp[j].vel = 0; g->sp[j].acc = 0; }
+            return;
+        }
+    }
+    for (int64_t adv = want; ; adv--){
+        servo_interp_eval(g, g->pf.k + adv);
+        if (adv == 1) break;
+        int ok = 1;
+        for (int i = 0; i < g->n; i++){
+            const int64_t d = (int64_t)g->sp[i].pos - g->ax[i]->pos_tgt;
+            if (d > max_delta || d < -max_delta){ ok = 0; break; }
+        }
+        if (ok){ g->adv = adv; break; }
+    }
+    g->live  = 1;
+    g->pf.k += g->adv;
+    if (g->pf.k >= g->pf.n) g->kind = INTERP_IDLE;    /* landed: sp[] holds the end point */
+}
+
+static int64_t servo_interp_take(Servo_Axis *ax, int64_t now, int64_t want, int32_t max_delta)
+{
+    Servo_Interp *g = ax->interp;
+    if (g->stamp != now) servo_interp_tick(g, now, want, max_delta);
+    if (g->live){
+        ax->sp = g->sp[ax->interp_lane];
+        ax->pos_tgt = ax->sp.pos;
+    }
+    return g->adv;
+}
+
+/* ---- 5e) Following-error statistics per window ----
+
+   WHY: the FE latch only says "above FE_WARN_PCT"; tuning a feed rate needs to know how
+   well the drive tracks between alarms. Every producing tick (pass c) adds the FE to a
+   window accumulator: min/max, sum (mean = bias), sum of squares (RMS) and a log-linear
+   histogram of |FE| for quantiles — a handful of integer ops, no allocation. When the
+   window is full the result is stored in ax->fe_stats (and published by the telemetry
+   segment, 4e); only then are the CSP_FE_SKETCH_BUCKETS buckets scanned and cleared.
+   The window restarts when the axis (re-)enables, so it never spans a disable.
+   Read ax->fe_stats from the cyclic thread; other threads/processes use telemetry. */
+#if CSP_FE_STATS
+static inline unsigned servo_fe_bucket(uint32_t v)
+{
+    if (v < 32) return v;
+    const unsigned e = 31u - (unsigned)__builtin_clz(v);         /* 5..31 */
+    return 32u + (e - 5u) * 8u + ((v >> (e - 3u)) & 7u);
+}
+
+/* Midpoint of a bucket (its quantile estimate). */
+static int32_t servo_fe_bucket_mid(unsigned b)
+{
+    if (b < 32) return (int32_t)b;
+    const unsigned e = 5u + (b - 32u) / 8u, sub = (b - 32u) % 8u;
+    const uint64_t lo = ((uint64_t)(8u + sub)) << (e - 3u), w = (uint64_t)1 << (e - 3u);
+    const uint64_t mid = lo + w / 2;
+    return mid > INT32_MAX ? INT32_MAX : (int32_t)mid;
+}
+
+static void servo_fe_window_reset(Servo_FeAccum *a)
+{
+    const uint32_t w = a->window;
+    memset(a, 0, sizeof *a);
+    a->window = w;
+}
+
+/* Window length in ms (rounded up to ticks, clamped to 1..65535 ticks). */
+void ServoAxis_SetFeWindow(Servo_Axis *ax, unsigned ms)
+{
+    int t = CSP_MS_TO_TICKS(ms);
+    if (t < 1) t = 1;
+    if (t > 65535) t = 65535;
+    ax->fe_acc.window = (uint32_t)t;
+    servo_fe_window_reset(&ax->fe_acc);
+}
+
+static void servo_fe_window_close(Servo_Axis *ax)
+{
+    Servo_FeAccum *a = &ax->fe_acc;
+    Servo_FeStats *o = &ax->fe_stats;
+    o->n    = a->n;
+    o->min  = a->min; o->max = a->max;
+    o->mean = (int32_t)(a->sum / (int64_t)a->n);
+    o->rms  = (int32_t)sqrt(a->sumsq / (double)a->n);
+    const uint32_t want[4] = { (a->n * 500u + 999u) / 1000u, (a->n * 900u + 999u) / 1000u,
+                               (a->n * 990u + 999u) / 1000u, (a->n * 999u + 999u) / 1000u };
+    int32_t *dst[4] = { &o->p50, &o->p90, &o->p99, &o->p999 };
+    uint32_t cum = 0; int q = 0;
+    for (unsigned b = 0; b < CSP_FE_SKETCH_BUCKETS && q < 4; b++){
+        cum += a->hist[b];
+        while (q < 4 && cum >= want[q]) *dst[q++] = servo_fe_bucket_mid(b);
+    }
+    o->windows++;
+    servo_fe_window_reset(a);
+}
+
+static inline void servo_fe_stats_add(Servo_Axis *ax, int32_t fe)
+{
+    Servo_FeAccum *a = &ax->fe_acc;
+    if (a->n == 0 || fe < a->min) a->min = fe;
+    if (a->n == 0 || fe > a->max) a->max = fe;
+    a->sum   += fe;
+    a->sumsq += (double)fe * (double)fe;
+    a->hist[servo_fe_bucket(fe < 0 ? 0u - (uint32_t)fe : (uint32_t)fe)]++;
+    if (++a->n >= a->window) servo_fe_window_close(ax);
+}
+# define servo_fe_stats_restart(ax) servo_fe_window_reset(&(ax)->fe_acc)
+#else
+# define servo_fe_stats_add(ax, fe)    ((void)0)
+# define servo_fe_stats_restart(ax)    ((void)0)
+#endif
+
+/* ---- 5f) Bus dead-time compensation ----
+
+   WHY: 0x6064/0x60F4 arrive one or more cycles after the drive sampled them, and the
+   target it compared against was sent earlier still. At 125–250 µs the lag is several
+   counts × ticks: FE warnings fire on moves the drive tracks well, and the enable
+   alignment (state 2) copies a position that is already stale.
+   HOW: every tick the target actually sent is pushed into a small per-axis ring. With a
+   delay of d ticks (ServoAxis_SetDeadTime; measure it: SYNC0 shift + frame + drive
+   sampling, typically 1–3 at 250 µs) the limit/FE kernel computes the FE itself as
+   target_sent[d ticks ago] − actual, instead of trusting 60F4. With `predict` the
+   alignment uses actual + v̂·d (v̂ from the last two actuals), so a coasting axis
+   enables without a jump. d = 0 keeps the drive's 60F4 as is. */
+#if CSP_DEADTIME_RING
+/* Delay `ticks` (< CSP_DEADTIME_RING) and prediction on/off. Call between ticks. */
+void ServoAxis_SetDeadTime(Servo_Axis *ax, unsigned ticks, int predict)
+{
+    ax->dt_ticks   = (uint8_t)(ticks < CSP_DEADTIME_RING ? ticks : CSP_DEADTIME_RING - 1);
+    ax->dt_predict = (uint8_t)(predict != 0);
+}
+
+static inline void servo_dt_push(Servo_Axis *ax, int32_t target)
+{
+    ax->cmd_hist[ax->cmd_n++ & (CSP_DEADTIME_RING - 1)] = target;
+}
+
+/* Target sent dt_ticks ticks ago (the oldest one we have while the ring fills). */
+static inline int32_t servo_dt_target(const Servo_Axis *ax)
+{
+    const uint32_t back = ax->dt_ticks < ax->cmd_n ? ax->dt_ticks : ax->cmd_n;
+    return back ? ax->cmd_hist[(ax->cmd_n - back) & (CSP_DEADTIME_RING - 1)] : ax->pos_tgt;
+}
+
+/* Feed this tick's actual (every mapped axis, every tick, so v̂ spans exactly one period). */
+static inline void servo_dt_observe(Servo_Axis *ax, int32_t act)
+{
+    const int64_t v = (int64_t)act - ax->act_prev;
+    int64_t p = (int64_t)act + v * ax->dt_ticks;
+    if (p > INT32_MAX) p = INT32_MAX;
+    if (p < INT32_MIN) p = INT32_MIN;
+    ax->act_prev = act;
+    ax->act_pred = (int32_t)p;
+}
+
+/* Enable alignment: the actual, or its extrapolation with `predict`. */
+static inline int32_t servo_dt_align(const Servo_Axis *ax, int32_t act)
+{
+    return ax->dt_predict ? ax->act_pred : act;
+}
+#else
+# define servo_dt_push(ax, t)          ((void)0)
+# define servo_dt_observe(ax, act)     ((void)0)
+# define servo_dt_align(ax, act)       (act)
+#endif
+
+/* ---- 5g) Runtime config (double-buffered) ----
+
+   WHY: INC_STEP, LIMIT_POS, DWELL_MS, RAMP_MS, FE_WINDOW_COUNTS, FE_WARN_PCT and
+   SETPOINT_EDGE_POLICY used to be compiled in: every tuning change was a rebuild and a
+   line stop.
+   HOW: the section-1 macros now only fill the default config, shared by every axis. An
+   axis given a Servo_ConfigBuf (ServoAxis_AttachConfig) reads slot[gen & 1] instead. A
+   non-RT thread edits the other slot (ServoConfig_Edit), ServoConfig_Commit validates it,
+   derives the tick counts, thresholds and ramp table *on that thread*, then publishes
+   gen + 1. The cyclic thread notices at the start of the axis' next tick (one acquire
+   load), swaps its pointer and acks; from then on the old slot is free for the next
+   edit. The hot path only ever dereferences ax->cfg, which does not change inside a tick.
+   One writer per buffer. FE_WINDOW_COUNTS is also the drive's 6065 window (set at
+   init); when widening the master-side window at runtime, write 6065 with
+   ServoSdo_ReqWrite (6b) as well.
+   A lower LIMIT_POS must not cut the axis off where it stands (the clamp would step the
+   target to the new limit in one tick): Commit refuses a limit below the target or the
+   actual position the axis reported at its last tick (`reach`), and should the axis move
+   past it before the switch, the cyclic side holds the old slot until it is back inside.
+   S-curve moves already queued towards the old limit (5b) still end at the new one. */
+static int servo_cfg_derive(Servo_AxisConfig *c)
+{
+    if (c->inc_step <= 0 || c->limit_pos <= 0 || c->dwell_ms < 0 || c->ramp_ms < 0 ||
+        c->ramp_ms > CSP_CFG_RAMP_MS_MAX || c->fe_window <= 0 ||
+        c->fe_warn_pct < 1 || c->fe_warn_pct > 100 || (c->edge_policy & ~1) ||
+        c->fault_cool_ms < 0 || c->comm_cool_ms < 0 || (c->fast_reenable & ~1) ||
+        c->retry_max < 0 || c->retry_max > 250 || c->retry_window_ms < 0 ||
+        c->backoff_max_ms < 0 || c->step_timeout_ms < 0)
+        return -1;
+    c->fault_cool_ns   = (int64_t)c->fault_cool_ms   * 1000000;
+    c->comm_cool_ns    = (int64_t)c->comm_cool_ms    * 1000000;
+    c->retry_window_ns = (int64_t)c->retry_window_ms * 1000000;
+    c->backoff_max_ns  = (int64_t)c->backoff_max_ms  * 1000000;
+    c->step_timeout_ns = (int64_t)c->step_timeout_ms * 1000000;
+    c->dwell_ticks = CSP_MS_TO_TICKS(c->dwell_ms);
+    c->ramp_ticks  = CSP_MS_TO_TICKS(c->ramp_ms);
+    c->fe_warn_th  = (int32_t)(((int64_t)c->fe_window * c->fe_warn_pct) / 100);
+    c->fe_ok_th    = c->fe_warn_th / 2;   /* hysteresis for any fe_warn_pct (80 % → 40 %) */
+    servo_ramp_build(c->ramp_lut, c->ramp_ticks, c->inc_step, RAMP_SHAPE);
+    return 0;
+}
+
+/* Tunables from the section-1 macros (derived fields untouched). */
+void ServoConfig_Defaults(Servo_AxisConfig *c)
+{
+    c->inc_step    = INC_STEP;
+    c->limit_pos   = LIMIT_POS;
+    c->dwell_ms    = DWELL_MS;
+    c->ramp_ms     = RAMP_MS;
+    c->fe_window   = FE_WINDOW_COUNTS;
+    c->fe_warn_pct = FE_WARN_PCT;
+    c->edge_policy = SETPOINT_EDGE_POLICY;
+    c->fault_cool_ms   = FAULT_COOLDOWN_MS;
+    c->comm_cool_ms    = COMM_COOLDOWN_MS;
+    c->fast_reenable   = CSP_402_FAST_REENABLE;
+    c->retry_max       = CSP_402_RETRY_MAX;
+    c->retry_window_ms = CSP_402_RETRY_WINDOW_MS;
+    c->backoff_max_ms  = CSP_402_BACKOFF_MAX_MS;
+    c->step_timeout_ms = CSP_402_STEP_TIMEOUT_MS;
+}
+
+/* Shared default config, built on the first ServoAxis_Init() (C has no constexpr tables). */
+static const Servo_AxisConfig *servo_cfg_default(void)
+{
+    static Servo_AxisConfig def;
+    static int ready;
+    if (!ready){
+        ServoConfig_Defaults(&def);
+        if (servo_cfg_derive(&def) != 0) ERRF("section-1 knobs out of range (RAMP_MS %d)", RAMP_MS);
+        ready = 1;
+    }
+    return &def;
+}
+
+/* Give `ax` a runtime config, starting from its current one. Call between ticks. */
+void ServoAxis_AttachConfig(Servo_Axis *ax, Servo_ConfigBuf *cb)
+{
+    memcpy(&cb->slot[0], ax->cfg, sizeof cb->slot[0]);
+    atomic_store_explicit(&cb->gen, 0, memory_order_relaxed);
+    atomic_store_explicit(&cb->ack, 0, memory_order_relaxed);
+    ax->cfg     = &cb->slot[0];
+    ax->cfg_gen = 0;
+    ax->cfg_buf = cb;
+}
+
+/* Writer: the inactive slot, pre-filled with the live tunables, or NULL while the previous
+   commit has not been picked up yet (retry after a tick). */
+Servo_AxisConfig *ServoConfig_Edit(Servo_ConfigBuf *cb)
+{
+    const uint32_t g = atomic_load_explicit(&cb->gen, memory_order_relaxed);
+    if (atomic_load_explicit(&cb->ack, memory_order_acquire) != g) return NULL;
+    Servo_AxisConfig *c = &cb->slot[(g + 1) & 1];
+    memcpy(c, &cb->slot[g & 1], offsetof(Servo_AxisConfig, dwell_ticks));
+    return c;
+}
+
+/* Writer: validate + derive the edited slot and publish it. -1 = out of range, or a limit
+   inside the axis' current target/actual position (nothing published, the slot can be
+   edited again). */
+int ServoConfig_Commit(Servo_ConfigBuf *cb)
+{
+    const uint32_t g = atomic_load_explicit(&cb->gen, memory_order_relaxed);
+    if (atomic_load_explicit(&cb->ack, memory_order_acquire) != g) return -1;
+    const Servo_AxisConfig *c = &cb->slot[(g + 1) & 1];
+    if (servo_cfg_derive(&cb->slot[(g + 1) & 1]) != 0) return -1;
+    if (c->limit_pos < atomic_load_explicit(&cb->reach, memory_order_relaxed)) return -1;
+    atomic_store_explicit(&cb->gen, g + 1, memory_order_release);
+    return 0;
+}
+
+/* 1 once the cyclic thread runs the last committed slot. */
+int ServoConfig_Applied(const Servo_ConfigBuf *cb)
+{
+    return atomic_load_explicit(&cb->ack, memory_order_acquire) ==
+           atomic_load_explicit(&cb->gen, memory_order_relaxed);
+}
+
+/* Cyclic side, tick boundary: report the reach, switch to a newly published slot (held
+   while the axis is beyond its limit). Running ramps/dwells are cut to the new lengths; an
+   attached S-curve source takes the new dwell and limit. */
+static inline void servo_cfg_poll(Servo_Axis *ax)
+{
+    Servo_ConfigBuf *cb = ax->cfg_buf;
+    if (!cb) return;
+    const int64_t tgt = ax->pos_tgt, act = (int32_t)PDO_GET32(ax, position_actual_value);
+    const int64_t reach = (tgt < 0 ? -tgt : tgt) > (act < 0 ? -act : act) ? (tgt < 0 ? -tgt : tgt)
+                                                                           : (act < 0 ? -act : act);
+    atomic_store_explicit(&cb->reach, (int32_t)(reach > INT32_MAX ? INT32_MAX : reach), memory_order_relaxed);
+    const uint32_t g = atomic_load_explicit(&cb->gen, memory_order_acquire);
+    if (g == ax->cfg_gen) return;
+    const Servo_AxisConfig *c = &cb->slot[g & 1];
+    if (c->limit_pos < reach) return;  /* moved past the new limit since the commit: hold */
+    if (ax->ramp_rem  > c->ramp_ticks)  ax->ramp_rem  = c->ramp_ticks;
+    if (ax->dwell_rem > c->dwell_ticks) ax->dwell_rem = c->dwell_ticks;
+    if (ax->traj){
+        atomic_store_explicit(&ax->traj->dwell_ticks, c->dwell_ticks, memory_order_relaxed);
+        atomic_store_explicit(&ax->traj->limit, c->limit_pos, memory_order_relaxed);
+    }
+    ax->cfg     = c;
+    ax->cfg_gen = g;
+    atomic_store_explicit(&cb->ack, g, memory_order_release);
+    DBGF("slave %d: config generation %u live", ax->slave_index, (unsigned)g);
+}
+
+/* Default axis behind the single-drive API (ServoTemplate_Init/Run). */
+static Servo_Axis g_axis;
+
+/* ===================================
+   6) INITIALIZATION (map + SDOs)
+   ===================================
+
+   WHAT: Map PDOs and (optionally) program SDOs for CSP.
+   WHY: Keep wiring + drive setup explicit and in one place.
+*/
+
+/* ---- 6a) Batched SDO plan ----
+
+   WHY: every CoE write is a mailbox round-trip (often ms). Issued one by one for 40
+   drives, they dominate boot-to-OP. A plan queues all writes for all slaves, keeps up to
+   `per_slave` transfers in flight on each slave and `total` on the bus, and records a
+   status per write. Writes to one slave start in the order they were added.
+   Read-verify (optional): read the object first and skip the write when it already holds
+   the value. A small cache remembers values written/read in this process, so running the
+   same plan again (ServoAxis_Init after a cell-wide plan, re-init after a comm drop)
+   costs no bus traffic; call ServoSdo_CacheClear() when a drive may have lost its
+   configuration (power cycle).
+   Masters without async CoE: sdo_async_start() returns -1 and the plan falls back to the
+   blocking calls — sdo_read() for the verify (same skip and cache), then sdo_write_u8/
+   u16/u32 when the value differs — still one status per write, but no overlap.
+
+     static Servo_SdoOp ops[64]; Servo_SdoPlan plan;
+     ServoSdo_PlanInit(&plan, ops, 64, 2, 16, 1);
+     for (int s = 0; s < n; s++) ServoSdo_AddCspConfig(&plan, s);
+     if (ServoSdo_Run(&plan, dev) != 0) ... inspect ops[i].status / abort_code */
+enum { SDO_QUEUED, SDO_READING, SDO_WRITING, SDO_OK, SDO_SKIPPED, SDO_FAILED };
+
+#define CSP_SDO_CACHE_SIZE     256    /* remembered (slave, index, sub) values                   */
+#define CSP_SDO_TIMEOUT_MS     1000   /* per transfer                                            */
+
+typedef struct {
+    int      slave;
+    uint16_t idx;
+    uint8_t  sub;
+    uint8_t  len;                      /* 1, 2 or 4 bytes                                      */
+    uint32_t value;
+    /* results */
+    int      status;                   /* SDO_*                                                */
+    uint32_t abort_code;               /* CoE abort code when FAILED (0 = timeout/local)       */
+    int      handle;
+    int64_t  t_start;
+    uint32_t readback;                 /* value read by read-verify                            */
+} Servo_SdoOp;
+
+typedef struct {
+    Servo_SdoOp *op;
+    size_t   n, cap;
+    int      per_slave, total;         /* in-flight limits                                     */
+    int      verify;                   /* 1 = read-verify before writing                       */
+    size_t   ok, skipped, failed;
+} Servo_SdoPlan;
+
+static struct { int slave; uint16_t idx; uint8_t sub; uint32_t value; } g_sdo_cache[CSP_SDO_CACHE_SIZE];
+static size_t g_sdo_cache_n;
+
+void ServoSdo_CacheClear(void){ g_sdo_cache_n = 0; }
+
+static int servo_sdo_cache_find(const Servo_SdoOp *o)
+{
+    for (size_t i = 0; i < g_sdo_cache_n; i++)
+        if (g_sdo_cache[i].slave == o->slave && g_sdo_cache[i].idx == o->idx && g_sdo_cache[i].sub == o->sub)
+            return (int)i;
+    return -1;
+}
+static void servo_sdo_cache_put(const Servo_SdoOp *o, uint32_t v)
+{
+    int i = servo_sdo_cache_find(o);
+    if (i < 0){
+        if (g_sdo_cache_n == CSP_SDO_CACHE_SIZE) return;
+        i = (int)g_sdo_cache_n++;
+        g_sdo_cache[i].slave = o->slave; g_sdo_cache[i].idx = o->idx; g_sdo_cache[i].sub = o->sub;
+    }
+    g_sdo_cache[i].value = v;
+}
+
+void ServoSdo_PlanInit(Servo_SdoPlan *p, Servo_SdoOp ops[], size_t cap, int per_slave, int total, int verify)
+{
+    memset(p, 0, sizeof *p);
+    p->op = ops; p->cap = cap;
+    p->per_slave = per_slave > 0 ? per_slave : 1;
+    p->total     = total > 0 ? total : 1;
+    p->verify    = verify;
+}
+
+/* Queue one write. Returns 0, or -1 when the plan is full / len is not 1, 2 or 4. */
+int ServoSdo_Add(Servo_SdoPlan *p, int slave, uint16_t idx, uint8_t sub, uint8_t len, uint32_t value)
+{
+    if (p->n == p->cap || (len != 1 && len != 2 && len != 4)) return -1;
+    Servo_SdoOp *o = &p->op[p->n++];
+    memset(o, 0, sizeof *o);
+    o->slave = slave; o->idx = idx; o->sub = sub; o->len = len; o->value = value;
+    o->status = SDO_QUEUED; o->handle = -1;
+    return 0;
+}
+
+/* The CSP configuration of section 1 (Omron block) for one slave. Returns the number of
+   writes queued, or -1 when the plan is full. */
+int ServoSdo_AddCspConfig(Servo_SdoPlan *p, int slave)
+{
+    int n = 0;
+    (void)p; (void)slave;
+#if OMRON_R88D_EXAMPLE
+  #if WRITE_6060_MODE_CSP
+    if (ServoSdo_Add(p, slave, 0x6060, 0, 1, 8) != 0) return -1;
+    n++;
+  #endif
+  #if WRITE_60C2_1_US
+    if (ServoSdo_Add(p, slave, 0x60C2, 1, 4, (uint32_t)LOOP_PERIOD_US) != 0) return -1;
+    n++;
+  #endif
+  #if WRITE_6065_FE_WIN
+    if (ServoSdo_Add(p, slave, 0x6065, 0, 4, (uint32_t)FE_WINDOW_COUNTS) != 0) return -1;
+    n++;
+  #endif
+  #if WRITE_10F1_1_WDT
+    if (ServoSdo_Add(p, slave, 0x10F1, 1, 4, 150) != 0) return -1;
+    n++;
+  #endif
+#endif
+    return n;
+}
+
+const char *ServoSdo_StatusName(int st)
+{
+    static const char *const name[] = { "queued", "reading", "writing", "ok", "skipped", "failed" };
+    return (st >= 0 && st <= SDO_FAILED) ? name[st] : "?";
+}
+
+static void servo_sdo_finish(Servo_SdoPlan *p, Servo_SdoOp *o, int status)
+{
+    o->status = status;
+    if (status == SDO_OK){ p->ok++; servo_sdo_cache_put(o, o->value); }
+    else if (status == SDO_SKIPPED) p->skipped++;
+    else {
+        p->failed++;
+        WARNF("SDO slave %d %04X:%u failed (abort 0x%08X)", o->slave, (unsigned)o->idx, (unsigned)o->sub, (unsigned)o->abort_code);
+    }
+}
+
+/* Blocking fallback for masters without async CoE. */
+static void servo_sdo_blocking(Servo_SdoPlan *p, EcDevice dev, Servo_SdoOp *o)
+{
+    int rc;
+    if (o->len == 1)      rc = sdo_write_u8 (dev, o->slave, o->idx, o->sub, (uint8_t)o->value);
+    else if (o->len == 2) rc = sdo_write_u16(dev, o->slave, o->idx, o->sub, (uint16_t)o->value);
+    else                  rc = sdo_write_u32(dev, o->slave, o->idx, o->sub, o->value);
+    servo_sdo_finish(p, o, rc == 0 ? SDO_OK : SDO_FAILED);
+}
+
+static void servo_sdo_start(Servo_SdoPlan *p, EcDevice dev, Servo_SdoOp *o, int write);
+
+/* Read-verify result in `buf` (async or blocking read): cache it, then skip or write. */
+static void servo_sdo_verified(Servo_SdoPlan *p, EcDevice dev, Servo_SdoOp *o, const uint8_t buf[4])
+{
+    o->readback = le_get_u32(buf) & servo_sdo_mask(o->len);
+    servo_sdo_cache_put(o, o->readback);
+    if (o->readback == o->value) servo_sdo_finish(p, o, SDO_SKIPPED);
+    else servo_sdo_start(p, dev, o, 1);
+}
+
+/* Start the next step of `o` (read for verify, or write). */
+static void servo_sdo_start(Servo_SdoPlan *p, EcDevice dev, Servo_SdoOp *o, int write)
+{
+    uint8_t buf[4] = { 0 };
+    if (write) le_set_u32(buf, o->value);            /* CoE data is little-endian   */
+    o->handle = sdo_async_start(dev, o->slave, o->idx, o->sub, write, buf, o->len);
+    if (o->handle < 0){
+        o->status = SDO_QUEUED;
+        if (write) servo_sdo_blocking(p, dev, o);
+        else if (sdo_read(dev, o->slave, o->idx, o->sub, buf, o->len) == 0) servo_sdo_verified(p, dev, o, buf);
+        else servo_sdo_start(p, dev, o, 1);                      /* cannot verify: write */
+        return;
+    }
+    o->status  = write ? SDO_WRITING : SDO_READING;
+    o->t_start = now_ns();
+}
+
+/* Run the whole plan to completion (non-RT, before OP). Returns 0 when every write is
+   OK or SKIPPED, -1 otherwise; per-write results are in p->op[i]. */
+int ServoSdo_Run(Servo_SdoPlan *p, EcDevice dev)
+{
+    p->ok = p->skipped = p->failed = 0;
+    for (size_t i = 0; i < p->n; i++){
+        Servo_SdoOp *o = &p->op[i];
+        o->status = SDO_QUEUED; o->handle = -1; o->abort_code = 0;
+        const int c = servo_sdo_cache_find(o);
+        if (c >= 0 && g_sdo_cache[c].value == o->value) servo_sdo_finish(p, o, SDO_SKIPPED);
+    }
+
+    size_t done = p->ok + p->skipped + p->failed;
+    while (done < p->n){
+        int in_flight = 0;
+        /* 1) poll what is on the wire */
+        for (size_t i = 0; i < p->n; i++){
+            Servo_SdoOp *o = &p->op[i];
+            if (o->status != SDO_READING && o->status != SDO_WRITING) continue;
+            uint8_t buf[4] = { 0 };
+            const int rc = sdo_async_poll(dev, o->handle, buf, &o->abort_code);
+            if (rc > 0){
+                if (now_ns() - o->t_start < (int64_t)CSP_SDO_TIMEOUT_MS * 1000000){ in_flight++; continue; }
+                o->abort_code = 0;
+                servo_sdo_finish(p, o, SDO_FAILED);             /* timeout */
+            } else if (rc < 0){
+                servo_sdo_finish(p, o, SDO_FAILED);
+            } else if (o->status == SDO_WRITING){
+                servo_sdo_finish(p, o, SDO_OK);
+            } else {                                           /* read-verify result */
+                servo_sdo_verified(p, dev, o, buf);
+                if (o->status == SDO_WRITING) in_flight++;
+            }
+        }
+        /* 2) start queued transfers within the limits, in per-slave order */
+        for (size_t i = 0; i < p->n && in_flight < p->total; i++){
+            Servo_SdoOp *o = &p->op[i];
+            if (o->status != SDO_QUEUED) continue;
+            int busy = 0, blocked = 0;
+            for (size_t j = 0; j < p->n; j++){
+                const Servo_SdoOp *q = &p->op[j];
+                if (q->slave != o->slave) continue;
+                if (q->status == SDO_READING || q->status == SDO_WRITING) busy++;
+                if (j < i && q->status == SDO_QUEUED) blocked = 1;   /* earlier write not started */
+            }
+            if (blocked || busy >= p->per_slave) continue;
+            servo_sdo_start(p, dev, o, !p->verify);
+            if (o->status == SDO_READING || o->status == SDO_WRITING) in_flight++;
+        }
+        done = p->ok + p->skipped + p->failed;
+        if (done < p->n && in_flight){
+            const struct timespec ts = { 0, 100000 };          /* 100 µs between sweeps */
+            nanosleep(&ts, NULL);
+        }
+    }
+    if (p->failed) ERRF("SDO plan: %zu ok, %zu skipped, %zu failed", p->ok, p->skipped, p->failed);
+    else           DBGF("SDO plan: %zu ok, %zu skipped", p->ok, p->skipped);
+    return p->failed ? -1 : 0;
+}
+
+/* ---- 6b) Runtime CoE requests (off the cyclic path) ----
+
+   WHY: reading 603F error details, temperatures or changing a tuning parameter in OP
+   costs a mailbox round-trip (ms); called from the tick it would blow the cycle.
+   HOW: any thread (the cyclic one included) submits a request into a fixed slot table:
+   claiming a slot is one CAS, publishing it one release store — no lock, no syscall. A
+   non-RT service (ServoSdo_Service() from your background loop, or the thread started
+   by ServoSdo_StartService() in section 9) executes requests in submission order with
+   up to `per_slave` in flight per slave, through sdo_async_start/poll (or the blocking
+   calls — it is off the RT path). Completion is one acquire load: poll it from the tick
+   with ServoSdo_ReqState(), then fetch the value with ServoSdo_ReqResult() (frees the
+   slot). An optional callback runs in the service thread on completion; a request with
+   a callback frees its slot by itself. */
+enum { SDO_REQ_FREE, SDO_REQ_CLAIMED, SDO_REQ_QUEUED, SDO_REQ_ACTIVE, SDO_REQ_DONE, SDO_REQ_FAILED };
+
+#define CSP_SDO_REQ_SLOTS      32     /* requests pending at once per queue                      */
+
+/* Runs in the service thread. ok = 1 on success; value = read result (reads). */
+typedef void (*Servo_SdoCallback)(void *user, int slave, uint16_t idx, uint8_t sub,
+                                  int ok, uint32_t value, uint32_t abort_code);
+
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic int       state;           /* SDO_REQ_*                                            */
+    uint32_t          seq;             /* submission order                                     */
+    int               slave;
+    uint16_t          idx;
+    uint8_t           sub, len, write;
+    uint32_t          value;           /* write: data; read: result                            */
+    uint32_t          abort_code;
+    Servo_SdoCallback cb;
+    void             *user;
+    int               handle;          /* service side                                         */
+    int64_t           t_start;
+} Servo_SdoReq;
+
+typedef struct {
+    Servo_SdoReq      req[CSP_SDO_REQ_SLOTS];
+    _Atomic uint32_t  seq;
+    int               per_slave;       /* in-flight limit per slave (≥ 1)                      */
+    _Atomic uint64_t  submitted, completed, failed, rejected;  /* rejected = table full        */
+} Servo_SdoQueue;
+
+void ServoSdo_QueueInit(Servo_SdoQueue *q, int per_slave)
+{
+    memset(q, 0, sizeof *q);
+    q->per_slave = per_slave > 0 ? per_slave : 1;
+}
+
+/* Any thread, wait-free for the caller. Returns a handle ≥ 0, or -1 when every slot is
+   busy (counted in `rejected`; retry next tick). */
+static int servo_sdo_submit(Servo_SdoQueue *q, int slave, uint16_t idx, uint8_t sub, uint8_t len,
+                            int write, uint32_t value, Servo_SdoCallback cb, void *user)
+{
+    if (len != 1 && len != 2 && len != 4) return -1;
+    for (int i = 0; i < CSP_SDO_REQ_SLOTS; i++){
+        Servo_SdoReq *r = &q->req[i];
+        int expect = SDO_REQ_FREE;
+        if (atomic_load_explicit(&r->state, memory_order_relaxed) != SDO_REQ_FREE ||
+            !atomic_compare_exchange_strong_explicit(&r->state, &expect, SDO_REQ_CLAIMED,
+                                                     memory_order_acquire, memory_order_relaxed))
+            continue;
+        r->seq = atomic_fetch_add_explicit(&q->seq, 1, memory_order_relaxed);
+        r->slave = slave; r->idx = idx; r->sub = sub; r->len = len; r->write = (uint8_t)write;
+        r->value = value; r->abort_code = 0; r->cb = cb; r->user = user; r->handle = -1;
+        atomic_store_explicit(&r->state, SDO_REQ_QUEUED, memory_order_release);
+        atomic_fetch_add_explicit(&q->submitted, 1, memory_order_relaxed);
+        return i;
+    }
+    atomic_fetch_add_explicit(&q->rejected, 1, memory_order_relaxed);
+    return -1;
+}
+
+int ServoSdo_ReqRead(Servo_SdoQueue *q, int slave, uint16_t idx, uint8_t sub, uint8_t len,
+                     Servo_SdoCallback cb, void *user)
+{ return servo_sdo_submit(q, slave, idx, sub, len, 0, 0, cb, user); }
+
+int ServoSdo_ReqWrite(Servo_SdoQueue *q, int slave, uint16_t idx, uint8_t sub, uint8_t len,
+                      uint32_t value, Servo_SdoCallback cb, void *user)
+{ return servo_sdo_submit(q, slave, idx, sub, len, 1, value, cb, user); }
+
+/* Cheap completion check (one acquire load): SDO_REQ_QUEUED/ACTIVE, DONE or FAILED. */
+int ServoSdo_ReqState(const Servo_SdoQueue *q, int h)
+{
+    return atomic_load_explicit(&q->req[h].state, memory_order_acquire);
+}
+
+/* After DONE/FAILED: copy the result out and free the slot. Returns 0 (DONE), -1 (FAILED),
+   or 1 when the request is still pending (nothing freed). */
+int ServoSdo_ReqResult(Servo_SdoQueue *q, int h, uint32_t *value, uint32_t *abort_code)
+{
+    Servo_SdoReq *r = &q->req[h];
+    const int st = atomic_load_explicit(&r->state, memory_order_acquire);
+    if (st != SDO_REQ_DONE && st != SDO_REQ_FAILED) return 1;
+    if (value)      *value = r->value;
+    if (abort_code) *abort_code = r->abort_code;
+    atomic_store_explicit(&r->state, SDO_REQ_FREE, memory_order_release);
+    return st == SDO_REQ_DONE ? 0 : -1;
+}
+
+static void servo_sdo_req_finish(Servo_SdoQueue *q, Servo_SdoReq *r, int ok)
+{
+    atomic_fetch_add_explicit(ok ? &q->completed : &q->failed, 1, memory_order_relaxed);
+    if (!ok) DBGF("SDO req slave %d %04X:%u failed (abort 0x%08X)", r->slave, (unsigned)r->idx, (unsigned)r->sub, (unsigned)r->abort_code);
+    if (r->cb){
+        r->cb(r->user, r->slave, r->idx, r->sub, ok, r->value, r->abort_code);
+        atomic_store_explicit(&r->state, SDO_REQ_FREE, memory_order_release);
+    } else {
+        atomic_store_explicit(&r->state, ok ? SDO_REQ_DONE : SDO_REQ_FAILED, memory_order_release);
+    }
+}
+
+/* Non-RT: one pass over the table — finish what completed, start what may start. Never
+   call it from the cyclic thread. Returns the number of requests still open (each one
+   counted once: in flight, or queued behind its slave's limit). Only published slots
+   (QUEUED and later) are read; a CLAIMED slot is still being filled by its submitter. */
+size_t ServoSdo_Service(Servo_SdoQueue *q, EcDevice dev)
+{
+    size_t open = 0;
+    for (int i = 0; i < CSP_SDO_REQ_SLOTS; i++){
+        Servo_SdoReq *r = &q->req[i];
+        if (atomic_load_explicit(&r->state, memory_order_acquire) != SDO_REQ_ACTIVE) continue;
+        uint8_t buf[4] = { 0 };
+        const int rc = sdo_async_poll(dev, r->handle, buf, &r->abort_code);
+        if (rc > 0 && now_ns() - r->t_start < (int64_t)CSP_SDO_TIMEOUT_MS * 1000000){ open++; continue; }
+        if (rc == 0 && !r->write) r->value = le_get_u32(buf) & servo_sdo_mask(r->len);
+        if (rc > 0) r->abort_code = 0;                 /* timeout */
+        servo_sdo_req_finish(q, r, rc == 0);
+    }
+
+    for (;;){   /* start queued requests, oldest first */
+        Servo_SdoReq *pick = NULL;
+        for (int i = 0; i < CSP_SDO_REQ_SLOTS; i++){
+            Servo_SdoReq *r = &q->req[i];
+            if (atomic_load_explicit(&r->state, memory_order_acquire) != SDO_REQ_QUEUED) continue;
+            int busy = 0;
+            for (int j = 0; j < CSP_SDO_REQ_SLOTS; j++)   /* ACTIVE: set by us, fields stable */
+                if (atomic_load_explicit(&q->req[j].state, memory_order_relaxed) == SDO_REQ_ACTIVE &&
+                    q->req[j].slave == r->slave) busy++;
+            if (busy >= q->per_slave) continue;
+            if (!pick || (int32_t)(r->seq - pick->seq) < 0) pick = r;
+        }
+        if (!pick) break;
+        uint8_t buf[4];
+        le_set_u32(buf, pick->value);
+        pick->handle = sdo_async_start(dev, pick->slave, pick->idx, pick->sub, pick->write, buf, pick->len);
+        if (pick->handle >= 0){
+            pick->t_start = now_ns();
+            atomic_store_explicit(&pick->state, SDO_REQ_ACTIVE, memory_order_release);
+            open++;
+            continue;
+        }
+        /* No async CoE: we are off the RT path, so the blocking calls are fine here. */
+        int rc;
+        if (pick->write){
+            rc = pick->len == 1 ? sdo_write_u8 (dev, pick->slave, pick->idx, pick->sub, (uint8_t)pick->value)
+               : pick->len == 2 ? sdo_write_u16(dev, pick->slave, pick->idx, pick->sub, (uint16_t)pick->value)
+               :                  sdo_write_u32(dev, pick->slave, pick->idx, pick->sub, pick->value);
+        } else {
+            uint8_t rb[4] = { 0 };
+            rc = sdo_read(dev, pick->slave, pick->idx, pick->sub, rb, pick->len);
+            pick->value = le_get_u32(rb) & servo_sdo_mask(pick->len);
+        }
+        servo_sdo_req_finish(q, pick, rc == 0);
+    }
+
+    for (int i = 0; i < CSP_SDO_REQ_SLOTS; i++)   /* held back by the per-slave limit */
+        if (atomic_load_explicit(&q->req[i].state, memory_order_relaxed) == SDO_REQ_QUEUED) open++;
+    return open;
+}
+
+/* ---- 6c) Group state transitions (INIT → PREOP → SAFEOP → OP) ----
+
+   WHY: request-then-poll per slave makes cold start grow with the slave count, and most
+   of it is each slave waiting on the previous one. Here every slave of a group is asked
+   for the next state at once, the AL status of the whole group is read in one sweep
+   (state_get_group()), and each step ends when the last slave arrives or the timeout
+   expires. Slaves already at or above a step skip it; slaves above the target go straight
+   down to it (OP → PREOP is a legal transition). A slave raising the AL error bit gets one
+   error acknowledge and one more try per transition, and the rest of the step timeout to
+   clear the bit (the ack is handled by the slave's mailbox/firmware, not at once); a slave
+   whose error is still set at the timeout, comes back after being cleared, or does not
+   arrive in time is a straggler: logged with its AL status and code, left out of the
+   later steps, and the other slaves go on. A slave in BOOT (firmware update, 0x03) is
+   not on the ladder — BOOT only leaves to INIT and a PREOP request is refused — so it is
+   a straggler from the start and is not asked for anything. Per-slave arrival times and the
+   slowest slave of each step are kept for the bring-up report.
+
+     static Servo_BusGroup bus;
+     ServoBus_GroupInit(&bus);
+     for (int i = 0; i < n; i++) ServoBus_Add(&bus, slave_handle[i], i);
+     if (ServoBus_Transition(&bus, EC_AL_OP, 5000) != 0) ... bus.m[i].failed / al / al_code */
+#define CSP_BUS_MAX_SLAVES     128
+#define CSP_BUS_POLL_US        500    /* pause between AL status sweeps                          */
+
+typedef struct {
+    int       index;                   /* your slave number, for the report                    */
+    uint16_t  al;                      /* last AL status                                       */
+    uint16_t  al_code;                 /* AL status code when it failed                        */
+    int       acks;                    /* error acknowledges sent in this transition           */
+    int       clearing;                /* ack sent, error bit not seen clear yet               */
+    int       failed;                  /* straggler: timed out or stuck in error               */
+    int64_t   t_step_ns[3];            /* PREOP, SAFEOP, OP: arrival after the request
+                                          (-1 = step skipped, 0 = never arrived)               */
+} Servo_BusSlave;
+
+typedef struct {
+    EcSlave         slv[CSP_BUS_MAX_SLAVES];
+    uint16_t        al[CSP_BUS_MAX_SLAVES];  /* sweep buffer for state_get_group()          */
+    Servo_BusSlave  m[CSP_BUS_MAX_SLAVES];
+    size_t          n;
+    int64_t         step_ns[3];        /* duration of each step (0 = nothing to do)            */
+    int             slowest[3];        /* member that closed each step (-1 = none)             */
+    int64_t         total_ns;
+    size_t          stragglers;
+} Servo_BusGroup;
+
+static const uint16_t k_bus_ladder[3] = { EC_AL_PREOP, EC_AL_SAFEOP, EC_AL_OP };
+
+void ServoBus_GroupInit(Servo_BusGroup *g){ memset(g, 0, sizeof *g); }
+
+/* Returns the member number, or -1 when the group is full. */
+int ServoBus_Add(Servo_BusGroup *g, EcSlave s, int index)
+{
+    if (g->n == CSP_BUS_MAX_SLAVES) return -1;
+    g->slv[g->n] = s;
+    g->m[g->n].index = index;
+    return (int)g->n++;
+}
+
+const char *ServoBus_StateName(uint16_t al)
+{
+    switch (al & EC_AL_MASK){
+    case EC_AL_INIT:   return "INIT";
+    case EC_AL_PREOP:  return "PREOP";
+    case EC_AL_BOOT:   return "BOOT";
+    case EC_AL_SAFEOP: return "SAFEOP";
+    case EC_AL_OP:     return "OP";
+    default:           return "?";
+    }
+}
+
+/* Rank on the ladder: INIT 0, PREOP 1, SAFEOP 2, OP 3, BOOT -1 (off the ladder: a stop,
+   not a step below PREOP); unknown counts as INIT. */
+static int servo_bus_rank(uint16_t al)
+{
+    switch (al & EC_AL_MASK){
+    case EC_AL_BOOT:   return -1;
+    case EC_AL_PREOP:  return 1;
+    case EC_AL_SAFEOP: return 2;
+    case EC_AL_OP:     return 3;
+    default:           return 0;
+    }
+}
+
+/* One step: bring every live member below `want` up to it (and, on the last step, every
+   member above it down to it). */
+static void servo_bus_step(Servo_BusGroup *g, int step, int last, unsigned timeout_ms)
+{
+    const uint16_t want = k_bus_ladder[step];
+    const int64_t t0 = now_ns(), t_end = t0 + (int64_t)timeout_ms * 1000000;
+    const struct timespec pause = { 0, CSP_BUS_POLL_US * 1000L };
+    size_t pending = 0;
+
+    g->slowest[step] = -1;
+    state_get_group(g->slv, g->n, g->al);
+    for (size_t i = 0; i < g->n; i++){
+        Servo_BusSlave *m = &g->m[i];
+        m->al = g->al[i];
+        m->t_step_ns[step] = -1;
+        const int rank = servo_bus_rank(m->al);
+        if (m->failed || rank == step + 1 || (rank > step + 1 && !last)) continue;
+        if (rank < 0){
+            WARNF("bus: slave %d in BOOT, left out", m->index);
+            m->failed = 1;
+            continue;
+        }
+        state_request(g->slv[i], want);
+        m->t_step_ns[step] = 0;
+        pending++;
+    }
+    if (!pending) return;
+
+    while (pending){
+        nanosleep(&pause, NULL);
+        state_get_group(g->slv, g->n, g->al);
+        const int64_t t = now_ns();
+        for (size_t i = 0; i < g->n; i++){
+            Servo_BusSlave *m = &g->m[i];
+            if (m->failed || m->t_step_ns[step] != 0) continue;   /* not pending */
+            m->al = g->al[i];
+            if ((m->al & EC_AL_MASK) == EC_AL_BOOT){ m->failed = 1; pending--; continue; }
+            if (m->al & EC_AL_ERROR){
+                if (m->clearing) continue;          /* acked: wait for it, up to t_end */
+                m->al_code = state_al_code(g->slv[i]);
+                if (m->acks++ == 0){
+                    state_request(g->slv[i], want | EC_AL_ERROR);
+                    m->clearing = 1;
+                    continue;
+                }
+                m->failed = 1; pending--;           /* came back after the ack */
+                continue;
+            }
+            m->clearing = 0;
+            if ((m->al & EC_AL_MASK) == want){
+                m->t_step_ns[step] = t - t0;
+                g->slowest[step] = (int)i;
+                pending--;
+            }
+        }
+        if (t >= t_end) break;
+    }
+    g->step_ns[step] = now_ns() - t0;
+
+    for (size_t i = 0; i < g->n && pending; i++){               /* timed out */
+        Servo_BusSlave *m = &g->m[i];
+        if (m->failed || m->t_step_ns[step] != 0) continue;
+        if (m->al & EC_AL_ERROR) m->al_code = state_al_code(g->slv[i]);
+        m->failed = 1; pending--;
+    }
+}
+
+/* Bring the group to `target` (EC_AL_PREOP, EC_AL_SAFEOP or EC_AL_OP) through the
+   intermediate states, `timeout_ms` per step. Non-RT (sleeps between sweeps). Returns the
+   number of stragglers (0 = all members in `target`), or -1 for a bad target. */
+int ServoBus_Transition(Servo_BusGroup *g, uint16_t target, unsigned timeout_ms)
+{
+    const int last = servo_bus_rank(target) - 1;
+    if (last < 0 || (target & ~EC_AL_MASK)) return -1;
+    const int64_t t0 = now_ns();
+    g->stragglers = 0;
+    for (size_t i = 0; i < g->n; i++){
+        g->m[i].failed = g->m[i].acks = g->m[i].clearing = 0;
+        g->m[i].t_step_ns[0] = g->m[i].t_step_ns[1] = g->m[i].t_step_ns[2] = -1;
+    }
+    for (int step = 0; step < 3; step++){ g->step_ns[step] = 0; g->slowest[step] = -1; }
+
+    for (int step = 0; step <= last; step++){
+        servo_bus_step(g, step, step == last, timeout_ms);
+        if (g->slowest[step] >= 0)
+            DBGF("bus -> AL 0x%X: %lld us, last slave %d after %lld us", (unsigned)k_bus_ladder[step],
+                 (long long)(g->step_ns[step] / 1000), g->m[g->slowest[step]].index,
+                 (long long)(g->m[g->slowest[step]].t_step_ns[step] / 1000));
+    }
+    g->total_ns = now_ns() - t0;
+
+    for (size_t i = 0; i < g->n; i++){
+        const Servo_BusSlave *m = &g->m[i];
+        if (!m->failed) continue;
+        g->stragglers++;
+        ERRF("bus: slave %d stuck (AL status 0x%02X, code 0x%04X)", m->index,
+             (unsigned)m->al, (unsigned)m->al_code);
+    }
+    LOGF("bus: %zu/%zu slaves in AL 0x%X after %lld ms", g->n - g->stragglers, g->n,
+         (unsigned)target, (long long)(g->total_ns / 1000000));
+    return (int)g->stragglers;
+}
+
+/* Axis context defaults, images not mapped. */
+static void servo_axis_defaults(Servo_Axis *ax, int slave_index)
+{
+    memset(ax, 0, sizeof *ax);
+    ax->dir           = 1;
+    ax->cfg           = servo_cfg_default();
+    ax->link_down     = 1;             /* first valid SW starts the engine timer (+ comm cooldown) */
+    ax->slave_index   = slave_index;
+#if CSP_FE_STATS
+    ServoAxis_SetFeWindow(ax, CSP_FE_STATS_WINDOW_MS);
+#endif
+#if CSP_DEADTIME_RING
+    ServoAxis_SetDeadTime(ax, CSP_DEADTIME_TICKS, 0);
+#endif
+}
+
+/* Attach the slave's images (alignment checked against CSP_IMAGE_ALIGN). With the
+   snapshot the first publish keeps what the output image holds. 0, or -1 = unmapped. */
+static int servo_axis_map(Servo_Axis *ax, Drive_Inputs *in, Drive_Outputs *out)
+{
+    ax->in = NULL; ax->out = NULL;
+    if ((((uintptr_t)in | (uintptr_t)out) & (CSP_IMAGE_ALIGN - 1)) != 0){
+        ERRF("slave %d: image not %d-byte aligned as CSP_IMAGE_ALIGN promises", ax->slave_index, CSP_IMAGE_ALIGN);
+        return -1;
+    }
+    ax->in = in; ax->out = out;
+#if CSP_PI_SNAPSHOT
+    memcpy(&ax->pi_out, ax->out, sizeof ax->pi_out);
+    servo_pi_swap_out(&ax->pi_out);
+#endif
+    return 0;
+}
+
+/* For images you already hold (a master that hands out pointers, replay 4g): the same
+   context as ServoAxis_Init() without map_io, size check or SDOs. */
+int ServoAxis_InitImages(Servo_Axis *ax, int slave_index, Drive_Inputs *in, Drive_Outputs *out)
+{
+    servo_axis_defaults(ax, slave_index);
+    return servo_axis_map(ax, in, out);
+}
+
+int ServoAxis_Init(Servo_Axis *ax,
+                   EcDevice dev,
+                   int slave_index,
+                   size_t eni_in_bits, size_t eni_out_bits,
+                   size_t eni_in_off_bits, size_t eni_out_off_bits)
+{
+    servo_axis_defaults(ax, slave_index);
+
+    if (eni_in_bits != DRIVE_INPUTS_BITS || eni_out_bits != DRIVE_OUTPUTS_BITS){
+        ERRF("PDO size mismatch: ENI in=%zu out=%zu, struct in=%u out=%u",
+             eni_in_bits, eni_out_bits,
+             (unsigned)DRIVE_INPUTS_BITS, (unsigned)DRIVE_OUTPUTS_BITS);
+        return -1;   /* never map a layout we would misread: the axis stays unmapped (no-op) */
+    }
+
+    Drive_Inputs  *in;
+    Drive_Outputs *out;
+    if (map_io(dev, slave_index, eni_in_off_bits, eni_out_off_bits, &in, &out) != 0){
+        WARNF("map_io() not implemented yet — template stays no-op until you wire it.");
+    } else if (servo_axis_map(ax, in, out) != 0){
+        return -1;
+    } else {
+        DBGF("PI mapped OK (bits in=%zu out=%zu)", eni_in_bits, eni_out_bits);
+    }
+
+#if OMRON_R88D_EXAMPLE
+    /* Omron R88D-1SN (CSP) example SDOs. Check your manual:
+       6060:0 = 8 (CSP), 60C2:1 = LOOP_PERIOD_US (µs, as expected with 60C2:2 = -6), 6065:0 = FE window.
+       10F1:1 watchdog is vendor-specific; keep off unless needed.
+       Issued through a one-slave plan (6a): after a cell-wide ServoSdo_Run() the cache
+       already holds these values and nothing goes on the bus. */
+    {
+        Servo_SdoOp   ops[4];
+        Servo_SdoPlan plan;
+        ServoSdo_PlanInit(&plan, ops, 4, 1, 1, 0);
+        (void)ServoSdo_AddCspConfig(&plan, slave_index);
+        (void)ServoSdo_Run(&plan, dev);
+    }
+#endif
+    return 0;
+}
+
+int ServoTemplate_Init(EcDevice dev,
+                       int slave_index,
+                       size_t eni_in_bits, size_t eni_out_bits,
+                       size_t eni_in_off_bits, size_t eni_out_off_bits)
+{
+    return ServoAxis_Init(&g_axis, dev, slave_index,
+                          eni_in_bits, eni_out_bits, eni_in_off_bits, eni_out_off_bits);
+}
+
+#if CSP_PI_SNAPSHOT
+/* Zero-copy publish for masters that build the frame from a pointer: give two output
+   images; each tick fills the back one and then makes it the front (release store).
+   The frame builder reads ServoAxis_FrontOutputs() once per frame (acquire). Without a
+   pair, outputs are block-copied into the image from map_io(). */
+void ServoAxis_SetOutputPair(Servo_Axis *ax, Drive_Outputs *a, Drive_Outputs *b)
+{
+    ax->out_pair[0] = a; ax->out_pair[1] = b;
+    memcpy(a, &ax->pi_out, sizeof *a);
+    servo_pi_swap_out(a);
+    memcpy(b, a, sizeof *b);
+    ax->out_back = 1;
+    atomic_store_explicit(&ax->out_front, a, memory_order_release);
+}
+
+Drive_Outputs *ServoAxis_FrontOutputs(Servo_Axis *ax)
+{
+    return atomic_load_explicit(&ax->out_front, memory_order_acquire);
+}
+#endif
+
+#if CSP_FF_MAPPED
+/* Feed-forward gains (both 0 after init = off). kv: velocity offset per count/s of
+   set-point velocity (1.0 when 60B1 uses the position's units/s, scale for gearing);
+   ka: torque offset (0.1 % rated) per count/s² of set-point acceleration, i.e. inertia
+   over torque constant — start from ka = J·2π / (counts_per_rev · T_rated · 0.001) and
+   tune with the FE statistics (5e). Call between ticks. */
+void ServoAxis_SetFeedForward(Servo_Axis *ax, float kv, float ka)
+{
+    ax->ff_kv = kv;
+    ax->ff_ka = ka;
+}
+#endif
+
+/* =========================================================
+   7) RUNTIME LOOP (CiA-402 + CSP set-point producer)
+   =========================================================
+
+   One tick runs in three passes over the axes:
+     a) per axis: CiA-402 gating + set-point step (unclamped target),
+     b) all producing axes at once: ±limit clamp + FE window/hysteresis (SoA kernel),
+     c) per axis: start dwell on clamp, write target + CW, log FE transitions.
+   With CSP_PI_SNAPSHOT the passes work on per-axis copies of the PDOs: all inputs are
+   read in one sweep before a) and all outputs written in one sweep after c), so a frame
+   boundary cannot tear a tick's view of the drive and the DMA image is touched briefly.
+   Pass b) is the same compare-and-select on every axis, so it runs on a
+   structure-of-arrays block with SSE4.1 / AVX2 / NEON when the compiler targets them.
+   Axes with a dead-time delay (5f) get their FE recomputed there from the delayed
+   target, so the warn latch, FE statistics and logs all see the compensated value. */
+
+/* ---- 7a) SoA lane block + limit/FE kernel ---- */
+#define CSP_SOA_LANES          64     /* Axes per kernel block (multiple of 8).                     */
+
+/* Lanes are dense: only axes whose producer ticked this period are gathered.
+   Masks are 0 / -1 so the vector and scalar paths share one representation. */
+typedef struct {
+    _Alignas(CSP_CACHE_LINE)
+    int32_t target[CSP_SOA_LANES];     /* in: unclamped target  → out: clamped target          */
+    int32_t actual[CSP_SOA_LANES];     /* in: 0x6064 position actual value                     */
+    int32_t fe[CSP_SOA_LANES];         /* in: 0x60F4 following error → out: FE used (5f)       */
+    int32_t warn[CSP_SOA_LANES];       /* in/out: FE warning latch (0 / -1)                    */
+    int32_t hit[CSP_SOA_LANES];        /* out: -1 where the target hit ±lim                    */
+    int32_t delayed[CSP_SOA_LANES];    /* in: target sent dt_ticks ago (5f)                    */
+    int32_t dtm[CSP_SOA_LANES];        /* in: -1 = FE := delayed − actual, 0 = keep 60F4       */
+    int32_t lim[CSP_SOA_LANES];        /* in: ±limit of the lane's config                      */
+    int32_t wth[CSP_SOA_LANES];        /* in: FE warn threshold                                */
+    int32_t oth[CSP_SOA_LANES];        /* in: FE clear threshold                               */
+    Servo_Axis *axis[CSP_SOA_LANES];   /* lane → owning axis                                   */
+} Servo_AxisSoA;
+
+/* Reference semantics (and tail / non-SIMD builds). */
+static inline void csp_kernel_scalar(Servo_AxisSoA *b, size_t i, size_t n)
+{
+    for (; i < n; i++){
+        const int32_t dfe = (int32_t)((uint32_t)b->delayed[i] - (uint32_t)b->actual[i]);
+        const int32_t fe = (b->dtm[i] & dfe) | (~b->dtm[i] & b->fe[i]);
+        b->fe[i] = fe;
+        const int32_t t = b->target[i], w = b->warn[i];
+        const int32_t lim = b->lim[i], wth = b->wth[i], oth = b->oth[i];
+        const int32_t hi = -(t >  lim), lo = -(t < -lim);
+        b->target[i] = hi ? lim : (lo ? -lim : t);
+        b->hit[i]    = hi | lo;
+        const int32_t set = -(fe > wth || fe < -wth);
+        const int32_t clr = -(fe < oth && fe > -oth);
+        b->warn[i] = (w & ~clr) | (~w & set);
+    }
+}
+
+#if defined(__AVX2__)
+static inline void csp_kernel(Servo_AxisSoA *b, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        const __m256i lim = _mm256_load_si256((const __m256i*)&b->lim[i]), nlim = _mm256_sub_epi32(zero, lim);
+        const __m256i wth = _mm256_load_si256((const __m256i*)&b->wth[i]), nwth = _mm256_sub_epi32(zero, wth);
+        const __m256i oth = _mm256_load_si256((const __m256i*)&b->oth[i]), noth = _mm256_sub_epi32(zero, oth);
+        const __m256i t  = _mm256_load_si256((const __m256i*)&b->target[i]);
+        const __m256i dm = _mm256_load_si256((const __m256i*)&b->dtm[i]);
+        const __m256i df = _mm256_sub_epi32(_mm256_load_si256((const __m256i*)&b->delayed[i]),
+                                            _mm256_load_si256((const __m256i*)&b->actual[i]));
+        const __m256i fe = _mm256_or_si256(_mm256_and_si256(dm, df),
+                                           _mm256_andnot_si256(dm, _mm256_load_si256((const __m256i*)&b->fe[i])));
+        const __m256i w  = _mm256_load_si256((const __m256i*)&b->warn[i]);
+        _mm256_store_si256((__m256i*)&b->fe[i], fe);
+        const __m256i hit = _mm256_or_si256(_mm256_cmpgt_epi32(t, lim), _mm256_cmpgt_epi32(nlim, t));
+        const __m256i set = _mm256_or_si256(_mm256_cmpgt_epi32(fe, wth), _mm256_cmpgt_epi32(nwth, fe));
+        const __m256i clr = _mm256_and_si256(_mm256_cmpgt_epi32(oth, fe), _mm256_cmpgt_epi32(fe, noth));
+        _mm256_store_si256((__m256i*)&b->target[i], _mm256_min_epi32(_mm256_max_epi32(t, nlim), lim));
+        _mm256_store_si256((__m256i*)&b->hit[i], hit);
+        _mm256_store_si256((__m256i*)&b->warn[i],
+                           _mm256_or_si256(_mm256_andnot_si256(clr, w), _mm256_andnot_si256(w, set)));
+    }
+    csp_kernel_scalar(b, i, n);
+}
+#elif defined(__SSE4_1__)
+static inline void csp_kernel(Servo_AxisSoA *b, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        const __m128i lim = _mm_load_si128((const __m128i*)&b->lim[i]), nlim = _mm_sub_epi32(zero, lim);
+        const __m128i wth = _mm_load_si128((const __m128i*)&b->wth[i]), nwth = _mm_sub_epi32(zero, wth);
+        const __m128i oth = _mm_load_si128((const __m128i*)&b->oth[i]), noth = _mm_sub_epi32(zero, oth);
+        const __m128i t  = _mm_load_si128((const __m128i*)&b->target[i]);
+        const __m128i dm = _mm_load_si128((const __m128i*)&b->dtm[i]);
+        const __m128i df = _mm_sub_epi32(_mm_load_si128((const __m128i*)&b->delayed[i]),
+                                         _mm_load_si128((const __m128i*)&b->actual[i]));
+        const __m128i fe = _mm_or_si128(_mm_and_si128(dm, df),
+                                        _mm_andnot_si128(dm, _mm_load_si128((const __m128i*)&b->fe[i])));
+        const __m128i w  = _mm_load_si128((const __m128i*)&b->warn[i]);
+        _mm_store_si128((__m128i*)&b->fe[i], fe);
+        const __m128i hit = _mm_or_si128(_mm_cmpgt_epi32(t, lim), _mm_cmplt_epi32(t, nlim));
+        const __m128i set = _mm_or_si128(_mm_cmpgt_epi32(fe, wth), _mm_cmplt_epi32(fe, nwth));
+        const __m128i clr = _mm_and_si128(_mm_cmplt_epi32(fe, oth), _mm_cmpgt_epi32(fe, noth));
+        _mm_store_si128((__m128i*)&b->target[i], _mm_min_epi32(_mm_max_epi32(t, nlim), lim));
+        _mm_store_si128((__m128i*)&b->hit[i], hit);
+        _mm_store_si128((__m128i*)&b->warn[i], _mm_or_si128(_mm_andnot_si128(clr, w), _mm_andnot_si128(w, set)));
+    }
+    csp_kernel_scalar(b, i, n);
+}
+#elif defined(__ARM_NEON)
+static inline void csp_kernel(Servo_AxisSoA *b, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        const int32x4_t lim = vld1q_s32(&b->lim[i]), nlim = vnegq_s32(lim);
+        const int32x4_t wth = vld1q_s32(&b->wth[i]), nwth = vnegq_s32(wth);
+        const int32x4_t oth = vld1q_s32(&b->oth[i]), noth = vnegq_s32(oth);
+        const int32x4_t t  = vld1q_s32(&b->target[i]);
+        const uint32x4_t dm = vreinterpretq_u32_s32(vld1q_s32(&b->dtm[i]));
+        const int32x4_t fe = vbslq_s32(dm, vsubq_s32(vld1q_s32(&b->delayed[i]), vld1q_s32(&b->actual[i])),
+                                       vld1q_s32(&b->fe[i]));
+        vst1q_s32(&b->fe[i], fe);
+        const uint32x4_t w = vreinterpretq_u32_s32(vld1q_s32(&b->warn[i]));
+        const uint32x4_t hit = vorrq_u32(vcgtq_s32(t, lim), vcltq_s32(t, nlim));
+        const uint32x4_t set = vorrq_u32(vcgtq_s32(fe, wth), vcltq_s32(fe, nwth));
+        const uint32x4_t clr = vandq_u32(vcltq_s32(fe, oth), vcgtq_s32(fe, noth));
+        vst1q_s32(&b->target[i], vminq_s32(vmaxq_s32(t, nlim), lim));
+        vst1q_s32(&b->hit[i], vreinterpretq_s32_u32(hit));
+        vst1q_s32(&b->warn[i], vreinterpretq_s32_u32(vbslq_u32(w, vbicq_u32(w, clr), set)));
+    }
+    csp_kernel_scalar(b, i, n);
+}
+#else
+static inline void csp_kernel(Servo_AxisSoA *b, size_t n){ csp_kernel_scalar(b, 0, n); }
+#endif
+
+/* ---- 7b) per-axis passes ---- */
+
+/* Set-point generator, one period: delta to apply now (no side effects). */
+static inline int servo_gen_delta(const Servo_Axis *ax)
+{
+    if (ax->dwell_rem > 0) return 0;
+    /* Mini-ramp: inc_step scaled by the ramp table during the first ramp_ms */
+    const Servo_AxisConfig *c = ax->cfg;
+    if (ax->ramp_rem > 0) return ax->dir * c->ramp_lut[c->ramp_ticks - ax->ramp_rem];
+    return ax->dir * c->inc_step;
+}
+
+/* Advance the generator by `k` periods with a per-period `delta` (k > 1 only when
+   extrapolating an overrun; the move is then bounded by OVERRUN_MAX_DELTA). */
+static inline void servo_gen_advance(Servo_Axis *ax, int64_t k, int delta)
+{
+    if (ax->dwell_rem > 0){
+        ax->dwell_rem -= (int)(k < ax->dwell_rem ? k : ax->dwell_rem);
+        if (ax->dwell_rem == 0){ ax->ramp_rem = ax->cfg->ramp_ticks; ax->dir = (ax->dir==0 ? -1 : ax->dir); /* resume */ }
+        return;
+    }
+    if (k == 1){
+        ax->pos_tgt += delta; /* clamped by the kernel; inside ±limit_pos while dwelling */
+    } else {
+        int64_t step = k * (int64_t)delta;
+        if (step >  OVERRUN_MAX_DELTA) step =  OVERRUN_MAX_DELTA;
+        if (step < -OVERRUN_MAX_DELTA) step = -OVERRUN_MAX_DELTA;
+        ax->pos_tgt += (int32_t)step;
+    }
+    if (ax->ramp_rem > 0) ax->ramp_rem -= (int)(k < ax->ramp_rem ? k : ax->ramp_rem);
+}
+
+/* CATCHUP: replay up to OVERRUN_MAX_CATCHUP owed periods step by step, stopping before
+   |Δtarget| exceeds OVERRUN_MAX_DELTA or once a limit is crossed (the kernel then clamps
+   and starts the dwell). Returns the periods consumed (≥1). */
+static inline int64_t servo_gen_catchup(Servo_Axis *ax, int64_t due)
+{
+    const int64_t max_steps = due < OVERRUN_MAX_CATCHUP ? due : OVERRUN_MAX_CATCHUP;
+    int64_t used = 0, sum = 0;
+    while (used < max_steps){
+        const int d = servo_gen_delta(ax);
+        if (used > 0 && (sum + d > OVERRUN_MAX_DELTA || sum + d < -OVERRUN_MAX_DELTA)) break;
+        servo_gen_advance(ax, 1, d);
+        sum += d; used++;
+        if (ax->pos_tgt > ax->cfg->limit_pos || ax->pos_tgt < -ax->cfg->limit_pos) break;
+    }
+    return used;
+}
+
+/* CiA-402 engine. One row per state: the CW it sends, how it is left, and where to.
+   Each tick: preemptions first (fault, lost enable, link back, lock-out ack), then the
+   current row's exit is tested and taken until the state settles, and the settled state's
+   CW is written — so a drive that answered this frame gets its next command in the same
+   tick. State time comes from `now` (st_t_ns), not from the producer's t0. Every
+   transition records how long the axis sat in `from` (s402.edge[from][to]). */
+enum { CSP_X_NONE, CSP_X_SW, CSP_X_SW_LOST, CSP_X_TIMER };
+
+static const struct {
+    const char *name;
+    uint16_t cw;                       /* CW sent while in the state (RUN: the producer's)     */
+    uint8_t  exit;                     /* CSP_X_*                                              */
+    uint8_t  timed;                    /* step timeout applies                                 */
+    uint16_t sw_mask, sw_want;         /* CSP_X_SW: leave when (SW & mask) == want (SW_LOST: != want) ... */
+    uint8_t  next, next_fast;          /* ... to `next`, or `next_fast` on a fast recovery     */
+} k_402[CSP_ST_COUNT] = {
+    [CSP_ST_SHUTDOWN]  = { "Shutdown",   0x0006, CSP_X_SW,    1, 0x006F, 0x0021, CSP_ST_SWITCH_ON, CSP_ST_ENABLE   },
+    [CSP_ST_SWITCH_ON] = { "SwitchOn",   0x0007, CSP_X_SW,    1, 0x006F, 0x0023, CSP_ST_ENABLE,    CSP_ST_ENABLE   },
+    [CSP_ST_ENABLE]    = { "Enabling",   0x000F, CSP_X_SW,    1, 0x006F, 0x0027, CSP_ST_RUN,       CSP_ST_RUN      },
+    [CSP_ST_RUN]       = { "Running",    0x000F, CSP_X_SW_LOST, 0, 0x006F, 0x0027, CSP_ST_SHUTDOWN, CSP_ST_SHUTDOWN },
+    [CSP_ST_FAULT]     = { "FaultReset", 0x0080, CSP_X_SW,    0, 0x0008, 0x0000, CSP_ST_COOLDOWN,  CSP_ST_SHUTDOWN },
+    [CSP_ST_COOLDOWN]  = { "Cooldown",   0x0006, CSP_X_TIMER, 0, 0,      0,      CSP_ST_SHUTDOWN,  CSP_ST_SHUTDOWN },
+    [CSP_ST_LOCKED]    = { "Locked",     0x0006, CSP_X_NONE,  0, 0,      0,      CSP_ST_LOCKED,    CSP_ST_LOCKED   },
+};
+
+const char *ServoAxis_StateName(int st)
+{
+    return (st >= 0 && st < CSP_ST_COUNT) ? k_402[st].name : "?";
+}
+
+/* Lock-out release (any thread): the axis resets the fault (if still present) and runs
+   the normal enable sequence with a fresh retry budget. */
+void ServoAxis_ClearFault(Servo_Axis *ax)
+{
+    atomic_store_explicit(&ax->fault_ack, 1, memory_order_release);
+}
+
+static inline uint32_t csp_us_sat(int64_t ns)
+{
+    return ns <= 0 ? 0 : (ns / 1000 > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns / 1000));
+}
+
+static void servo_402_enter(Servo_Axis *ax, int to, int64_t now)
+{
+    Servo_402Edge *e = &ax->s402.edge[ax->st][to];
+    const uint32_t us = csp_us_sat(now - ax->st_t_ns);
+    e->n++; e->last_us = us;
+    if (us > e->max_us) e->max_us = us;
+    DBGF("slave %d: state %d -> %d after %u us", ax->slave_index, ax->st, to, us);
+    ax->st = to; ax->st_t_ns = now; ax->st_ticks = 0;
+
+    if (to == CSP_ST_RUN){
+        ax->t0 = now; ax->ramp_rem = ax->cfg->ramp_ticks;
+        if (ax->fault_t_ns){
+            const uint32_t rec = csp_us_sat(now - ax->fault_t_ns);
+            ax->s402.recoveries++; ax->s402.rec_last_us = rec;
+            if (rec > ax->s402.rec_max_us) ax->s402.rec_max_us = rec;
+            LOGF("slave %d: recovered in %u us (attempt %d)", ax->slave_index, rec, ax->st_retry + 1);
+        }
+        servo_fe_stats_restart(ax);
+        if (ax->stream)    servo_stream_reset(ax->stream);
+        else if (ax->traj) servo_traj_reset(ax->traj, ax->pos_tgt);
+    }
+}
+
+/* A recovery attempt failed (repeat fault or step timeout): back off, or lock out. */
+static void servo_402_retry(Servo_Axis *ax, int64_t now, int to_cool)
+{
+    const Servo_AxisConfig *c = ax->cfg;
+    if (ax->st_retry < UINT8_MAX) ax->st_retry++;
+    ax->s402.retries++;
+    if (c->retry_max && ax->st_retry > c->retry_max){
+        ax->s402.lockouts++;
+        atomic_store_explicit(&ax->fault_ack, 0, memory_order_relaxed);   /* only a later ack counts */
+        ERRF("slave %d: locked out after %d attempts (ServoAxis_ClearFault to retry)",
+             ax->slave_index, ax->st_retry);
+        servo_402_enter(ax, CSP_ST_LOCKED, now);
+        return;
+    }
+    const int sh = ax->st_retry < 20 ? ax->st_retry : 20;
+    int64_t cool = (c->fault_cool_ns > 0 ? c->fault_cool_ns : LOOP_PERIOD_NS) << sh;
+    if (c->backoff_max_ns > 0 && cool > c->backoff_max_ns) cool = c->backoff_max_ns;
+    ax->cool_ns = cool;
+    if (to_cool) servo_402_enter(ax, CSP_ST_COOLDOWN, now);
+}
+
+/* Fast path: only the first attempt of an incident, and only when configured. */
+static inline int servo_402_fast(const Servo_Axis *ax)
+{
+    return ax->cfg->fast_reenable && ax->fault_t_ns && ax->st_retry == 0;
+}
+
+/* Pass a) is split by phase, so each part can be profiled on its own: the engine's
+   preemptions (fault / link / lost enable) only move the state; the table step returns 1
+   when it owns this tick's CW; the producer returns 1 when it stepped the set-point. */
+static void servo_axis_gate(Servo_Axis *ax, uint16_t SW, int64_t now)
+{
+    const Servo_AxisConfig *c = ax->cfg;
+
+    /* Link back (or first tick): restart the state timer, optional comm cooldown. */
+    if (ax->link_down){
+        ax->link_down = 0;
+        ax->st_t_ns   = now;
+        if (c->comm_cool_ns > 0 && ax->st != CSP_ST_LOCKED){
+            ax->cool_ns = c->comm_cool_ns;
+            servo_402_enter(ax, CSP_ST_COOLDOWN, now);
+        }
+    }
+
+    if (ax->st == CSP_ST_LOCKED){
+        if (!atomic_exchange_explicit(&ax->fault_ack, 0, memory_order_acquire)) return;
+        ax->st_retry = 0;
+        servo_402_enter(ax, (SW & 0x0008) ? CSP_ST_FAULT : CSP_ST_SHUTDOWN, now);
+        return;
+    }
+
+    /* Fault (SW bit3): open an incident, or count a retry when it recurs while one is open. */
+    if ((SW & 0x0008) && ax->st != CSP_ST_FAULT){
+        ax->s402.faults++;
+#ifdef CSP_PDO_HAS_error_code
+        WARNF("slave %d: fault in state %d (603F 0x%04X)", ax->slave_index, ax->st,
+              (unsigned)PDO_GET16(ax, error_code));
+#else
+        WARNF("slave %d: fault in state %d", ax->slave_index, ax->st);
+#endif
+        if (!ax->fault_t_ns){ ax->fault_t_ns = now; ax->st_retry = 0; }
+        else                { servo_402_retry(ax, now, 0); if (ax->st == CSP_ST_LOCKED) return; }
+        servo_402_enter(ax, CSP_ST_FAULT, now);
+        return;
+    }
+
+    /* Switch-on disabled while (being) enabled: the drive dropped us, start over. */
+    if ((SW & 0x0040) && (ax->st == CSP_ST_SWITCH_ON || ax->st == CSP_ST_ENABLE || ax->st == CSP_ST_RUN))
+        servo_402_enter(ax, CSP_ST_SHUTDOWN, now);
+}
+
+static int servo_axis_cia402(Servo_Axis *ax, uint16_t SW, int64_t now)
+{
+    const Servo_AxisConfig *c = ax->cfg;
+
+    /* Settle: take exits until the row holds (bounded; the table has no cycles without SW). */
+    for (int hop = 0; hop < CSP_ST_COUNT; hop++){
+        const int st = ax->st;
+        int to = -1;
+        if (k_402[st].exit == CSP_X_SW){
+            if ((SW & k_402[st].sw_mask) == k_402[st].sw_want)
+                to = servo_402_fast(ax) ? k_402[st].next_fast : k_402[st].next;
+            else if (k_402[st].timed && c->step_timeout_ns > 0 && now - ax->st_t_ns >= c->step_timeout_ns){
+                ax->s402.timeouts++;
+                WARNF("slave %d: state %d timed out (SW 0x%04X)", ax->slave_index, st, (unsigned)SW);
+                servo_402_retry(ax, now, 1);
+                continue;
+            }
+        } else if (k_402[st].exit == CSP_X_SW_LOST){
+            /* Left OperationEnabled without a fault (SwitchedOn, QuickStopActive, …): the
+               drive no longer follows, so stop producing and re-enable from 6064 — straight
+               from SwitchedOn, through Shutdown otherwise. */
+            if ((SW & k_402[st].sw_mask) != k_402[st].sw_want){
+                ax->s402.drops++;
+                WARNF("slave %d: left OperationEnabled (SW 0x%04X)", ax->slave_index, (unsigned)SW);
+                ax->pos_tgt = ax->pos_prev = servo_dt_align(ax, (int32_t)PDO_GET32(ax, position_actual_value));
+                to = (SW & 0x006F) == 0x0023 ? CSP_ST_ENABLE : k_402[st].next;
+            }
+        } else if (k_402[st].exit == CSP_X_TIMER){
+            if (now - ax->st_t_ns >= ax->cool_ns) to = k_402[st].next;
+        }
+        if (to < 0) break;
+        if (st == CSP_ST_FAULT && to == CSP_ST_COOLDOWN)   /* slow path: cooldown (backed off on retries) */
+            ax->cool_ns = ax->st_retry ? ax->cool_ns : c->fault_cool_ns;
+        if (to == CSP_ST_RUN)                              /* traj/stream restart from here */
+            ax->pos_tgt = servo_dt_align(ax, (int32_t)PDO_GET32(ax, position_actual_value));
+        servo_402_enter(ax, to, now);
+        if (to == CSP_ST_RUN) goto held;     /* producer starts next tick, from the aligned target */
+    }
+
+    /* Running: close the incident once it has stayed enabled for the retry window. */
+    if (ax->st == CSP_ST_RUN){
+        if ((ax->fault_t_ns || ax->st_retry) && now - ax->st_t_ns >= c->retry_window_ns){
+            ax->fault_t_ns = 0; ax->st_retry = 0;
+        }
+        return 0;
+    }
+
+    if (ax->st == CSP_ST_FAULT){
+        /* Fault Reset wants a rising edge on bit7: 0x0080, release, 0x0080, … until it clears. */
+        PDO_SET16(ax, control_word, (ax->st_ticks & 1) ? 0x0006 : 0x0080);
+        ax->st_ticks++;
+        return 1;
+    }
+held:
+    if (ax->st == CSP_ST_ENABLE || ax->st == CSP_ST_RUN){
+        /* Align targets to avoid a jump (dead-time predicted when configured, 5f) */
+        if (ax->st == CSP_ST_ENABLE)
+            ax->pos_tgt = servo_dt_align(ax, (int32_t)PDO_GET32(ax, position_actual_value));
+        PDO_SET32(ax, target_position, (uint32_t)ax->pos_tgt);
+    }
+    PDO_SET16(ax, control_word, k_402[ax->st].cw);
+    ax->st_ticks++;
+    return 1;
+}
+
+/* Engine counters, nonzero transitions only. Non-RT; values may be one tick apart. */
+void ServoAxis_Print402(const Servo_Axis *ax, FILE *f)
+{
+    const Servo_402Stats *s = &ax->s402;
+    fprintf(f, "slave %d: %s, faults=%u retries=%u timeouts=%u lockouts=%u drops=%u recoveries=%u"
+               " (last %u us, max %u us)\n", ax->slave_index, ServoAxis_StateName(ax->st),
+            s->faults, s->retries, s->timeouts, s->lockouts, s->drops, s->recoveries, s->rec_last_us,
+            s->rec_max_us);
+    for (int a = 0; a < CSP_ST_COUNT; a++)
+        for (int b = 0; b < CSP_ST_COUNT; b++){
+            const Servo_402Edge *e = &s->edge[a][b];
+            if (e->n) fprintf(f, "  %-10s -> %-10s n=%-8u last=%-10u max=%u us\n",
+                              k_402[a].name, k_402[b].name, e->n, e->last_us, e->max_us);
+        }
+}
+
+/* CSP producer (only at OperationEnabled). The target is left unclamped in ax->pos_tgt
+   for the kernel. */
+static int servo_axis_produce(Servo_Axis *ax, int64_t now)
+{
+    if (ax->st != CSP_ST_RUN) return 0;
+    const int64_t late = now - (ax->t0 + LOOP_PERIOD_NS);   /* vs. this tick's nominal time */
+    if (late < -LOOP_SLACK_NS) return 0;
+
+    /* Overrun accounting: `due` periods are owed, 1 when on time */
+    int64_t due = 1;
+    if (late >= LOOP_PERIOD_NS){
+        const int64_t missed = late / LOOP_PERIOD_NS;
+        due += missed;
+        ax->ovr.events++;
+        ax->ovr.missed += (uint64_t)missed;
+        if (late > ax->ovr.worst_late_ns) ax->ovr.worst_late_ns = late;
+    }
+
+    ax->pos_prev = ax->pos_tgt;
+    int64_t used;
+    if (ax->interp || ax->stream || ax->traj){
+        /* Queued source: SKIP takes one sample (the path stretches), CATCHUP takes up
+           to OVERRUN_MAX_CATCHUP within OVERRUN_MAX_DELTA, EXTRAPOLATE jumps to the
+           sample that is due now (the path stays time-correct). */
+#if OVERRUN_POLICY == 1
+        const int64_t want = due < OVERRUN_MAX_CATCHUP ? due : OVERRUN_MAX_CATCHUP;
+        const int32_t bound = OVERRUN_MAX_DELTA;
+#elif OVERRUN_POLICY == 2
+        const int64_t want = due;
+        const int32_t bound = INT32_MAX;
+#else
+        const int64_t want = 1;
+        const int32_t bound = INT32_MAX;
+#endif
+        used = ax->interp ? servo_interp_take(ax, now, want, bound)
+             : ax->stream ? servo_stream_take(ax, want, bound)
+             :              servo_traj_take(ax, want, bound);
+    } else {
+#if OVERRUN_POLICY == 1   /* CATCHUP */
+        used = servo_gen_catchup(ax, due);
+#elif OVERRUN_POLICY == 2 /* EXTRAPOLATE */
+        servo_gen_advance(ax, due, servo_gen_delta(ax));
+        used = due;
+#else                     /* SKIP */
+        servo_gen_advance(ax, 1, servo_gen_delta(ax));
+        used = 1;
+#endif
+    }
+
+    /* Advance on a fixed grid so call jitter does not accumulate into drift.
+       Backlog beyond what the policy may keep resynchronizes to `now`. */
+    ax->t0 += used * LOOP_PERIOD_NS;
+    const int64_t backlog = (now - ax->t0) / LOOP_PERIOD_NS;
+    if (backlog >= (OVERRUN_POLICY == 1 ? OVERRUN_MAX_BACKLOG : 1)){
+        ax->ovr.dropped += (uint64_t)backlog;
+        ax->t0 = now;
+    }
+    return 1;
+}
+
+/* Pass a): read SW, then gating → CiA-402 → producer. Returns 1 when the producer ticked. */
+static int servo_axis_step(Servo_Axis *ax, int64_t now)
+{
+    CSP_PHASE_BEGIN();
+    /* Always read StatusWord safely; 0 means comm/state down → do nothing. */
+    const uint16_t SW = PDO_GET16(ax, status_word);
+    CSP_PHASE_MARK(CSP_PH_READ);
+    if (SW == 0){
+        ax->t0 = now; /* avoid backlog when link returns */
+        ax->link_down = 1;
+        return 0;
+    }
+    servo_axis_gate(ax, SW, now);
+    CSP_PHASE_MARK(CSP_PH_GATING);
+    const int sequencing = servo_axis_cia402(ax, SW, now);
+    CSP_PHASE_MARK(CSP_PH_STATE);
+    if (sequencing) return 0;
+    const int produced = servo_axis_produce(ax, now);
+    CSP_PHASE_MARK(CSP_PH_PRODUCER);
+    return produced;
+}
+
+#if CSP_FF_MAPPED
+static inline int32_t csp_sat32(float v){ return v >= 2147483520.0f ? INT32_MAX : (v <= -2147483648.0f ? INT32_MIN : (int32_t)v); }
+static inline int16_t csp_sat16(float v){ return v >= 32767.0f ? INT16_MAX : (v <= -32768.0f ? INT16_MIN : (int16_t)v); }
+
+/* Feed-forward for the published set-point: velocity/acceleration from the trajectory
+   source (S-curve, stream, interpolator), or differenced from the triangle generator's
+   targets. Zero while the target is held at a limit. */
+static inline void servo_axis_ff(Servo_Axis *ax, int hit)
+{
+    int32_t v = 0, a = 0;
+    if (hit){
+        /* clamped: the target does not move this tick */
+    } else if (ax->interp || ax->stream || ax->traj){
+        v = ax->sp.vel; a = ax->sp.acc;
+    } else {
+        const int64_t v64 = (int64_t)(ax->pos_tgt - ax->pos_prev) * 1000000 / LOOP_PERIOD_US;
+        v = (int32_t)v64;
+        a = (int32_t)((v64 - ax->ff_vel_prev) * 1000000 / LOOP_PERIOD_US);
+    }
+    ax->ff_vel_prev = v;
+#ifdef CSP_PDO_HAS_velocity_offset
+    PDO_SET32(ax, velocity_offset, (uint32_t)csp_sat32(ax->ff_kv * (float)v));
+#endif
+#ifdef CSP_PDO_HAS_torque_offset
+    PDO_SET16(ax, torque_offset, (uint16_t)csp_sat16(ax->ff_ka * (float)a));
+#endif
+}
+
+/* Not producing (sequencing, fault, dwell gating): no offsets on a standing axis. */
+static inline void servo_axis_ff_clear(Servo_Axis *ax)
+{
+    ax->ff_vel_prev = 0;
+#ifdef CSP_PDO_HAS_velocity_offset
+    PDO_SET32(ax, velocity_offset, 0);
+#endif
+#ifdef CSP_PDO_HAS_torque_offset
+    PDO_SET16(ax, torque_offset, 0);
+#endif
+}
+#else
+# define servo_axis_ff(ax, hit)     ((void)0)
+# define servo_axis_ff_clear(ax)    ((void)0)
+#endif
+
+/* Pass c): apply the kernel result for one lane and publish target + CW. */
+static void servo_axis_publish(Servo_Axis *ax, const Servo_AxisSoA *b, size_t lane)
+{
+    ax->pos_tgt = b->target[lane];
+
+    /* Clamp hit → start dwell at the limit */
+    if (b->hit[lane]){ ax->dwell_rem = ax->cfg->dwell_ticks; ax->dir = 0; }
+
+    /* Write target (unaligned + LE safe) and its feed-forward */
+    PDO_SET32(ax, target_position, (uint32_t)ax->pos_tgt);
+    servo_axis_ff(ax, b->hit[lane] != 0);
+    servo_dt_push(ax, ax->pos_tgt);
+
+    /* New set-point edge on CW bit4 */
+    if (ax->cfg->edge_policy == 0){   /* ON_TICK */
+        ax->edge ^= 0x0010;
+    } else {                            /* ON_CHANGE — baseline friendly */
+        if (ax->pos_tgt != ax->pos_prev){ ax->edge ^= 0x0010; }
+    }
+    PDO_SET16(ax, control_word, 0x000F | ax->edge);
+
+    servo_fe_stats_add(ax, b->fe[lane]);
+
+    /* Following-error monitor with hysteresis: the kernel already moved the latch */
+    const uint8_t warn = (uint8_t)(b->warn[lane] != 0);
+    if (warn != ax->fe_warn){
+        if (warn) WARNF("slave %d: FE high: %d", ax->slave_index, b->fe[lane]);
+        else      DBGF("slave %d: FE back: %d", ax->slave_index, b->fe[lane]);
+        ax->fe_warn = warn;
+    }
+}
+
+/* ---- 7c) entry points ---- */
+
+/* Kernel pass b) + publish pass c) for one filled block */
+static void servo_block_finish(Servo_AxisSoA *b, size_t m)
+{
+    CSP_PHASE_BEGIN();
+    csp_kernel(b, m);
+    CSP_PHASE_MARK_N(CSP_PH_FE, m);
+    for (size_t k = 0; k < m; k++) servo_axis_publish(b->axis[k], b, k);
+    CSP_PHASE_MARK_N(CSP_PH_PUBLISH, m);
+}
+#if CSP_PI_SNAPSHOT
+/* Tick start: one block read per axis, so every later read sees the same frame. */
+static void servo_pi_snapshot(Servo_Axis ctx[], size_t n)
+{
+    for (size_t i = 0; i < n; i++){
+        Servo_Axis *ax = &ctx[i];
+        if (!ax->in || !ax->out) continue;
+        memcpy(&ax->pi_in, ax->in, sizeof ax->pi_in);
+        servo_pi_swap_in(&ax->pi_in);
+    }
+}
+
+/* Tick end: one block write (or a buffer flip) per axis. */
+static void servo_pi_publish(Servo_Axis ctx[], size_t n)
+{
+    for (size_t i = 0; i < n; i++){
+        Servo_Axis *ax = &ctx[i];
+        if (!ax->in || !ax->out) continue;
+#if CSP_PDO_SWAP_BATCH
+        Drive_Outputs o = ax->pi_out;          /* wire order for the master */
+        servo_pi_swap_out(&o);
+        const Drive_Outputs *src = &o;
+#else
+        const Drive_Outputs *src = &ax->pi_out;
+#endif
+        if (ax->out_pair[0]){
+            Drive_Outputs *back = ax->out_pair[ax->out_back];
+            memcpy(back, src, sizeof *back);
+            atomic_store_explicit(&ax->out_front, back, memory_order_release);
+            ax->out_back ^= 1;
+        } else {
+            memcpy(ax->out, src, sizeof *ax->out);
+        }
+    }
+}
+#else
+# define servo_pi_snapshot(ctx, n) ((void)0)
+# define servo_pi_publish(ctx, n)  ((void)0)
+#endif
+
+#if CSP_TRACE
+/* After publish: one record per mapped axis into the bound tracer (4d). */
+static void servo_trace_tick(Servo_Axis ctx[], size_t n)
+{
+    Servo_Trace *t = tls_trace;
+    if (!t) return;
+    if (atomic_load_explicit(&t->rearm, memory_order_acquire)){
+        atomic_store_explicit(&t->rearm, 0, memory_order_relaxed);
+        atomic_store_explicit(&t->freeze_at, 0, memory_order_release);
+    }
+    const int64_t late = CSP_CYCLE_STATS ? tls_cycle_stats->last_late_ns : 0;
+    Servo_TraceRecord r;
+    memset(&r, 0, sizeof r);
+    r.tick    = t->tick++;
+    r.late_ns = late > INT32_MAX ? INT32_MAX : (late < INT32_MIN ? INT32_MIN : (int32_t)late);
+    for (size_t i = 0; i < n; i++){
+        Servo_Axis *ax = &ctx[i];
+        if (!ax->in || !ax->out) continue;
+        r.sw     = PDO_GET16(ax, status_word);
+        const uint8_t flags = (uint8_t)(((r.sw & 0x0008) ? CSP_TRACE_F_FAULT : 0) |
+                                        (ax->fe_warn ? CSP_TRACE_F_FE_WARN : 0));
+        const uint8_t rise = (uint8_t)(flags & ~ax->trace_flags);
+        ax->trace_flags = flags;
+        if (servo_trace_frozen(t)) continue;
+        r.axis   = (uint16_t)ax->slave_index;
+        r.st     = (uint8_t)ax->st;
+        r.flags  = servo_trace_trigger(t, flags, rise);
+        r.cw     = PDO_OUT16(ax, control_word);
+        r.target = (int32_t)PDO_OUT32(ax, target_position);
+        r.actual = (int32_t)PDO_GET32(ax, position_actual_value);
+        r.fe     = (int32_t)PDO_GET32(ax, following_error_actual);
+#ifdef CSP_PDO_HAS_error_code
+        r.err    = PDO_GET16(ax, error_code);
+#endif
+        servo_trace_push(t, &r);
+    }
+}
+#else
+# define servo_trace_tick(ctx, n) ((void)0)
+#endif
+
+#if CSP_TELEMETRY
+/* After publish: the whole cell into the bound segment under one seqlock (4e). */
+static void servo_telem_tick(Servo_Axis ctx[], size_t n, int64_t now)
+{
+    Servo_Telemetry *tm = tls_telem;
+    if (!tm || !tm->hdr) return;
+    Servo_TelemetryHeader *h = tm->hdr;
+    const unsigned live = (unsigned)(n < h->axes_cap ? n : h->axes_cap);
+    const uint64_t tick = tm->cycle->tick;
+
+    servo_telem_begin(h);
+    tm->cycle->tick = tick + 1;
+    tm->cycle->t_ns = now;
+    if (CSP_CYCLE_STATS && tick % CSP_TELEMETRY_STATS_EVERY == 0){
+        ServoStats_Summarize(&tls_cycle_stats->exec, &tm->cycle->exec);
+        ServoStats_Summarize(&tls_cycle_stats->late, &tm->cycle->late);
+    }
+    tm->cycle->dc_offset_ns = tls_cycle_stats->dc_offset_ns;
+    tm->cycle->dc_shift_ns  = tls_cycle_stats->dc_shift_ns;
+    tm->cycle->dc_drift_ppb = tls_cycle_stats->dc_drift_ppb;
+    tm->cycle->dc_flags     = tls_cycle_stats->dc_flags;
+    for (unsigned i = 0; i < live; i++){
+        const Servo_Axis *ax = &ctx[i];
+        Servo_TelemetryAxis *o = &tm->axis[i];
+        o->slave   = (uint32_t)ax->slave_index;
+        o->st      = ax->st;
+        o->fe_warn = ax->fe_warn;
+        o->mapped  = ax->in && ax->out;
+        o->ovr_events = ax->ovr.events; o->ovr_missed = ax->ovr.missed;
+        o->ovr_dropped = ax->ovr.dropped; o->ovr_worst_late_ns = ax->ovr.worst_late_ns;
+        if (!o->mapped) continue;
+        o->sw     = PDO_GET16(ax, status_word);
+        o->cw     = PDO_OUT16(ax, control_word);
+        o->target = (int32_t)PDO_OUT32(ax, target_position);
+        o->actual = (int32_t)PDO_GET32(ax, position_actual_value);
+        o->fe     = (int32_t)PDO_GET32(ax, following_error_actual);
+#ifdef CSP_PDO_HAS_error_code
+        o->err    = PDO_GET16(ax, error_code);
+#endif
+#if CSP_FE_STATS
+        const Servo_FeStats *fs = &ax->fe_stats;
+        o->fe_windows = fs->windows;
+        o->fe_min = fs->min; o->fe_max = fs->max; o->fe_mean = fs->mean; o->fe_rms = fs->rms;
+        o->fe_p50 = fs->p50; o->fe_p90 = fs->p90; o->fe_p99 = fs->p99; o->fe_p999 = fs->p999;
+        o->fe_cur_n = ax->fe_acc.n; o->fe_cur_min = ax->fe_acc.min; o->fe_cur_max = ax->fe_acc.max;
+#endif
+    }
+    atomic_store_explicit(&h->axes_live, live, memory_order_relaxed);
+    servo_telem_end(h);
+}
+#else
+# define servo_telem_tick(ctx, n, now) ((void)0)
+#endif
+
+#if CSP_RECORD
+/* Output image the frame carries this tick (the front buffer with a pair). */
+static inline const uint8_t *servo_rec_out_image(Servo_Axis *ax)
+{
+#if CSP_PI_SNAPSHOT
+    if (ax->out_pair[0]) return (const uint8_t*)atomic_load_explicit(&ax->out_front, memory_order_relaxed);
+#endif
+    return (const uint8_t*)ax->out;
+}
+
+/* Knobs and layouts a replay must share with the recording (FNV-1a). */
+static uint32_t servo_rec_build_hash(void)
+{
+    Servo_AxisConfig c;
+    memset(&c, 0, sizeof c);
+    ServoConfig_Defaults(&c);
+    const int64_t k[] = { (int64_t)sizeof(Drive_Inputs), (int64_t)sizeof(Drive_Outputs), LOOP_PERIOD_US,
+                          RAMP_SHAPE, OVERRUN_POLICY, OVERRUN_MAX_CATCHUP, OVERRUN_MAX_DELTA,
+                          OVERRUN_MAX_BACKLOG, CSP_DEADTIME_TICKS, CSP_FF_MAPPED };
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof k; i++) h = (h ^ ((const uint8_t*)k)[i]) * 16777619u;
+    for (size_t i = 0; i < offsetof(Servo_AxisConfig, dwell_ticks); i++) h = (h ^ ((const uint8_t*)&c)[i]) * 16777619u;
+    return h;
+}
+
+/* Create `path` for the ticks of `ctx[0..n)` (the array later passed to RunBatch, or
+   &g_axis for ServoTemplate_Run — use ServoRecord_OpenSingle). Open right after Init,
+   before the first tick, then ServoRecord_Bind() in the cyclic thread. Non-RT. */
+int ServoRecord_Open(Servo_Recorder *r, const char *path, Servo_Axis ctx[], size_t n)
+{
+    const size_t in = sizeof(Drive_Inputs), out = sizeof(Drive_Outputs);
+    memset(r, 0, offsetof(Servo_Recorder, ring));
+    r->ctx      = ctx;
+    r->axes     = n;
+    r->frame    = malloc(10 + n * (CSP_REC_MASK_BYTES(in) + in + CSP_REC_MASK_BYTES(out) + out));
+    r->prev_in  = calloc(n ? n : 1, in);
+    r->prev_out = calloc(n ? n : 1, out);
+    r->mapped   = calloc(n ? n : 1, 1);
+    r->f        = (r->frame && r->prev_in && r->prev_out && r->mapped) ? fopen(path, "wb") : NULL;
+    if (!r->f){ ServoRecord_Close(r); return -1; }
+
+    Servo_RecHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, "CSPRECRD", 8);
+    h.version     = CSP_REC_VERSION;
+    h.header_size = (uint32_t)(sizeof h + n * (8 + out));
+    h.axes        = (uint32_t)n;
+    h.in_size     = (uint32_t)in;
+    h.out_size    = (uint32_t)out;
+    h.period_us   = LOOP_PERIOD_US;
+    h.flags       = ctx == &g_axis ? CSP_REC_F_SINGLE : 0;
+    h.build_hash  = servo_rec_build_hash();
+    h.t_open_ns   = now_ns();
+    r->prev_ns    = h.t_open_ns;
+    int ok = fwrite(&h, sizeof h, 1, r->f) == 1;
+    for (size_t i = 0; i < n && ok; i++){
+        const int32_t  slave  = ctx[i].slave_index;
+        const uint32_t mapped = ctx[i].in && ctx[i].out;
+        r->mapped[i] = (uint8_t)mapped;
+        if (mapped) memcpy(r->prev_out + i * out, servo_rec_out_image(&ctx[i]), out);
+        ok = fwrite(&slave, 4, 1, r->f) == 1 && fwrite(&mapped, 4, 1, r->f) == 1 &&
+             fwrite(r->prev_out + i * out, out, 1, r->f) == 1;
+    }
+    if (!ok){ ServoRecord_Close(r); return -1; }
+    return 0;
+}
+
+/* The single-axis entry (ServoTemplate_Init + ServoTemplate_Run). */
+int ServoRecord_OpenSingle(Servo_Recorder *r, const char *path){ return ServoRecord_Open(r, path, &g_axis, 1); }
+
+/* Tick start, before the snapshot: time and inputs of every mapped axis (4g). */
+static void servo_rec_begin(Servo_Axis ctx[], size_t n, int64_t now)
+{
+    Servo_Recorder *r = tls_rec;
+    if (!r || atomic_load_explicit(&r->stopped, memory_order_relaxed)) return;
+    if ((const void*)ctx != r->ctx || n != r->axes){ atomic_store_explicit(&r->stopped, 1, memory_order_relaxed); return; }
+    const size_t in = sizeof(Drive_Inputs);
+    r->fpos = servo_rec_varint(r->frame, now - r->prev_ns - LOOP_PERIOD_NS);
+    r->prev_ns = now;
+    for (size_t i = 0; i < n; i++){
+        if ((ctx[i].in && ctx[i].out) != r->mapped[i]){ atomic_store_explicit(&r->stopped, 1, memory_order_relaxed); return; }
+        if (r->mapped[i])
+            r->fpos += servo_rec_delta(r->frame + r->fpos, r->prev_in + i * in, (const uint8_t*)ctx[i].in, in);
+    }
+}
+
+/* After publish: the outputs, then commit the frame. */
+static void servo_rec_end(Servo_Axis ctx[], size_t n)
+{
+    Servo_Recorder *r = tls_rec;
+    if (!r || atomic_load_explicit(&r->stopped, memory_order_relaxed) || (const void*)ctx != r->ctx) return;
+    const size_t out = sizeof(Drive_Outputs);
+    for (size_t i = 0; i < n; i++)
+        if (r->mapped[i])
+            r->fpos += servo_rec_delta(r->frame + r->fpos, r->prev_out + i * out, servo_rec_out_image(&ctx[i]), out);
+    servo_rec_push(r);
+}
+#else
+# define servo_rec_begin(ctx, n, now) ((void)0)
+# define servo_rec_end(ctx, n)        ((void)0)
+#endif
+
+static void servo_run_axes(Servo_Axis ctx[], size_t n, int64_t now)
+{
+    Servo_AxisSoA b;
+    size_t m = 0;
+
+    CSP_LOG_TICK();
+    servo_rec_begin(ctx, n, now);
+    servo_pi_snapshot(ctx, n);
+
+    for (size_t i = 0; i < n; i++){
+        Servo_Axis *ax = &ctx[i];
+        if (!ax->in || !ax->out) continue;       /* unmapped axes are skipped */
+        servo_cfg_poll(ax);
+        servo_dt_observe(ax, (int32_t)PDO_GET32(ax, position_actual_value));
+        if (!servo_axis_step(ax, now)){
+            servo_axis_ff_clear(ax);
+            servo_dt_push(ax, (int32_t)PDO_OUT32(ax, target_position));
+            continue;
+        }
+
+        /* Gather the producing axis into the next dense lane */
+        CSP_PHASE_BEGIN();
+        b.axis[m]   = ax;
+        b.target[m] = ax->pos_tgt;
+        b.actual[m] = (int32_t)PDO_GET32(ax, position_actual_value);
+        b.fe[m]     = (int32_t)PDO_GET32(ax, following_error_actual);
+        b.warn[m]   = -(int32_t)ax->fe_warn;
+        b.lim[m]    = ax->cfg->limit_pos;
+        b.wth[m]    = ax->cfg->fe_warn_th;
+        b.oth[m]    = ax->cfg->fe_ok_th;
+#if CSP_DEADTIME_RING
+        b.delayed[m] = servo_dt_target(ax);
+        b.dtm[m]     = -(int32_t)(ax->dt_ticks != 0);
+#else
+        b.delayed[m] = 0;
+        b.dtm[m]     = 0;
+#endif
+        CSP_PHASE_MARK_N(CSP_PH_FE, 0);          /* counted with the block's kernel call */
+        if (++m == CSP_SOA_LANES){
+            servo_block_finish(&b, m);
+            m = 0;
+        }
+    }
+    if (m) servo_block_finish(&b, m);
+    servo_pi_publish(ctx, n);
+    servo_rec_end(ctx, n);
+    servo_trace_tick(ctx, n);
+    servo_telem_tick(ctx, n, now);
+}
+
+void ServoTemplate_Run(EcDevice dev)
+{
+    (void)dev;
+    if (!g_axis.in || !g_axis.out) return; /* Not mapped yet → nothing to do */
+    const int64_t now = now_ns();
+    const int64_t t   = servo_stats_begin(now);
+    servo_run_axes(&g_axis, 1, now);
+    servo_stats_end(t);
+}
+
+/* Step every axis of a cell in one pass. `ctx` is a contiguous array (one entry per
+   drive, each initialized with ServoAxis_Init); call it once per period from your
+   cyclic task instead of ServoTemplate_Run. Unmapped axes are skipped. */
+void ServoTemplate_RunBatch(Servo_Axis ctx[], size_t n)
+{
+    const int64_t now = now_ns();
+    const int64_t t   = servo_stats_begin(now);
+    servo_run_axes(ctx, n, now);
+    servo_stats_end(t);
+}
+
+#if CSP_RECORD
+/* Replay driver for recordings of 4g: the axes run on images owned by the replay, on the
+   recorded clock, through the entry point that was recorded. Single-threaded. */
+#define CSP_REC_IMG_MAX        1024   /* largest image a replay accepts (bytes)               */
+_Static_assert(sizeof(Drive_Inputs) <= CSP_REC_IMG_MAX && sizeof(Drive_Outputs) <= CSP_REC_IMG_MAX,
+               "raise CSP_REC_IMG_MAX for this layout");
+
+typedef struct {
+    FILE           *f;
+    Servo_RecHeader h;
+    Servo_Axis     *ax;                /* axes being replayed (yours, g_axis, or `own`)        */
+    Servo_Axis     *own;               /* allocated by Open when no array was given            */
+    size_t          n, stride;
+    uint8_t        *img;               /* per axis: input image, output image (stride apart)   */
+    uint8_t        *want;              /* per axis: recorded outputs                           */
+    uint8_t        *mapped;
+    int64_t         now;
+    uint64_t        frames;            /* ticks replayed                                       */
+    uint64_t        mismatches;        /* ticks with at least one differing output byte        */
+    uint64_t        first_tick;        /* first mismatch: tick, slave, byte in Drive_Outputs,   */
+    int             first_slave;       /* recorded / replayed value                            */
+    int             first_byte;
+    uint8_t         first_want, first_got;
+    size_t          rpos, rlen;
+    uint8_t         rbuf[1 << 16];
+} Servo_Replay;
+
+static inline int servo_rp_byte(Servo_Replay *rp)
+{
+    if (rp->rpos == rp->rlen){
+        rp->rlen = fread(rp->rbuf, 1, sizeof rp->rbuf, rp->f);
+        rp->rpos = 0;
+        if (!rp->rlen) return -1;
+    }
+    return rp->rbuf[rp->rpos++];
+}
+
+static int servo_rp_varint(Servo_Replay *rp, int64_t *v)
+{
+    uint64_t z = 0;
+    for (unsigned sh = 0; sh < 64; sh += 7){
+        const int c = servo_rp_byte(rp);
+        if (c < 0) return -1;
+        z |= (uint64_t)(c & 0x7F) << sh;
+        if (!(c & 0x80)){ *v = (int64_t)(z >> 1) ^ -(int64_t)(z & 1); return 0; }
+    }
+    return -1;
+}
+
+/* Apply one delta onto `img` (the previous bytes). 0, or -1 at end of file. */
+static int servo_rp_delta(Servo_Replay *rp, uint8_t *img, size_t len)
+{
+    uint8_t m[CSP_REC_MASK_BYTES(CSP_REC_IMG_MAX)];
+    for (size_t k = 0; k < CSP_REC_MASK_BYTES(len); k++){
+        const int c = servo_rp_byte(rp);
+        if (c < 0) return -1;
+        m[k] = (uint8_t)c;
+    }
+    for (size_t j = 0; j < len; j++){
+        if (!(m[j >> 3] & (1u << (j & 7)))) continue;
+        const int c = servo_rp_byte(rp);
+        if (c < 0) return -1;
+        img[j] = (uint8_t)c;
+    }
+    return 0;
+}
+
+void ServoReplay_Close(Servo_Replay *rp)
+{
+    if (rp->f) fclose(rp->f);
+    free(rp->img); free(rp->want); free(rp->mapped); free(rp->own);
+    rp->f = NULL; rp->img = rp->want = rp->mapped = NULL; rp->own = NULL;
+    ServoClock_Inject(0);
+}
+
+/* Open a recording and set up its axes in `ctx[0..cap)` (NULL: allocated here; ignored
+   for a single-axis recording, which replays into g_axis). Attach configs / sources
+   before ServoReplay_Run. Injects the clock. 0, or -1 (logged). */
+int ServoReplay_Open(Servo_Replay *rp, const char *path, Servo_Axis ctx[], size_t cap)
+{
+    const size_t in = sizeof(Drive_Inputs), out = sizeof(Drive_Outputs);
+    memset(rp, 0, offsetof(Servo_Replay, rbuf));
+    rp->f = fopen(path, "rb");
+    if (!rp->f || fread(&rp->h, sizeof rp->h, 1, rp->f) != 1 || memcmp(rp->h.magic, "CSPRECRD", 8) != 0 ||
+        rp->h.version != CSP_REC_VERSION){
+        ERRF("replay: not a recording (version %u)", (unsigned)rp->h.version);
+        ServoReplay_Close(rp);
+        return -1;
+    }
+    const uint32_t hash = servo_rec_build_hash();
+    if (rp->h.in_size != in || rp->h.out_size != out || rp->h.period_us != LOOP_PERIOD_US ||
+        rp->h.build_hash != hash){
+        ERRF("replay: recorded by another build (period %u us, images %u/%u, knobs 0x%08X)",
+             (unsigned)rp->h.period_us, (unsigned)rp->h.in_size, (unsigned)rp->h.out_size,
+             (unsigned)rp->h.build_hash);
+        ServoReplay_Close(rp);
+        return -1;
+    }
+    rp->n = rp->h.axes;
+    if (rp->h.flags & CSP_REC_F_SINGLE)  rp->ax = rp->n == 1 ? &g_axis : NULL;
+    else if (ctx)                        rp->ax = rp->n <= cap ? ctx : NULL;
+    else                                 rp->ax = rp->own = aligned_alloc(CSP_CACHE_LINE, (rp->n ? rp->n : 1) * sizeof *rp->own);
+    rp->stride = ((in > out ? in : out) + CSP_CACHE_LINE - 1) & ~(size_t)(CSP_CACHE_LINE - 1);
+    rp->img    = aligned_alloc(CSP_CACHE_LINE, (rp->n ? rp->n : 1) * 2 * rp->stride);
+    rp->want   = malloc((rp->n ? rp->n : 1) * out);
+    rp->mapped = malloc(rp->n ? rp->n : 1);
+    if (!rp->ax || !rp->img || !rp->want || !rp->mapped){
+        ERRF("replay: %u axes do not fit (cap %zu) or out of memory", (unsigned)rp->n, cap);
+        ServoReplay_Close(rp);
+        return -1;
+    }
+    memset(rp->img, 0, rp->n * 2 * rp->stride);
+    for (size_t i = 0; i < rp->n; i++){
+        int32_t slave; uint32_t mapped;
+        uint8_t *ii = rp->img + 2 * i * rp->stride, *oi = ii + rp->stride;
+        if (fread(&slave, 4, 1, rp->f) != 1 || fread(&mapped, 4, 1, rp->f) != 1 ||
+            fread(rp->want + i * out, out, 1, rp->f) != 1){
+            ERRF("replay: truncated axis table (axis %zu)", i);
+            ServoReplay_Close(rp);
+            return -1;
+        }
+        memcpy(oi, rp->want + i * out, out);
+        rp->mapped[i] = (uint8_t)(mapped != 0);
+        if (!mapped) servo_axis_defaults(&rp->ax[i], slave);
+        else (void)ServoAxis_InitImages(&rp->ax[i], slave, (Drive_Inputs*)ii, (Drive_Outputs*)oi);
+    }
+    fseek(rp->f, (long)rp->h.header_size, SEEK_SET);
+    rp->now = rp->h.t_open_ns;
+    ServoClock_Inject(1);
+    ServoClock_Set(rp->now);
+    return 0;
+}
+
+/* One recorded tick: inputs in, tick, outputs compared. 1 = done, 0 = end of recording,
+   -1 = truncated frame (a recording cut short by a crash ends like this). */
+int ServoReplay_Step(Servo_Replay *rp)
+{
+    const size_t in = sizeof(Drive_Inputs), out = sizeof(Drive_Outputs);
+    int64_t dt;
+    if (servo_rp_varint(rp, &dt) != 0) return 0;
+    rp->now += dt + LOOP_PERIOD_NS;
+    for (size_t i = 0; i < rp->n; i++)
+        if (rp->mapped[i] && servo_rp_delta(rp, rp->img + 2 * i * rp->stride, in) != 0) return -1;
+
+    ServoClock_Set(rp->now);
+    if (rp->h.flags & CSP_REC_F_SINGLE) ServoTemplate_Run(NULL);
+    else                                ServoTemplate_RunBatch(rp->ax, rp->n);
+
+    int bad = 0;
+    for (size_t i = 0; i < rp->n; i++){
+        if (!rp->mapped[i]) continue;
+        uint8_t *w = rp->want + i * out;
+        if (servo_rp_delta(rp, w, out) != 0) return -1;
+        const uint8_t *got = servo_rec_out_image(&rp->ax[i]);
+        if (memcmp(w, got, out) == 0 || bad++ || rp->mismatches) continue;
+        size_t j = 0;
+        while (w[j] == got[j]) j++;
+        rp->first_tick  = rp->frames;
+        rp->first_slave = rp->ax[i].slave_index;
+        rp->first_byte  = (int)j;
+        rp->first_want  = w[j];
+        rp->first_got   = got[j];
+    }
+    rp->frames++;
+    if (bad) rp->mismatches++;
+    return 1;
+}
+
+/* The whole recording, as fast as it goes. Returns the ticks whose outputs differed. */
+uint64_t ServoReplay_Run(Servo_Replay *rp)
+{
+    int rc;
+    while ((rc = ServoReplay_Step(rp)) > 0) {}
+    if (rc < 0) WARNF("replay: recording ends in a truncated frame after tick %llu", (unsigned long long)rp->frames);
+    return rp->mismatches;
+}
+#endif /* CSP_RECORD */
+
+/* ==============================================================
+   8) FAULT RECOVERY (where the policy lives)
+   ==============================================================
+
+   The CiA-402 engine (7b, k_402) owns it; tune it per axis through the runtime config:
+   • fault_cool_ms [FAULT_COOLDOWN_MS]: Shutdown hold after a fault clears, timed from
+     the engine's own state clock (not from the producer's t0).
+   • comm_cool_ms [COMM_COOLDOWN_MS]: the same after the link returns (SW was 0).
+   • retries: a fault within retry_window_ms of reaching OperationEnabled (or a step
+     timeout) is a failed attempt; the cooldown doubles per attempt up to backoff_max_ms,
+     and after retry_max attempts the axis holds Shutdown in CSP_ST_LOCKED until
+     ServoAxis_ClearFault() (an HMI button, a PLC ack …).
+   • fast_reenable: the first attempt skips the cooldown and the separate SwitchOn step.
+     Targets are still re-aligned to the actual position before enabling (a drive that
+     coasted must not jump); for a smaller step on a moving axis use the dead-time
+     prediction (5f).
+   • a drive that leaves OperationEnabled without a fault (SW & 0x006F ≠ 0x0027: it fell
+     to SwitchedOn, QuickStopActive, …) stops the producer at once; the targets are
+     re-aligned to 6064 and the axis re-enables from SwitchedOn, or through Shutdown
+     (counted in s402.drops).
+   ServoAxis_Print402() shows where the time goes per transition (e.g. 40 drives that
+   all wait 250 ms in Cooldown).
+*/
+
+/* ==============================================================
+   9) REFERENCE CYCLIC TASK (optional, CSP_WITH_RUNNER=1)
+   ==============================================================
+
+   WHAT: a POSIX RT thread that calls your tick (ServoTemplate_Run or RunBatch) on a fixed
+   absolute deadline grid: clock_nanosleep(TIMER_ABSTIME) + next += period.
+   WHY: sleeping a *relative* period adds the tick's own runtime and wake-up latency every
+   cycle, so the loop drifts; an absolute grid only jitters around the ideal instant.
+   Setup done once: mlockall (no page faults later), SCHED_FIFO priority, CPU pinning and a
+   pre-touched stack. Needs CAP_SYS_NICE/root for SCHED_FIFO; otherwise it warns and runs
+   with the default policy (fine for tests, not for a machine).
+   With dc_read set, the grid is additionally steered onto the distributed clock (4h):
+   each deadline moves by the controller's correction, so the host follows the reference
+   clock's rate instead of beating against SYNC0.
+*/
+#if CSP_WITH_RUNNER
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define CSP_RUNNER_PREFAULT_BYTES  (256u * 1024u)  /* stack touched before the first tick */
+#define CSP_CPU(n)                 ((n) + 1)        /* Servo_Runner.pin_cpu for CPU n        */
+
+typedef struct {
+    /* Configure before ServoRunner_Start() */
+    int64_t  period_ns;                /* tick period (default LOOP_PERIOD_NS when 0)          */
+    int      priority;                 /* SCHED_FIFO priority 1..99 (0 = keep default policy)  */
+    int      pin_cpu;                  /* CSP_CPU(n) pins to CPU n; 0 = no pinning (a zeroed
+                                          runner must not land on CPU 0 by accident)          */
+    void   (*tick)(void *user);        /* called once per period                               */
+    void   (*on_start)(void *user);    /* optional, once in the thread before the first tick   */
+    void    *user;
+    int64_t  start_ns;                 /* first deadline (CLOCK_MONOTONIC); 0 = now + period.
+                                          Runners given the same start stay on one grid.       */
+    /* Optional DC lock (4h): after each tick, the DC time of its frame (0 = ok). NULL = the
+       plain CLOCK_MONOTONIC grid. ServoDc_ReadMaster (user = EcDevice) uses dc_time(). */
+    int    (*dc_read)(void *dc_user, int64_t *dc_ns);
+    void    *dc_user;
+    Servo_DcSync dc;                   /* Start() runs ServoDc_Init unless dc.period_ns is set
+                                          (your own Init + tuning); then offset/drift/locked */
+
+    /* Runtime (read from other threads) */
+    _Atomic uint64_t cycles;           /* ticks executed                                       */
+    _Atomic uint64_t overruns;         /* deadlines already past when we were done → skipped   */
+    _Atomic int      running;
+    pthread_t        thread;
+    int64_t          deadline_ns;      /* deadline of the tick in progress (for the tick only) */
+} Servo_Runner;
+
+/* Ready-made ticks: `user` = EcDevice for the single-axis API, or a Servo_AxisSet. */
+typedef struct { Servo_Axis *ctx; size_t n; } Servo_AxisSet;
+
+void ServoRunner_TickSingle(void *user){ ServoTemplate_Run((EcDevice)user); }
+void ServoRunner_TickBatch (void *user){
+    Servo_AxisSet *set = (Servo_AxisSet*)user;
+    ServoTemplate_RunBatch(set->ctx, set->n);
+}
+
+static inline struct timespec ns_to_ts(int64_t t){
+    struct timespec ts = { (time_t)(t / 1000000000LL), (long)(t % 1000000000LL) };
+    return ts;
+}
+
+/* Touch the stack once so the first RT ticks do not page-fault (with mlockall it stays). */
+static __attribute__((noinline)) void servo_runner_prefault(void)
+{
+    volatile uint8_t buf[CSP_RUNNER_PREFAULT_BYTES];
+    for (size_t i = 0; i < sizeof buf; i += 256) buf[i] = 0;
+}
+
+static void *servo_runner_main(void *arg)
+{
+    Servo_Runner *r = (Servo_Runner*)arg;
+    servo_runner_prefault();
+    if (r->on_start) r->on_start(r->user);
+
+    int64_t next = now_ns() + r->period_ns;
+    if (r->start_ns){                  /* join the shared grid at its next slot */
+        const int64_t now = next - r->period_ns;
+        next = r->start_ns;
+        if (next <= now) next += ((now - next) / r->period_ns + 1) * r->period_ns;
+    }
+    while (atomic_load_explicit(&r->running, memory_order_relaxed)){
+        const struct timespec dl = ns_to_ts(next);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &dl, NULL) != 0){ /* EINTR: retry */ }
+
+        ServoStats_ExpectStart(next);
+        r->deadline_ns = next;
+        r->tick(r->user);
+        atomic_store_explicit(&r->cycles,
+            atomic_load_explicit(&r->cycles, memory_order_relaxed) + 1, memory_order_relaxed);
+
+        /* Next deadline is fixed by the grid, never by "now". If already past, skip the
+           missed slots (staying on the grid) and count them. */
+        next += r->period_ns;
+        if (r->dc_read){
+            int64_t dc;
+            if (r->dc_read(r->dc_user, &dc) == 0) next += ServoDc_Update(&r->dc, dc);
+            else ServoDc_Lost(&r->dc);
+        }
+        const int64_t now = now_ns();
+        if (now >= next){
+            const int64_t missed = (now - next) / r->period_ns + 1;
+            next += missed * r->period_ns;
+            atomic_store_explicit(&r->overruns,
+                atomic_load_explicit(&r->overruns, memory_order_relaxed) + (uint64_t)missed,
+                memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+/* Start the RT thread. Returns 0 on success, -1 (logged) if the thread could not be
+   created. A refused SCHED_FIFO falls back to the default policy; a refused pin_cpu does
+   not: a cyclic task silently sharing a core is worse than one that does not start. */
+int ServoRunner_Start(Servo_Runner *r)
+{
+    if (!r->tick) return -1;
+    if (r->period_ns <= 0) r->period_ns = LOOP_PERIOD_NS;
+    if (r->dc_read){
+        if (r->dc.period_ns <= 0) ServoDc_Init(&r->dc, r->period_ns);
+        if (r->dc.period_ns != r->period_ns || r->period_ns != LOOP_PERIOD_NS)
+            WARNF("DC lock: runner %lld ns / DC %lld ns / 60C2:1 %lld ns differ — SYNC0 will beat",
+                  (long long)r->period_ns, (long long)r->dc.period_ns, (long long)LOOP_PERIOD_NS);
+    }
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        WARNF("mlockall failed — page faults may hit the cyclic task");
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (r->priority > 0){
+        struct sched_param sp = { .sched_priority = r->priority };
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &sp);
+    }
+    if (r->pin_cpu > 0){
+        cpu_set_t cs; CPU_ZERO(&cs); CPU_SET(r->pin_cpu - 1, &cs);
+        pthread_attr_setaffinity_np(&attr, sizeof cs, &cs);
+    }
+
+    atomic_store(&r->running, 1);
+    int rc = pthread_create(&r->thread, &attr, servo_runner_main, r);
+    if (rc != 0 && r->priority > 0){
+        WARNF("SCHED_FIFO %d refused (rc=%d) — running with default policy", r->priority, rc);
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        rc = pthread_create(&r->thread, &attr, servo_runner_main, r);
+    }
+    pthread_attr_destroy(&attr);
+    if (rc != 0){
+        atomic_store(&r->running, 0);
+        if (r->pin_cpu > 0) ERRF("runner: thread not started on CPU %d (rc=%d) — CPU offline or outside the cpuset?",
+                                 r->pin_cpu - 1, rc);
+        else                ERRF("runner: thread not started (rc=%d)", rc);
+        return -1;
+    }
+    return 0;
+}
+
+void ServoRunner_Stop(Servo_Runner *r)
+{
+    if (!atomic_exchange(&r->running, 0)) return;
+    pthread_join(r->thread, NULL);
+}
+
+/* Background service for runtime CoE requests (6b): a plain (non-RT) thread that runs
+   ServoSdo_Service() every `poll_us` µs. */
+typedef struct {
+    Servo_SdoQueue  *q;
+    EcDevice         dev;
+    unsigned         poll_us;
+    _Atomic int      running;
+    pthread_t        thread;
+} Servo_SdoService;
+
+static void *servo_sdo_service_main(void *arg)
+{
+    Servo_SdoService *s = (Servo_SdoService*)arg;
+    const struct timespec ts = { (time_t)(s->poll_us / 1000000u), (long)(s->poll_us % 1000000u) * 1000L };
+    while (atomic_load_explicit(&s->running, memory_order_relaxed)){
+        (void)ServoSdo_Service(s->q, s->dev);
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+int ServoSdo_StartService(Servo_SdoService *s, Servo_SdoQueue *q, EcDevice dev, unsigned poll_us)
+{
+    s->q = q; s->dev = dev; s->poll_us = poll_us ? poll_us : 500;
+    atomic_store(&s->running, 1);
+    if (pthread_create(&s->thread, NULL, servo_sdo_service_main, s) != 0){ atomic_store(&s->running, 0); return -1; }
+    return 0;
+}
+
+void ServoSdo_StopService(Servo_SdoService *s)
+{
+    if (!atomic_exchange(&s->running, 0)) return;
+    pthread_join(s->thread, NULL);
+}
+
+/* Background producer for the S-curve generators (5b) of a cell: a plain (non-RT) thread
+   that runs ServoTraj_Service() on every axis with a Servo_Traj every `poll_us` µs. Keep
+   poll_us well under SETPOINT_RING periods (default: a quarter of them). */
+typedef struct {
+    Servo_Axis      *ax;
+    size_t           n;
+    unsigned         poll_us;
+    _Atomic int      running;
+    pthread_t        thread;
+} Servo_TrajService;
+
+static void *servo_traj_service_main(void *arg)
+{
+    Servo_TrajService *s = (Servo_TrajService*)arg;
+    const struct timespec ts = { (time_t)(s->poll_us / 1000000u), (long)(s->poll_us % 1000000u) * 1000L };
+    while (atomic_load_explicit(&s->running, memory_order_relaxed)){
+        for (size_t i = 0; i < s->n; i++)
+            if (s->ax[i].traj) while (ServoTraj_Service(s->ax[i].traj) > 0){}
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+int ServoTraj_StartService(Servo_TrajService *s, Servo_Axis ax[], size_t n, unsigned poll_us)
+{
+    s->ax = ax; s->n = n;
+    s->poll_us = poll_us ? poll_us : (unsigned)(SETPOINT_RING / 4 * LOOP_PERIOD_US);
+    atomic_store(&s->running, 1);
+    if (pthread_create(&s->thread, NULL, servo_traj_service_main, s) != 0){ atomic_store(&s->running, 0); return -1; }
+    return 0;
+}
+
+void ServoTraj_StopService(Servo_TrajService *s)
+{
+    if (!atomic_exchange(&s->running, 0)) return;
+    pthread_join(s->thread, NULL);
+}
+
+/* ---- 9b) Multi-core sharding ----
+
+   WHAT: split one cell's axes into N contiguous slices ("shards"), each ticked by its own
+   pinned runner on a common deadline grid, and let the thread that sends the frame
+   collect them without a barrier.
+   HOW: a shard owns its Servo_Axis slice (each context is cache-line padded, so slices
+   never share a line), its own cycle stats, phase profile and log ring (bound in its
+   thread), and one cache line holding `done_slot` — the deadline of the last tick it
+   finished, published with a release store. Shards never wait for each other. The
+   frame thread runs later in the period (its own runner, or the master's callback) and
+   calls ServoShards_Wait(set, slot, give_up_at): it polls the done lines (acquire) until
+   every shard reached `slot`, or the give-up time passes — late shards are counted as
+   stragglers.
+   What a straggler's slice of the frame holds depends on how its axes publish: with
+   output pairs (ServoAxis_SetOutputPair) the tick writes the back image and the frame
+   reads the front one, so it goes out with the previous outputs, whole. With block copy
+   the tick writes the image the frame is built from, and a straggler caught mid-tick
+   would put torn outputs (half this tick, half the last) on the wire. So each shard also
+   keeps `seq`, odd while a tick runs: at give-up, Wait keeps polling a block-copy shard
+   whose `seq` is odd until the tick ends, at most one more period (`torn` counts the ones
+   that still had not). That closes the mid-copy case only — a block-copy straggler that
+   starts its tick after Wait returned still writes while the frame is built. Cells whose
+   shards can miss should use output pairs.
+   Rules: an interpolation group (5d) must live in one shard; with CSP_PI_SNAPSHOT each
+   axis only touches its own image block, but blocks of different shards in one cache
+   line still ping-pong between cores — ServoShards_Init() warns about those. */
+#define CSP_MAX_SHARDS         8
+
+typedef struct {
+    Servo_Runner      runner;
+    Servo_Axis       *ctx;             /* this shard's slice                                   */
+    size_t            n;
+    int               copy_out;        /* some axis block-copies its outputs (no pair)         */
+    Servo_CycleStats  stats;
+#if CSP_PROFILE_PHASES
+    Servo_PhaseProfile prof;
+#endif
+#if CSP_LOG_DEFERRED
+    Servo_LogRing     log;
+#endif
+    _Alignas(CSP_CACHE_LINE)
+    _Atomic int64_t   done_slot;       /* deadline (ns) of the last finished tick              */
+    _Atomic uint32_t  seq;             /* odd while a tick runs                                */
+    _Alignas(CSP_CACHE_LINE)
+    char              pad_;            /* keep the next shard off done_slot's line             */
+} Servo_Shard;
+
+typedef struct {
+    Servo_Shard      shard[CSP_MAX_SHARDS];
+    int              n;
+    int64_t          period_ns;
+    int64_t          start_ns;         /* grid origin, set by ServoShards_Start()              */
+    /* frame-thread counters (one writer, readable anywhere) */
+    _Atomic uint64_t frames;           /* ServoShards_Wait() calls                             */
+    _Atomic uint64_t late_frames;      /* … that gave up on at least one shard                 */
+    _Atomic uint64_t stragglers;       /* shard-ticks missing at give-up time, summed          */
+    _Atomic uint64_t torn;             /* … of them block-copy and still mid-tick after a period */
+} Servo_ShardSet;
+
+static void servo_shard_start(void *user)
+{
+    Servo_Shard *sh = (Servo_Shard*)user;
+    ServoStats_Bind(&sh->stats);
+#if CSP_PROFILE_PHASES
+    ServoProfile_Bind(&sh->prof);
+#endif
+#if CSP_LOG_DEFERRED
+    if (ServoLog_BindRing(&sh->log) != 0) WARNF("shard: no free log ring slot, logging to the default ring");
+#endif
+}
+
+static void servo_shard_tick(void *user)
+{
+    Servo_Shard *sh = (Servo_Shard*)user;
+    const uint32_t q = atomic_load_explicit(&sh->seq, memory_order_relaxed);
+    atomic_store_explicit(&sh->seq, q + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);     /* odd before any output store */
+    ServoTemplate_RunBatch(sh->ctx, sh->n);
+    atomic_store_explicit(&sh->done_slot, sh->runner.deadline_ns, memory_order_release);
+    atomic_store_explicit(&sh->seq, q + 2, memory_order_release);
+}
+
+/* Count cache lines shared by image blocks of axes in different shards. */
+static size_t servo_shard_shared_lines(const Servo_ShardSet *set)
+{
+    size_t shared = 0;
+    for (int a = 0; a < set->n; a++)
+        for (size_t i = 0; i < set->shard[a].n; i++){
+            const Servo_Axis *x = &set->shard[a].ctx[i];
+            if (!x->in || !x->out) continue;
+            for (int b = a + 1; b < set->n; b++)
+                for (size_t j = 0; j < set->shard[b].n; j++){
+                    const Servo_Axis *y = &set->shard[b].ctx[j];
+                    if (!y->in || !y->out) continue;
+                    const uintptr_t L = CSP_CACHE_LINE;
+                    const uintptr_t xs[2][2] = { { (uintptr_t)x->in,  (uintptr_t)x->in  + sizeof(Drive_Inputs)  - 1 },
+                                                 { (uintptr_t)x->out, (uintptr_t)x->out + sizeof(Drive_Outputs) - 1 } };
+                    const uintptr_t ys[2][2] = { { (uintptr_t)y->in,  (uintptr_t)y->in  + sizeof(Drive_Inputs)  - 1 },
+                                                 { (uintptr_t)y->out, (uintptr_t)y->out + sizeof(Drive_Outputs) - 1 } };
+                    for (int p = 0; p < 2; p++)
+                        for (int q = 0; q < 2; q++)
+                            if (xs[p][0]/L <= ys[q][1]/L && ys[q][0]/L <= xs[p][1]/L) shared++;
+                }
+        }
+    return shared;
+}
+
+/* Split ctx[0..n) into `nshards` contiguous slices (sizes differ by at most one). Shard k
+   runs on cpus[k] (NULL or -1 = unpinned) at SCHED_FIFO `priority`. Call after every
+   ServoAxis_Init() / ServoInterp_Init(). Returns 0, or -1 on bad arguments or an
+   interpolation group split across shards. */
+int ServoShards_Init(Servo_ShardSet *set, Servo_Axis ctx[], size_t n, int nshards,
+                     const int cpus[], int priority)
+{
+    if (nshards < 1 || nshards > CSP_MAX_SHARDS || (size_t)nshards > n) return -1;
+    memset(set, 0, sizeof *set);
+    set->n = nshards;
+    set->period_ns = LOOP_PERIOD_NS;
+
+    size_t first = 0;
+    for (int k = 0; k < nshards; k++){
+        Servo_Shard *sh = &set->shard[k];
+        sh->ctx = &ctx[first];
+        sh->n   = n / (size_t)nshards + ((size_t)k < n % (size_t)nshards);
+        first  += sh->n;
+        sh->runner.period_ns = set->period_ns;
+        sh->runner.priority  = priority;
+        sh->runner.pin_cpu   = cpus && cpus[k] >= 0 ? CSP_CPU(cpus[k]) : 0;
+        sh->runner.tick      = servo_shard_tick;
+        sh->runner.on_start  = servo_shard_start;
+        sh->runner.user      = sh;
+        atomic_store(&sh->done_slot, INT64_MIN);
+
+        for (size_t i = 0; i < sh->n; i++){
+            const Servo_Interp *g = sh->ctx[i].interp;
+            if (!g) continue;
+            for (int l = 0; l < g->n; l++)
+                if (g->ax[l] < sh->ctx || g->ax[l] >= sh->ctx + sh->n){
+                    ERRF("shard %d: interpolation group of slave %d spans shards", k, sh->ctx[i].slave_index);
+                    return -1;
+                }
+        }
+    }
+
+    const size_t shared = servo_shard_shared_lines(set);
+    if (shared)
+        WARNF("shards: %zu image block pair(s) share a cache line across shards (false sharing) — pad the ENI or regroup", shared);
+    return 0;
+}
+
+/* Start every shard on one grid whose first slot is two periods from now. Call after
+   the output pairs (if any) are set. */
+int ServoShards_Start(Servo_ShardSet *set)
+{
+    set->start_ns = now_ns() + 2 * set->period_ns;
+    for (int k = 0; k < set->n; k++){
+        Servo_Shard *sh = &set->shard[k];
+        sh->copy_out = 0;
+        for (size_t i = 0; i < sh->n; i++){
+#if CSP_PI_SNAPSHOT
+            if (!sh->ctx[i].out_pair[0]) sh->copy_out = 1;
+#else
+            sh->copy_out = 1;
+#endif
+        }
+        set->shard[k].runner.start_ns = set->start_ns;
+        if (ServoRunner_Start(&set->shard[k].runner) != 0){
+            ERRF("shard %d of %d did not start", k, set->n);
+            while (k-- > 0) ServoRunner_Stop(&set->shard[k].runner);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void ServoShards_Stop(Servo_ShardSet *set)
+{
+    for (int k = 0; k < set->n; k++) ServoRunner_Stop(&set->shard[k].runner);
+}
+
+/* The grid slot (deadline) at or before `t`: what a frame sent at `t` should contain. */
+int64_t ServoShards_SlotAt(const Servo_ShardSet *set, int64_t t)
+{
+    if (t < set->start_ns) return set->start_ns - set->period_ns;
+    return set->start_ns + ((t - set->start_ns) / set->period_ns) * set->period_ns;
+}
+
+static inline void csp_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ volatile("yield");
+#endif
+}
+
+/* Frame thread: wait until every shard finished the tick of `slot`, polling until
+   `give_up_ns` (CLOCK_MONOTONIC); past it, only block-copy shards caught mid-tick are
+   waited for, up to one more period (see above). Returns the number of stragglers
+   (0 = all in). The acquire loads pair with each shard's release, so their outputs are
+   visible on return. */
+int ServoShards_Wait(Servo_ShardSet *set, int64_t slot, int64_t give_up_ns)
+{
+    int missing, torn;
+    for (;;){
+        missing = torn = 0;
+        for (int k = 0; k < set->n; k++){
+            const Servo_Shard *sh = &set->shard[k];
+            if (atomic_load_explicit(&sh->done_slot, memory_order_acquire) >= slot) continue;
+            missing++;
+            if (sh->copy_out && (atomic_load_explicit(&sh->seq, memory_order_acquire) & 1u)) torn++;
+        }
+        if (!missing) break;
+        const int64_t t = now_ns();
+        if (t >= give_up_ns && (!torn || t >= give_up_ns + set->period_ns)) break;
+        csp_cpu_relax();
+    }
+    CSP_RELAXED_ADD(set->frames, 1);
+    if (missing){
+        CSP_RELAXED_ADD(set->late_frames, 1);
+        CSP_RELAXED_ADD(set->stragglers, (uint64_t)missing);
+        if (torn) CSP_RELAXED_ADD(set->torn, (uint64_t)torn);
+    }
+    return missing;
+}
+#endif
+
+/* ==============================================================
+   10) OFFLINE HARNESS (optional, CSP_SIM_MAIN=1 / CSP_REPLAY_MAIN=1)
+   ==============================================================
+
+   WHAT: a main() that runs RunBatch() against simulated drives (4f) on the virtual clock,
+   as fast as the CPU allows, and reports what a soak test wants to know: speed vs. real
+   time, tick execution time, how many axes reached OperationEnabled, faults, recoveries
+   and their worst time, lockouts, FE quantiles.
+   WHY: a change to the engine, the kernels or the config can be checked for thousands of
+   axes and hours of machine time before it meets a real cell; under perf/valgrind too.
+   Build: cc -O2 -DCSP_SIM_MAIN=1 -DCSP_LOG_DEFERRED=1 csp_servo_template.c -lm -pthread
+   Run:   ./a.out [axes=64] [seconds=10] [fault_ppm=0] [record.rec]  (exit 1 if an axis locked out)
+   The exec figures are real time (CLOCK_MONOTONIC_RAW) spent in RunBatch(), the model
+   excluded; the 4c profile and 4d trace work here as on a machine. With CSP_RECORD=1 a
+   fourth argument records the run (4g), for the replay main below.
+   CSP_REPLAY_MAIN=1 instead builds `./a.out record.rec`: replays a recording and exits 1
+   if any published output differs from it (bit-exact regression of the tick). */
+#if CSP_SIM_MAIN
+int main(int argc, char **argv)
+{
+    const size_t   n   = argc > 1 ? strtoul(argv[1], NULL, 0) : 64;
+    const double   sec = argc > 2 ? atof(argv[2]) : 10.0;
+    const uint32_t ppm = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 0) : 0;
+    if (n == 0 || n > CSP_SIM_MAX_SLAVES || !(sec > 0)){
+        fprintf(stderr, "usage: %s [axes 1..%d] [seconds] [fault_ppm] [record.rec]\n", argv[0], CSP_SIM_MAX_SLAVES);
+        return 2;
+    }
+
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.fault_ppm = ppm;
+    ServoSim_Configure(-1, &p);
+    ServoSim_UseVirtualClock(1);
+
+    Servo_Axis *ax = aligned_alloc(CSP_CACHE_LINE, n * sizeof *ax);
+    if (!ax){ fprintf(stderr, "out of memory\n"); return 2; }
+    for (size_t i = 0; i < n; i++)
+        (void)ServoAxis_Init(&ax[i], NULL, (int)i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0);
+#if CSP_RECORD
+    static Servo_Recorder rec;
+    const int recording = argc > 4;
+    if (recording){
+        if (ServoRecord_Open(&rec, argv[4], ax, n) != 0){ perror(argv[4]); return 2; }
+        ServoRecord_Bind(&rec);
+    }
+#endif
+
+    const uint64_t ticks = (uint64_t)(sec * 1e6 / LOOP_PERIOD_US);
+    const int64_t  t0    = now_raw_ns();
+    for (uint64_t k = 0; k < ticks; k++){
+        ServoTemplate_RunBatch(ax, n);
+        ServoSim_Exchange();
+#if CSP_RECORD
+        if (recording) (void)ServoRecord_Flush(&rec);
+#endif
+#if CSP_LOG_DEFERRED
+        if ((k & 1023) == 0) (void)ServoLog_Drain(stdout);
+#endif
+    }
+    const int64_t wall = now_raw_ns() - t0;
+#if CSP_LOG_DEFERRED
+    (void)ServoLog_Drain(stdout);
+#endif
+
+    size_t   running = 0, locked = 0;
+    uint32_t faults = 0, recoveries = 0, rec_max_us = 0, lockouts = 0, retries = 0;
+    int32_t  fe_p99 = 0, fe_max = 0;
+    for (size_t i = 0; i < n; i++){
+        const Servo_402Stats *s = &ax[i].s402;
+        running    += ax[i].st == CSP_ST_RUN;
+        locked     += ax[i].st == CSP_ST_LOCKED;
+        faults     += s->faults;
+        recoveries += s->recoveries;
+        retries    += s->retries;
+        lockouts   += s->lockouts;
+        if (s->rec_max_us > rec_max_us) rec_max_us = s->rec_max_us;
+#if CSP_FE_STATS
+        const Servo_FeStats *fs = &ax[i].fe_stats;
+        const int32_t m = fs->max > -fs->min ? fs->max : -fs->min;
+        if (fs->p99 > fe_p99) fe_p99 = fs->p99;
+        if (m > fe_max)       fe_max = m;
+#endif
+    }
+
+    Servo_HistSummary ex;
+    ServoStats_Summarize(&ServoStats_Default()->exec, &ex);
+    const double sim_s = (double)ticks * LOOP_PERIOD_US * 1e-6;
+    printf("sim: %zu axes, %.1f s simulated (%llu ticks) in %.2f s (%.1fx real time)\n",
+           n, sim_s, (unsigned long long)ticks, (double)wall * 1e-9,
+           wall > 0 ? sim_s / ((double)wall * 1e-9) : 0.0);
+    printf("exec: mean %lld ns, p50/p99/p99.9 %lld/%lld/%lld ns, max %lld ns (%.1f ns/axis)\n",
+           (long long)ex.mean_ns, (long long)ex.p50_ns, (long long)ex.p99_ns,
+           (long long)ex.p999_ns, (long long)ex.max_ns, (double)ex.mean_ns / (double)n);
+    printf("402: %zu running, %zu locked; faults %u, retries %u, recoveries %u (max %u us), lockouts %u\n",
+           running, locked, faults, retries, recoveries, rec_max_us, lockouts);
+#if CSP_FE_STATS
+    printf("FE (last window, worst axis): p99 %d, max %d counts\n", fe_p99, fe_max);
+#endif
+#if CSP_RECORD
+    if (recording){
+        ServoRecord_Bind(NULL);
+        ServoRecord_Close(&rec);
+        printf("record: %llu ticks, %.2f MB (%.1f bytes/axis/tick) in %s\n",
+               (unsigned long long)atomic_load(&rec.frames), (double)rec.bytes / 1e6,
+               (double)rec.bytes / ((double)ticks * (double)n), argv[4]);
+    }
+#endif
+    free(ax);
+    return locked ? 1 : 0;
+}
+#elif CSP_REPLAY_MAIN
+int main(int argc, char **argv)
+{
+    if (argc != 2){ fprintf(stderr, "usage: %s record.rec\n", argv[0]); return 2; }
+    static Servo_Replay rp;
+    if (ServoReplay_Open(&rp, argv[1], NULL, 0) != 0) return 2;
+
+    const int64_t t0 = now_raw_ns();
+    (void)ServoReplay_Run(&rp);
+    const int64_t wall = now_raw_ns() - t0;
+    const double  rec_s = (double)rp.frames * LOOP_PERIOD_US * 1e-6;
+    printf("replay: %u axes, %llu ticks (%.1f s recorded) in %.2f s (%.0fx real time)\n",
+           (unsigned)rp.n, (unsigned long long)rp.frames, rec_s, (double)wall * 1e-9,
+           wall > 0 ? rec_s / ((double)wall * 1e-9) : 0.0);
+    if (rp.mismatches)
+        printf("replay: %llu ticks differ; first at tick %llu, slave %d, output byte %d: recorded 0x%02X, replayed 0x%02X\n",
+               (unsigned long long)rp.mismatches, (unsigned long long)rp.first_tick, rp.first_slave,
+               rp.first_byte, (unsigned)rp.first_want, (unsigned)rp.first_got);
+    else
+        printf("replay: outputs bit-exact\n");
+    const int rc = rp.mismatches ? 1 : 0;
+    ServoReplay_Close(&rp);
+    return rc;
+}
+#endif /* CSP_SIM_MAIN / CSP_REPLAY_MAIN */
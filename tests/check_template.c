@@ -0,0 +1,1086 @@
+/*
+check_template.c — unit checks of the template's building blocks, for ctest
+==========================================================================
+
+WHAT: one executable, one check per argument, each run as its own ctest case (fresh
+process, fresh simulated drives):
+  402     engine: enable from power-up, fault → cooldown → recovery, a drive that drops
+          OperationEnabled without a fault (re-enable without a target jump);
+  ring    set-point SPSC ring: full/empty, index wrap, take stops at max_delta, and a
+          producer thread streaming against the consumer in order;
+  lut     ramp table: the linear shape equals the old integer formula, every shape is
+          monotone, ≥ 1 and ends at inc_step;
+  cfg     runtime config: range checks, FE hysteresis, a limit inside the axis refused,
+          publish → applied on the next tick, Edit() blocked until then;
+  fe      FE window statistics: exact min/max/mean/RMS, sketch quantiles within 6 %;
+  dc      DC lock controller: lock under jitter and outliers, drift estimate, phase step,
+          lock dropped after CSP_DC_LOST_TICKS ticks without a DC time;
+  replay  record a faulting run, replay it bit-exact, and see a changed config diverge;
+  trace   per-tick trace: the trigger is in the header with the first flush after a
+          fault, `frozen` only once the post-trigger window is full, Rearm() resumes
+          (leaves check_trace.trace, and a copy without the header trigger, in dir);
+  sdo     SDO plan (6a): read-verify skips on the blocking path and on async CoE, the
+          cache, per-slave start order and the per_slave/total limits on the pipelined
+          path, a slave whose mailbox never answers times out alone;
+  sdoq    runtime CoE queue (6b), blocking and async: per-slave order (a read after a
+          write sees it), callbacks, a full table rejects, results free their slot;
+  bus     group AL transitions (6c): skip what is there, one error acknowledge, BOOT
+          left out as a straggler, OP → PREOP in one step, bad targets;
+  telem   shared-memory telemetry (4e): what the tick wrote, consistent snapshots while
+          a reader thread races the tick, torn/unknown segments refused;
+  interp  coordinated moves (5d): a line stays on the line within the feed, an arc on its
+          circle, a gantry follower keeps its offset, a member fault aborts the move;
+  traj    S-curve generator (5b): velocity/acceleration bounds, both limits reached, the
+          restart after a fault, and the service thread (section 9) keeping the ring full;
+  shards  multi-core sharding (9b): slicing, an interpolation group across shards
+          refused, three shards ticking a cell on one grid against the frame thread;
+  ff      feed-forward (60B1/60B2, check_template_ff): offsets from the triangle and the
+          S-curve, zero with no gains and while not producing;
+  dt      bus dead-time compensation (5f): the FE computed with the right delay equals
+          the drive's 60F4, a wrong delay does not, and the actual prediction.
+WHY: the soak harness (csp_sim / csp_replay) says the whole tick still behaves; these
+say which part broke.
+
+Like the bench, the template is included (one translation unit) with the simulated
+drives (4f) behind section 4, the recorder (4g), the trace (4d), telemetry (4e) and the
+runner (section 9) on; check_template_ff is the same file built with CSP_FEED_FORWARD=1.
+
+Usage: check_template <check> [dir]   (one of the names above; exit 0 = pass)
+*/
+#define CSP_SIM_DRIVE 1
+#define CSP_RECORD    1
+#define CSP_TRACE     1
+#define CSP_TELEMETRY 1
+#define CSP_WITH_RUNNER 1
+#include "csp_servo_template.c"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+static int g_fail;
+
+#define CHECK(cond, ...) do {                                                   \
+        if (!(cond)){                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__);                                       \
+            fputc('\n', stderr);                                                \
+            g_fail = 1;                                                         \
+        }                                                                       \
+    } while (0)
+
+/* Tick `ax[0..n)` against the model until `until(ax)` holds; the ticks taken, or -1. */
+static int check_run_until(Servo_Axis *ax, size_t n, int max_ticks, int (*until)(const Servo_Axis *))
+{
+    for (int k = 0; k < max_ticks; k++){
+        if (until(ax)) return k;
+        ServoTemplate_RunBatch(ax, n);
+        ServoSim_Exchange();
+    }
+    return until(ax) ? max_ticks : -1;
+}
+
+static int check_running(const Servo_Axis *ax){ return ax->st == CSP_ST_RUN; }
+static int check_faulted(const Servo_Axis *ax){ return ax->st == CSP_ST_FAULT || ax->st == CSP_ST_COOLDOWN; }
+
+static int32_t check_target(Servo_Axis *ax){ return (int32_t)PDO_OUT32(ax, target_position); }
+
+/* Tick `ax[0..n)` until every axis is Running; 0, or -1 after `max_ticks`. */
+static int check_run_all(Servo_Axis *ax, size_t n, int max_ticks)
+{
+    for (int k = 0; k < max_ticks; k++){
+        size_t up = 0;
+        for (size_t i = 0; i < n; i++) up += ax[i].st == CSP_ST_RUN;
+        if (up == n) return 0;
+        ServoTemplate_RunBatch(ax, n);
+        ServoSim_Exchange();
+    }
+    return -1;
+}
+
+static void check_tick(Servo_Axis *ax, size_t n){ ServoTemplate_RunBatch(ax, n); ServoSim_Exchange(); }
+
+/* ---- 402 ---- */
+static void check_402(void)
+{
+    static Servo_Axis ax;
+    ServoSim_UseVirtualClock(1);
+    CHECK(ServoAxis_Init(&ax, NULL, 0, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init");
+
+    const int up = check_run_until(&ax, 1, 5000, check_running);
+    CHECK(up >= 0, "not Running after 5000 ticks (state %d)", ax.st);
+    CHECK(ax.s402.edge[CSP_ST_SHUTDOWN][CSP_ST_SWITCH_ON].n == 1 &&
+          ax.s402.edge[CSP_ST_SWITCH_ON][CSP_ST_ENABLE].n == 1 &&
+          ax.s402.edge[CSP_ST_ENABLE][CSP_ST_RUN].n == 1, "enable path not Shutdown → SwitchOn → Enable → Run");
+
+    ServoSim_InjectFault(0, 0x7500);
+    CHECK(check_run_until(&ax, 1, 100, check_faulted) >= 0, "fault not seen (state %d)", ax.st);
+    const int back = check_run_until(&ax, 1, CSP_MS_TO_TICKS(FAULT_COOLDOWN_MS) + 5000, check_running);
+    CHECK(back >= CSP_MS_TO_TICKS(FAULT_COOLDOWN_MS), "re-enabled after %d ticks, inside the cooldown", back);
+    CHECK(ax.s402.faults == 1 && ax.s402.recoveries == 1, "faults %u recoveries %u",
+          ax.s402.faults, ax.s402.recoveries);
+
+    /* The drive falls back to SwitchedOn on its own: the engine must leave Running with
+       the target on the actual position and come back from there without a step. */
+    int32_t prev = check_target(&ax), jump = 0, off = INT32_MAX, back_off = INT32_MAX;
+    for (int k = 0; k < 3000; k++){
+        if (k >= 500 && k < 600){
+            g_sim[0].st = CSP_SIM_SO;
+            le_set_u16((uint8_t*)&ax.in->status_word, 0x0233);
+        }
+        const int was = ax.st;
+        ServoTemplate_RunBatch(&ax, 1);
+        const int32_t t = check_target(&ax), d = t > prev ? t - prev : prev - t;
+        const int32_t act = (int32_t)PDO_GET32(&ax, position_actual_value);
+        if (was == CSP_ST_RUN && ax.st != CSP_ST_RUN) off = t - act;
+        if (was != CSP_ST_RUN && ax.st == CSP_ST_RUN) back_off = t > act ? t - act : act - t;
+        if (was == CSP_ST_RUN && ax.st == CSP_ST_RUN && d > jump) jump = d;
+        prev = t;
+        ServoSim_Exchange();
+    }
+    CHECK(ax.s402.drops == 1, "drops %u", ax.s402.drops);
+    CHECK(off == 0, "target left %d counts off 6064 on the drop", off);
+    CHECK(ax.st == CSP_ST_RUN, "not Running again (state %d)", ax.st);
+    CHECK(back_off <= INC_STEP, "re-enabled %d counts away from 6064", back_off);
+    CHECK(jump <= INC_STEP, "target stepped %d counts while Running (INC_STEP %d)", jump, INC_STEP);
+}
+
+/* ---- ring ---- */
+#define CHECK_STREAM_N 200000u
+
+static Servo_Stream g_stream;
+
+static void *check_stream_producer(void *arg)
+{
+    (void)arg;
+    Servo_Setpoint sp[64];
+    uint32_t next = 1;
+    while (next <= CHECK_STREAM_N){
+        size_t n = 0;
+        while (n < 64 && next + n <= CHECK_STREAM_N){
+            memset(&sp[n], 0, sizeof sp[n]);
+            sp[n].pos = (int32_t)(next + n);
+            n++;
+        }
+        const size_t put = ServoStream_Push(&g_stream, sp, n);
+        next += (uint32_t)put;
+        if (!put) sched_yield();
+    }
+    return NULL;
+}
+
+static void check_ring(void)
+{
+    static Servo_SetpointRing r;
+    static Servo_Axis ax;
+    Servo_Setpoint v;
+    memset(&v, 0, sizeof v);
+
+    /* indices start just below the wrap of uint32 */
+    atomic_store(&r.head, UINT32_MAX - 5);
+    atomic_store(&r.tail, UINT32_MAX - 5);
+    CHECK(servo_ring_level(&r) == 0, "level %u", servo_ring_level(&r));
+    for (int i = 0; i < SETPOINT_RING; i++){ v.pos = 10 + i; CHECK(servo_ring_push(&r, v), "push %d refused", i); }
+    CHECK(!servo_ring_push(&r, v), "push into a full ring accepted");
+    CHECK(servo_ring_level(&r) == SETPOINT_RING, "level %u when full", servo_ring_level(&r));
+
+    ax.pos_prev = 9;
+    CHECK(servo_ring_take(&ax, &r, 3, 1000) == 3 && ax.pos_tgt == 12, "take 3: target %d", ax.pos_tgt);
+    CHECK(servo_ring_level(&r) == SETPOINT_RING - 3, "level %u after take", servo_ring_level(&r));
+
+    /* the first sample is always taken; the next ones only within max_delta of pos_prev */
+    ax.pos_prev = 0;
+    CHECK(servo_ring_take(&ax, &r, 4, 5) == 1 && ax.pos_tgt == 13, "max_delta: target %d", ax.pos_tgt);
+    ax.pos_prev = 13;
+    CHECK(servo_ring_take(&ax, &r, 1000, 1 << 30) == SETPOINT_RING - 4 && ax.pos_tgt == 10 + SETPOINT_RING - 1,
+          "drain: target %d", ax.pos_tgt);
+    CHECK(servo_ring_level(&r) == 0 && servo_ring_take(&ax, &r, 1, 1 << 30) == 0, "not empty after drain");
+
+    /* one producer thread, the consumer here: every sample once, in order */
+    ServoStream_Attach(&ax, &g_stream, STREAM_UNDERRUN_HOLD, 0.0);
+    ax.stream = NULL;                  /* only the ring is under test */
+    CHECK(ServoStream_Space(&g_stream) == SETPOINT_RING, "space %zu", ServoStream_Space(&g_stream));
+    pthread_t th;
+    CHECK(pthread_create(&th, NULL, check_stream_producer, NULL) == 0, "pthread_create");
+    uint32_t want = 1, bad = 0;
+    while (want <= CHECK_STREAM_N){
+        if (!servo_ring_take(&ax, &g_stream.ring, 1, 1 << 30)){ sched_yield(); continue; }
+        if (ax.pos_tgt != (int32_t)want && !bad++)
+            fprintf(stderr, "stream: sample %u holds %d\n", want, ax.pos_tgt);
+        want++;
+    }
+    pthread_join(th, NULL);
+    CHECK(bad == 0, "%u samples out of order", bad);
+    CHECK(atomic_load(&g_stream.pushed) == CHECK_STREAM_N, "pushed %llu",
+          (unsigned long long)atomic_load(&g_stream.pushed));
+}
+
+/* ---- lut ---- */
+static void check_lut(void)
+{
+    static int32_t lut[CSP_CFG_RAMP_TICKS_MAX > 0 ? CSP_CFG_RAMP_TICKS_MAX : 1];
+    const int     ns[]    = { 1, 7, 100, CSP_CFG_RAMP_TICKS_MAX };
+    const int32_t steps[] = { 1, 3, INC_STEP, 1000000 };
+    for (int shape = 0; shape < 3; shape++)
+        for (size_t a = 0; a < sizeof ns / sizeof ns[0]; a++)
+            for (size_t b = 0; b < sizeof steps / sizeof steps[0]; b++){
+                const int n = ns[a];
+                const int32_t inc = steps[b];
+                if (n < 1) continue;
+                servo_ramp_build(lut, n, inc, shape);
+                int bad = 0;
+                for (int i = 0; i < n && !bad; i++){
+                    if (lut[i] < 1 || lut[i] > inc || (i && lut[i] < lut[i - 1])) bad = 1;
+                    if (shape == 0 && lut[i] != (int32_t)((int64_t)inc * (i + 1) / n)
+                                   && !(lut[i] == 1 && (int64_t)inc * (i + 1) / n == 0)) bad = 1;
+                    if (bad) fprintf(stderr, "lut shape %d n %d inc %d: entry %d = %d\n", shape, n, inc, i, lut[i]);
+                }
+                CHECK(!bad, "shape %d n %d inc %d", shape, n, inc);
+                CHECK(lut[n - 1] == inc, "shape %d n %d: last %d, want %d", shape, n, lut[n - 1], inc);
+            }
+}
+
+/* ---- cfg ---- */
+static void check_cfg(void)
+{
+    Servo_AxisConfig c;
+    ServoConfig_Defaults(&c);
+    CHECK(servo_cfg_derive(&c) == 0, "defaults out of range");
+    for (int pct = 1; pct <= 100; pct++){
+        c.fe_warn_pct = pct;
+        CHECK(servo_cfg_derive(&c) == 0, "pct %d refused", pct);
+        CHECK(c.fe_ok_th == c.fe_warn_th / 2 && (c.fe_warn_th < 2 || c.fe_ok_th < c.fe_warn_th),
+              "pct %d: warn %d ok %d", pct, c.fe_warn_th, c.fe_ok_th);
+    }
+
+    static Servo_Axis ax;
+    static Servo_ConfigBuf cb;
+    ServoSim_UseVirtualClock(1);
+    CHECK(ServoAxis_Init(&ax, NULL, 0, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init");
+    ServoAxis_AttachConfig(&ax, &cb);
+    CHECK(check_run_until(&ax, 1, 5000, check_running) >= 0, "not Running (state %d)", ax.st);
+    for (int k = 0; k < 5000 && atomic_load(&cb.reach) <= 1000; k++){ ServoTemplate_RunBatch(&ax, 1); ServoSim_Exchange(); }
+    const int32_t reach = atomic_load(&cb.reach);   /* moving, well inside LIMIT_POS */
+    CHECK(reach > 1000 && reach < LIMIT_POS / 2, "reach %d", reach);
+
+    Servo_AxisConfig *e = ServoConfig_Edit(&cb);
+    CHECK(e != NULL, "edit refused while idle");
+    if (!e) return;
+    e->fe_warn_pct = 0;
+    CHECK(ServoConfig_Commit(&cb) == -1, "fe_warn_pct 0 accepted");
+    e->fe_warn_pct = FE_WARN_PCT;
+    e->limit_pos = reach / 2;
+    CHECK(ServoConfig_Commit(&cb) == -1, "limit %d inside the axis (reach %d) accepted", reach / 2, reach);
+
+    e->limit_pos = LIMIT_POS;
+    e->inc_step  = INC_STEP / 2;
+    CHECK(ServoConfig_Commit(&cb) == 0, "valid commit refused");
+    CHECK(!ServoConfig_Applied(&cb) && ServoConfig_Edit(&cb) == NULL, "applied / editable before a tick");
+    CHECK(ax.cfg->inc_step == INC_STEP, "live slot changed before the tick");
+    ServoTemplate_RunBatch(&ax, 1);
+    ServoSim_Exchange();
+    CHECK(ServoConfig_Applied(&cb) && ax.cfg->inc_step == INC_STEP / 2, "not applied after a tick (inc_step %d)",
+          ax.cfg->inc_step);
+    CHECK(ServoConfig_Edit(&cb) != NULL, "edit refused after apply");
+}
+
+/* ---- fe ---- */
+static void check_fe(void)
+{
+#if CSP_FE_STATS
+    static Servo_Axis ax;
+    const uint32_t n = 1000;
+    ax.fe_acc.window = n;
+    servo_fe_window_reset(&ax.fe_acc);
+    int64_t sum = 0; double sq = 0.0;
+    for (uint32_t i = 1; i <= n; i++){             /* |FE| = 1..1000, alternating sign */
+        const int32_t fe = (i & 1) ? (int32_t)i : -(int32_t)i;
+        sum += fe; sq += (double)fe * (double)fe;
+        servo_fe_stats_add(&ax, fe);
+    }
+    const Servo_FeStats *s = &ax.fe_stats;
+    CHECK(s->windows == 1 && s->n == n && ax.fe_acc.n == 0, "window not closed (windows %llu n %u)",
+          (unsigned long long)s->windows, s->n);
+    CHECK(s->min == -1000 && s->max == 999, "min %d max %d", s->min, s->max);
+    CHECK(s->mean == (int32_t)(sum / (int64_t)n), "mean %d", s->mean);
+    CHECK(s->rms == (int32_t)sqrt(sq / (double)n), "rms %d", s->rms);
+    const int32_t got[4] = { s->p50, s->p90, s->p99, s->p999 }, want[4] = { 500, 900, 990, 999 };
+    for (int q = 0; q < 4; q++)
+        CHECK(abs(got[q] - want[q]) * 16 <= want[q] + 16, "quantile %d: %d, want %d", q, got[q], want[q]);
+
+    for (int32_t v = 0; v < 32; v++)               /* small values are exact */
+        CHECK(servo_fe_bucket_mid(servo_fe_bucket((uint32_t)v)) == v, "bucket of %d", v);
+#else
+    fprintf(stderr, "fe: CSP_FE_STATS off in this build\n");
+#endif
+}
+
+/* ---- dc ---- */
+static void check_dc(void)
+{
+    const int64_t P = LOOP_PERIOD_NS;
+    const double  ppm = 50.0;                      /* reference clock runs 50 ppm fast */
+    Servo_DcSync s;
+    ServoDc_Init(&s, P);
+    srand(7);
+
+    /* Host wakes 20 µs into the period + 0..2 µs jitter, and every 3000 ticks a frame
+       0.4 period late (beyond step_ns). The controller moves the host grid (`next`). */
+    int64_t next = P, dc_base = 123456789;
+    int lock_at = -1, was = 0, losses = 0;
+    int32_t lo = INT32_MAX, hi = INT32_MIN;
+    for (int k = 0; k < 60000; k++){
+        int64_t host = next + 20000 + (int64_t)(2000.0 * rand() / (double)RAND_MAX);
+        if (k % 3000 == 1500) host += P * 2 / 5;
+        next += P + ServoDc_Update(&s, dc_base + host + (int64_t)((double)host * ppm * 1e-6));
+        if (s.locked && lock_at < 0) lock_at = k;
+        if (was && !s.locked) losses++;
+        was = s.locked;
+        if (k >= 20000){
+            if (s.drift_ppb < lo) lo = s.drift_ppb;
+            if (s.drift_ppb > hi) hi = s.drift_ppb;
+        }
+    }
+    CHECK(lock_at >= 0 && lock_at < 5000, "locked at tick %d", lock_at);
+    CHECK(losses == 0, "lock lost %d times to isolated outliers", losses);
+    CHECK(s.steps == 1, "%llu phase steps (only the initial one expected)", (unsigned long long)s.steps);
+    CHECK(lo >= 47000 && hi <= 53000, "drift %d..%d ppb, want 50000 ± 3000", lo, hi);
+    CHECK(ServoStats_Default()->dc_flags & CSP_DC_F_LOCKED, "telemetry not locked");
+
+    /* no DC time: the lock holds for CSP_DC_LOST_TICKS - 1 ticks, then drops */
+    for (int k = 0; k < CSP_DC_LOST_TICKS - 1; k++){ ServoDc_Lost(&s); next += P; }
+    CHECK(s.locked, "lock dropped before CSP_DC_LOST_TICKS");
+    ServoDc_Lost(&s); next += P;
+    CHECK(!s.locked && !(ServoStats_Default()->dc_flags & CSP_DC_F_LOCKED), "still locked without DC time");
+
+    /* DC time jumps by a third of a period: one phase step after CSP_DC_STEP_TICKS, relock */
+    dc_base += P / 3;
+    const uint64_t steps = s.steps;
+    for (int k = 0; k < 5000; k++){
+        const int64_t host = next + 20000;
+        next += P + ServoDc_Update(&s, dc_base + host + (int64_t)((double)host * ppm * 1e-6));
+    }
+    CHECK(s.steps == steps + 1, "%llu phase steps for one jump", (unsigned long long)(s.steps - steps));
+    CHECK(s.locked && s.drift_ppb > 47000 && s.drift_ppb < 53000, "after the jump: locked %d drift %d",
+          s.locked, s.drift_ppb);
+}
+
+/* ---- replay ---- */
+#define CHECK_REC_AXES 4
+
+static void check_replay(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof path, "%s/check_replay.rec", dir);
+
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.fault_ppm = 500;                             /* a few faults and recoveries per axis */
+    ServoSim_Configure(-1, &p);
+    ServoSim_UseVirtualClock(1);
+
+    static Servo_Axis ax[CHECK_REC_AXES];
+    static Servo_Recorder rec;
+    for (int i = 0; i < CHECK_REC_AXES; i++)
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+    if (ServoRecord_Open(&rec, path, ax, CHECK_REC_AXES) != 0){ CHECK(0, "cannot record to %s", path); return; }
+    ServoRecord_Bind(&rec);
+    const uint64_t ticks = 20000;
+    for (uint64_t k = 0; k < ticks; k++){
+        ServoTemplate_RunBatch(ax, CHECK_REC_AXES);
+        ServoSim_Exchange();
+        (void)ServoRecord_Flush(&rec);
+    }
+    ServoRecord_Bind(NULL);
+    ServoRecord_Close(&rec);
+    uint32_t faults = 0;
+    for (int i = 0; i < CHECK_REC_AXES; i++) faults += ax[i].s402.faults;
+    CHECK(faults > 0, "no fault in the recorded run (raise fault_ppm)");
+    CHECK(atomic_load(&rec.frames) == ticks && !atomic_load(&rec.stopped), "recorded %llu of %llu ticks",
+          (unsigned long long)atomic_load(&rec.frames), (unsigned long long)ticks);
+
+    static Servo_Replay rp;
+    CHECK(ServoReplay_Open(&rp, path, NULL, 0) == 0, "open %s", path);
+    if (!rp.f) return;
+    CHECK(ServoReplay_Run(&rp) == 0, "replay differs: tick %llu slave %d byte %d (0x%02X, want 0x%02X)",
+          (unsigned long long)rp.first_tick, rp.first_slave, rp.first_byte, rp.first_got, rp.first_want);
+    CHECK(rp.frames == ticks, "replayed %llu ticks", (unsigned long long)rp.frames);
+    ServoReplay_Close(&rp);
+
+    /* The same recording with another config must not pass. */
+    static Servo_ConfigBuf cb;
+    CHECK(ServoReplay_Open(&rp, path, NULL, 0) == 0, "reopen %s", path);
+    if (!rp.f) return;
+    ServoAxis_AttachConfig(&rp.ax[0], &cb);
+    Servo_AxisConfig *e = ServoConfig_Edit(&cb);
+    e->inc_step = INC_STEP + 1;
+    CHECK(ServoConfig_Commit(&cb) == 0, "commit");
+    CHECK(ServoReplay_Run(&rp) > 0 && rp.first_slave == 0, "changed config replayed bit-exact");
+    ServoReplay_Close(&rp);
+    remove(path);
+}
+
+/* ---- trace ---- */
+static void check_trace(const char *dir)
+{
+    char path[512], copy[512];
+    snprintf(path, sizeof path, "%s/check_trace.trace", dir);
+    snprintf(copy, sizeof copy, "%s/check_trace_nohdr.trace", dir);
+
+    static Servo_Axis ax;
+    static Servo_Trace tr;
+    ServoSim_UseVirtualClock(1);
+    CHECK(ServoAxis_Init(&ax, NULL, 0, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init");
+    if (ServoTrace_Open(&tr, path, 1, 1, CSP_TRACE_F_FAULT) != 0){ CHECK(0, "cannot trace to %s", path); return; }
+    ServoTrace_Bind(&tr);
+    const Servo_TraceFileHeader *h = tr.hdr;
+    CHECK(check_run_until(&ax, 1, 5000, check_running) >= 0, "not Running (state %d)", ax.st);
+    (void)ServoTrace_Flush(&tr);
+    CHECK(!h->trig_flags && !atomic_load(&h->frozen), "trigger 0x%X before any fault", h->trig_flags);
+
+    /* a few ticks after the fault: the window is far from full, the header has the trigger */
+    ServoSim_InjectFault(0, 0x7500);
+    for (int k = 0; k < 20; k++){ ServoTemplate_RunBatch(&ax, 1); ServoSim_Exchange(); }
+    (void)ServoTrace_Flush(&tr);
+    CHECK(h->trig_flags == CSP_TRACE_F_FAULT, "header trig_flags 0x%X after the fault", h->trig_flags);
+    CHECK(!atomic_load(&h->frozen), "frozen %llu records after the trigger",
+          (unsigned long long)(atomic_load(&h->written) - h->trig_seq));
+    CHECK(h->trig_seq < atomic_load(&h->written) &&
+          (tr.file[h->trig_seq % tr.cap].flags & CSP_TRACE_F_TRIGGER), "record %llu is not the trigger",
+          (unsigned long long)h->trig_seq);
+    const uint64_t trig = h->trig_seq;
+
+    /* a copy as a process that died before the header update would leave it */
+    FILE *f = fopen(copy, "wb");
+    CHECK(f != NULL, "cannot write %s", copy);
+    if (f){
+        Servo_TraceFileHeader c;
+        memcpy(&c, h, sizeof c);
+        c.trig_flags = 0;
+        c.trig_seq   = 0;
+        CHECK(fwrite(&c, sizeof c, 1, f) == 1, "write %s", copy);
+        CHECK(fwrite((const uint8_t*)h + sizeof c, tr.map_len - sizeof c, 1, f) == 1, "write %s", copy);
+        fclose(f);
+    }
+
+    /* the rest of the window: frozen, recording stops, the trigger stays put */
+    for (uint64_t k = 0; k < tr.post + 100; k++){
+        ServoTemplate_RunBatch(&ax, 1);
+        ServoSim_Exchange();
+        if ((k & 1023) == 0) (void)ServoTrace_Flush(&tr);
+    }
+    (void)ServoTrace_Flush(&tr);
+    const uint64_t w = atomic_load(&h->written);
+    CHECK(atomic_load(&h->frozen) && w == trig + 1 + tr.post, "frozen %u, written %llu, want %llu",
+          (unsigned)atomic_load(&h->frozen), (unsigned long long)w, (unsigned long long)(trig + 1 + tr.post));
+    CHECK(h->trig_seq == trig, "trigger moved to %llu", (unsigned long long)h->trig_seq);
+
+    ServoTrace_Rearm(&tr);
+    for (int k = 0; k < 10; k++){ ServoTemplate_RunBatch(&ax, 1); ServoSim_Exchange(); }
+    (void)ServoTrace_Flush(&tr);
+    CHECK(!atomic_load(&h->frozen) && atomic_load(&h->written) == w + 10, "rearm: frozen %u written +%llu",
+          (unsigned)atomic_load(&h->frozen), (unsigned long long)(atomic_load(&h->written) - w));
+    ServoTrace_Bind(NULL);
+    ServoTrace_Close(&tr);
+}
+
+/* ---- sdo ---- */
+#define CHECK_SDO_SLAVES 4
+#define CHECK_SDO_OPS    4                          /* per slave */
+
+/* 6060 already 8 on a fresh drive; the other three differ until written. */
+static void check_sdo_add(Servo_SdoPlan *p, int slave)
+{
+    CHECK(ServoSdo_Add(p, slave, 0x6060, 0, 1, 8) == 0, "add");
+    CHECK(ServoSdo_Add(p, slave, 0x6065, 0, 4, 5000u + (uint32_t)slave) == 0, "add");
+    CHECK(ServoSdo_Add(p, slave, 0x60C2, 1, 1, 1) == 0, "add");
+    CHECK(ServoSdo_Add(p, slave, 0x10F1, 1, 4, 150) == 0, "add");
+}
+
+static void check_sdo_plan(int per_slave, int total, int verify, size_t ok, size_t skipped, const char *what)
+{
+    static Servo_SdoOp ops[CHECK_SDO_SLAVES * CHECK_SDO_OPS];
+    Servo_SdoPlan plan;
+    ServoSdo_PlanInit(&plan, ops, CHECK_SDO_SLAVES * CHECK_SDO_OPS, per_slave, total, verify);
+    for (int s = 0; s < CHECK_SDO_SLAVES; s++) check_sdo_add(&plan, s);
+    CHECK(ServoSdo_Run(&plan, NULL) == 0, "%s: plan failed", what);
+    CHECK(plan.ok == ok && plan.skipped == skipped && !plan.failed, "%s: %zu ok %zu skipped %zu failed",
+          what, plan.ok, plan.skipped, plan.failed);
+    /* writes to one slave start in the order they were added */
+    for (size_t i = 0; i < plan.n; i++)
+        for (size_t j = i + 1; j < plan.n; j++)
+            if (ops[j].slave == ops[i].slave && ops[i].status == SDO_OK && ops[j].status == SDO_OK)
+                CHECK(ops[j].t_start >= ops[i].t_start, "%s: slave %d %04X started before %04X", what,
+                      ops[i].slave, (unsigned)ops[j].idx, (unsigned)ops[i].idx);
+}
+
+static void check_sdo(void)
+{
+    const size_t n = CHECK_SDO_SLAVES * CHECK_SDO_OPS;
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    ServoSim_Configure(-1, &p);                    /* sdo_polls 0: blocking SDO only */
+
+    /* blocking path: the verify reads with sdo_read() and skips what already holds */
+    check_sdo_plan(2, 8, 1, n - CHECK_SDO_SLAVES, CHECK_SDO_SLAVES, "blocking verify");
+    CHECK(g_sim_coe.started == 0, "async CoE used by a slave without it");
+    for (int s = 0; s < CHECK_SDO_SLAVES; s++)
+        CHECK(ServoSim_Drive(s)->fe_window == 5000u + (uint32_t)s, "slave %d: 6065 %u", s, ServoSim_Drive(s)->fe_window);
+    check_sdo_plan(2, 8, 1, 0, n, "cached");
+    ServoSdo_CacheClear();
+    check_sdo_plan(2, 8, 1, 0, n, "blocking verify after CacheClear");
+
+    /* async CoE: fresh drives answer on the 3rd poll; pipelined within the limits */
+    for (int s = 0; s < CHECK_SDO_SLAVES; s++) g_sim[s].used = 0;
+    p.sdo_polls = 3;
+    ServoSim_Configure(-1, &p);
+    ServoSdo_CacheClear();
+    check_sdo_plan(2, 5, 0, n, 0, "async");
+    CHECK(g_sim_coe.started == n, "async: %llu transfers started", (unsigned long long)g_sim_coe.started);
+    CHECK(g_sim_coe.peak > 2 && g_sim_coe.peak <= 5, "async: %u in flight at once (total 5)", g_sim_coe.peak);
+    for (int s = 0; s < CHECK_SDO_SLAVES; s++)
+        CHECK(ServoSim_Drive(s)->coe_peak <= 2 && ServoSim_Drive(s)->fe_window == 5000u + (uint32_t)s,
+              "slave %d: %u in flight (per_slave 2), 6065 %u", s, ServoSim_Drive(s)->coe_peak,
+              ServoSim_Drive(s)->fe_window);
+    ServoSdo_CacheClear();
+    g_sim_coe.started = 0;
+    check_sdo_plan(1, 16, 1, 0, n, "async verify");
+    CHECK(g_sim_coe.started == n, "async verify: %llu transfers for %zu reads",
+          (unsigned long long)g_sim_coe.started, n);
+
+    /* a mute mailbox: its write times out, the other slave's completes */
+    p.sdo_polls = UINT32_MAX;
+    ServoSim_Configure(5, &p);
+    static Servo_SdoOp ops[2];
+    Servo_SdoPlan plan;
+    ServoSdo_PlanInit(&plan, ops, 2, 1, 2, 0);
+    ServoSdo_Add(&plan, 5, 0x6065, 0, 4, 1234);
+    ServoSdo_Add(&plan, 0, 0x6065, 0, 4, 4321);
+    const int64_t t0 = now_ns();
+    CHECK(ServoSdo_Run(&plan, NULL) == -1, "plan with a mute slave passed");
+    const int64_t ms = (now_ns() - t0) / 1000000;
+    CHECK(ops[0].status == SDO_FAILED && ops[0].abort_code == 0 && ops[1].status == SDO_OK,
+          "mute: %s (abort 0x%08X) / %s", ServoSdo_StatusName(ops[0].status), ops[0].abort_code,
+          ServoSdo_StatusName(ops[1].status));
+    CHECK(ms >= CSP_SDO_TIMEOUT_MS && ms < 3 * CSP_SDO_TIMEOUT_MS, "timed out after %lld ms", (long long)ms);
+}
+
+/* ---- sdoq ---- */
+static int      g_sdoq_cb;
+static uint32_t g_sdoq_cb_value;
+
+static void check_sdoq_cb(void *user, int slave, uint16_t idx, uint8_t sub, int ok, uint32_t value, uint32_t abort_code)
+{
+    (void)user; (void)slave; (void)idx; (void)sub; (void)abort_code;
+    if (ok){ g_sdoq_cb++; g_sdoq_cb_value = value; }
+}
+
+static void check_sdoq_run(uint32_t polls, const char *what)
+{
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.sdo_polls = polls;
+    ServoSim_Configure(-1, &p);
+    memset(&g_sim_coe, 0, sizeof g_sim_coe);
+
+    static Servo_SdoQueue q;
+    ServoSdo_QueueInit(&q, 1);
+    enum { S = 4 };
+    int hw[S], hr[S], extra[CSP_SDO_REQ_SLOTS], ne = 0;
+    for (int s = 0; s < S; s++){                   /* per slave: write, then read it back */
+        hw[s] = ServoSdo_ReqWrite(&q, s, 0x6065, 0, 4, 7000u + (uint32_t)s, NULL, NULL);
+        hr[s] = ServoSdo_ReqRead(&q, s, 0x6065, 0, 4, NULL, NULL);
+        CHECK(hw[s] >= 0 && hr[s] >= 0, "%s: submit refused", what);
+    }
+    g_sdoq_cb = 0;
+    CHECK(ServoSdo_ReqRead(&q, 0, 0x6060, 0, 1, check_sdoq_cb, NULL) >= 0, "%s: submit refused", what);
+    while (ne < CSP_SDO_REQ_SLOTS && (extra[ne] = ServoSdo_ReqRead(&q, 1, 0x6041, 0, 2, NULL, NULL)) >= 0) ne++;
+    CHECK(ne == CSP_SDO_REQ_SLOTS - 2 * S - 1 && atomic_load(&q.rejected) == 1,
+          "%s: %d more accepted, %llu rejected", what, ne, (unsigned long long)atomic_load(&q.rejected));
+    CHECK(ServoSdo_ReqState(&q, hr[0]) == SDO_REQ_QUEUED, "%s: state %d before the service", what,
+          ServoSdo_ReqState(&q, hr[0]));
+    CHECK(ServoSdo_ReqResult(&q, hr[0], NULL, NULL) == 1, "%s: result of a pending request", what);
+
+    int passes = 0;
+    while (ServoSdo_Service(&q, NULL) > 0 && passes < 100000) passes++;
+    CHECK(passes < 100000, "%s: queue never drained", what);
+    for (int s = 0; s < S; s++){
+        uint32_t v = 0, abort_code = 1;
+        CHECK(ServoSdo_ReqResult(&q, hw[s], NULL, &abort_code) == 0 && abort_code == 0, "%s: write %d", what, s);
+        CHECK(ServoSdo_ReqResult(&q, hr[s], &v, NULL) == 0 && v == 7000u + (uint32_t)s,
+              "%s: slave %d read %u after writing %u", what, s, v, 7000u + (uint32_t)s);
+        CHECK(ServoSdo_ReqState(&q, hr[s]) == SDO_REQ_FREE, "%s: slot not freed", what);
+    }
+    for (int i = 0; i < ne; i++) CHECK(ServoSdo_ReqResult(&q, extra[i], NULL, NULL) == 0, "%s: read %d", what, i);
+    CHECK(g_sdoq_cb == 1 && g_sdoq_cb_value == 8, "%s: callback %d times, value %u", what, g_sdoq_cb, g_sdoq_cb_value);
+    CHECK(atomic_load(&q.completed) == atomic_load(&q.submitted) && !atomic_load(&q.failed),
+          "%s: %llu of %llu completed", what, (unsigned long long)atomic_load(&q.completed),
+          (unsigned long long)atomic_load(&q.submitted));
+    if (polls){
+        CHECK(g_sim_coe.started == atomic_load(&q.submitted), "%s: %llu async transfers", what,
+              (unsigned long long)g_sim_coe.started);
+        CHECK(g_sim_coe.peak > 1 && g_sim_coe.peak <= S, "%s: %u in flight at once", what, g_sim_coe.peak);
+        for (int s = 0; s < S; s++)
+            CHECK(ServoSim_Drive(s)->coe_peak == 1, "%s: slave %d had %u in flight (per_slave 1)", what, s,
+                  ServoSim_Drive(s)->coe_peak);
+    } else {
+        CHECK(passes == 0 && g_sim_coe.started == 0, "%s: blocking queue took %d passes", what, passes);
+    }
+}
+
+static void check_sdoq(void)
+{
+    check_sdoq_run(0, "blocking");
+    check_sdoq_run(3, "async");
+}
+
+/* ---- bus ---- */
+static void check_bus(void)
+{
+    enum { N = 5 };
+    static Servo_BusGroup bus;
+    ServoBus_GroupInit(&bus);
+    for (int i = 0; i < N; i++){
+        CHECK(ServoBus_Add(&bus, ServoSim_Slave(i), 10 + i) == i, "add %d", i);
+        g_sim[i].al = EC_AL_INIT;
+    }
+    g_sim[1].al = EC_AL_OP;                        /* already there */
+    g_sim[2].al = EC_AL_INIT | EC_AL_ERROR;        /* needs one acknowledge */
+    g_sim[3].al = EC_AL_BOOT;                      /* firmware update: off the ladder */
+
+    CHECK(ServoBus_Transition(&bus, EC_AL_OP, 200) == 1 && bus.stragglers == 1, "%zu stragglers", bus.stragglers);
+    for (int i = 0; i < N; i++){
+        const uint16_t want = i == 3 ? EC_AL_BOOT : EC_AL_OP;
+        CHECK(g_sim[i].al == want && bus.m[i].failed == (i == 3), "slave %d: AL 0x%02X failed %d", i,
+              (unsigned)g_sim[i].al, bus.m[i].failed);
+    }
+    CHECK(bus.m[2].acks == 1 && !bus.m[2].clearing, "error slave: %d acks, clearing %d", bus.m[2].acks, bus.m[2].clearing);
+    CHECK(bus.m[0].acks == 0, "ack sent to a slave without error");
+    for (int k = 0; k < 3; k++){
+        CHECK(bus.m[0].t_step_ns[k] > 0 && bus.m[1].t_step_ns[k] == -1, "step %d: arrival %lld / %lld", k,
+              (long long)bus.m[0].t_step_ns[k], (long long)bus.m[1].t_step_ns[k]);
+        CHECK(bus.slowest[k] >= 0 && bus.slowest[k] != 1 && bus.slowest[k] != 3, "step %d closed by %d",
+              k, bus.slowest[k]);
+    }
+
+    /* OP → PREOP is one step down for everybody in OP; BOOT stays out */
+    CHECK(ServoBus_Transition(&bus, EC_AL_PREOP, 200) == 1, "down: %zu stragglers", bus.stragglers);
+    for (int i = 0; i < N; i++)
+        if (i != 3) CHECK(g_sim[i].al == EC_AL_PREOP && bus.m[i].t_step_ns[0] > 0, "slave %d: AL 0x%02X", i,
+                          (unsigned)g_sim[i].al);
+    CHECK(bus.step_ns[1] == 0 && bus.step_ns[2] == 0, "steps above PREOP ran");
+
+    CHECK(ServoBus_Transition(&bus, EC_AL_INIT, 200) == -1 && ServoBus_Transition(&bus, EC_AL_BOOT, 200) == -1 &&
+          ServoBus_Transition(&bus, EC_AL_OP | EC_AL_ERROR, 200) == -1, "bad target accepted");
+    CHECK(!strcmp(ServoBus_StateName(EC_AL_SAFEOP | EC_AL_ERROR), "SAFEOP"), "state name");
+}
+
+/* ---- telem ---- */
+#define CHECK_TELEM_AXES 2
+
+static Servo_Telemetry g_telem;
+static _Atomic int     g_telem_stop;
+static _Atomic long    g_telem_reads, g_telem_torn;
+
+/* Both axes run the same model without noise: a consistent snapshot has equal targets. */
+static void *check_telem_reader(void *arg)
+{
+    (void)arg;
+    Servo_TelemetryCycle c;
+    Servo_TelemetryAxis a[CHECK_TELEM_AXES];
+    while (!atomic_load(&g_telem_stop)){
+        if (ServoTelemetry_Read(g_telem.hdr, &c, a, CHECK_TELEM_AXES, 100) != CHECK_TELEM_AXES){ sched_yield(); continue; }
+        atomic_fetch_add(&g_telem_reads, 1);
+        if (a[0].target != a[1].target || a[0].st != a[1].st) atomic_fetch_add(&g_telem_torn, 1);
+        sched_yield();
+    }
+    return NULL;
+}
+
+static void check_telem(void)
+{
+    char name[64];
+    snprintf(name, sizeof name, "/csp_check_%d", (int)getpid());
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.noise = 0;
+    ServoSim_Configure(-1, &p);
+    ServoSim_UseVirtualClock(1);
+
+    static Servo_Axis ax[CHECK_TELEM_AXES];
+    for (int i = 0; i < CHECK_TELEM_AXES; i++)
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+    if (ServoTelemetry_Open(&g_telem, name, 4) != 0){ CHECK(0, "cannot open %s", name); return; }
+    ServoTelemetry_Bind(&g_telem);
+
+    /* tick until the reader got its share (one CPU: it runs when the tick yields or is
+       preempted), and at least past one FE window */
+    pthread_t th;
+    CHECK(pthread_create(&th, NULL, check_telem_reader, NULL) == 0, "pthread_create");
+    uint64_t ticks = 0;
+    for (; ticks < 200000 && (ticks < 3000 || atomic_load(&g_telem_reads) < 1000); ticks++){
+        check_tick(ax, CHECK_TELEM_AXES);
+        if ((ticks & 15) == 0) sched_yield();
+    }
+    atomic_store(&g_telem_stop, 1);
+    pthread_join(th, NULL);
+    CHECK(atomic_load(&g_telem_reads) > 0 && atomic_load(&g_telem_torn) == 0, "%ld reads, %ld inconsistent",
+          atomic_load(&g_telem_reads), atomic_load(&g_telem_torn));
+
+    Servo_TelemetryCycle c;
+    Servo_TelemetryAxis a[4];
+    CHECK(ServoTelemetry_Read(g_telem.hdr, &c, a, 4, 1) == CHECK_TELEM_AXES, "read");
+    CHECK(c.tick == ticks, "tick %llu, want %llu", (unsigned long long)c.tick, (unsigned long long)ticks);
+    for (int i = 0; i < CHECK_TELEM_AXES; i++){
+        CHECK(a[i].slave == (uint32_t)i && a[i].mapped && a[i].st == ax[i].st && a[i].st == CSP_ST_RUN,
+              "axis %d: slave %u mapped %u st %d", i, a[i].slave, a[i].mapped, a[i].st);
+        CHECK(a[i].target == check_target(&ax[i]) && a[i].actual == (int32_t)PDO_GET32(&ax[i], position_actual_value),
+              "axis %d: target %d actual %d", i, a[i].target, a[i].actual);
+        CHECK(CSP_FE_STATS == 0 || (a[i].fe_windows >= 1 && a[i].fe_rms == ax[i].fe_stats.rms),
+              "axis %d: %llu FE windows", i, (unsigned long long)a[i].fe_windows);
+    }
+
+    /* a write in progress for longer than the reader tries, and an unknown layout */
+    atomic_fetch_add(&g_telem.hdr->seq, 1);
+    CHECK(ServoTelemetry_Read(g_telem.hdr, &c, a, 4, 5) == -1, "read during a write");
+    atomic_fetch_add(&g_telem.hdr->seq, 1);
+    g_telem.hdr->version = CSP_TELEMETRY_VERSION - 1;
+    CHECK(ServoTelemetry_Read(g_telem.hdr, &c, a, 4, 5) == -1, "older layout read");
+    g_telem.hdr->version = CSP_TELEMETRY_VERSION;
+
+    ServoTelemetry_Bind(NULL);
+    ServoTelemetry_Close(&g_telem, 1);
+}
+
+/* ---- interp ---- */
+#define CHECK_INTERP_AXES 3
+
+static int32_t check_abs(int32_t v){ return v < 0 ? -v : v; }
+
+static void check_interp(void)
+{
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.noise = 0;
+    ServoSim_Configure(-1, &p);
+    ServoSim_UseVirtualClock(1);
+    static Servo_Axis ax[CHECK_INTERP_AXES];
+    static Servo_Interp g;
+    Servo_Axis *grp[CHECK_INTERP_AXES];
+    for (int i = 0; i < CHECK_INTERP_AXES; i++){
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+        grp[i] = &ax[i];
+    }
+    CHECK(ServoInterp_Init(&g, grp, CHECK_INTERP_AXES) == 0, "init group");
+    CHECK(check_run_all(ax, CHECK_INTERP_AXES, 5000) == 0, "not all Running");
+    const double feed = 100000.0, step = feed * LOOP_PERIOD_US * 1e-6;
+
+    /* line: every lane at the same fraction of its move, path speed ≤ feed, one arrival */
+    int32_t p0[CHECK_INTERP_AXES], tgt[CHECK_INTERP_AXES], prev[CHECK_INTERP_AXES];
+    const int32_t d[CHECK_INTERP_AXES] = { 30000, -20000, 10000 };
+    for (int i = 0; i < CHECK_INTERP_AXES; i++){ p0[i] = prev[i] = ax[i].pos_tgt; tgt[i] = p0[i] + d[i]; }
+    CHECK(ServoInterp_Linear(&g, tgt, feed, 0, 0) == 0 && ServoInterp_Busy(&g), "line refused");
+    CHECK(ServoInterp_Linear(&g, tgt, feed, 0, 0) == -1, "second move accepted while busy");
+    int off = 0, fast = 0, ticks = 0;
+    for (; ServoInterp_Busy(&g) && ticks < 5000; ticks++){
+        check_tick(ax, CHECK_INTERP_AXES);
+        const double u = (double)(check_target(&ax[0]) - p0[0]) / d[0];
+        double l2 = 0.0;
+        for (int i = 0; i < CHECK_INTERP_AXES; i++){
+            const int32_t t = check_target(&ax[i]);
+            const double e = fabs((double)t - (p0[i] + u * d[i]));
+            if (e > off) off = (int)ceil(e);
+            l2 += (double)(t - prev[i]) * (double)(t - prev[i]);
+            prev[i] = t;
+        }
+        if (sqrt(l2) > step + 2.0) fast++;
+    }
+    CHECK(!ServoInterp_Busy(&g) && g.moves == 1, "line still busy after %d ticks", ticks);
+    CHECK(off <= 2, "a lane %d counts off the line", off);
+    CHECK(fast == 0, "%d ticks faster than the feed", fast);
+    for (int i = 0; i < CHECK_INTERP_AXES; i++)
+        CHECK(check_target(&ax[i]) == tgt[i], "lane %d ended at %d, want %d", i, check_target(&ax[i]), tgt[i]);
+
+    /* full circle in XY about a point 10000 counts to the left: on the circle, back home */
+    const int32_t cx = tgt[0] - 10000, cy = tgt[1];
+    int32_t xmin = INT32_MAX, rerr = 0;
+    CHECK(ServoInterp_Arc(&g, tgt, cx, cy, 1, feed, 0, 0) == 0, "arc refused");
+    for (ticks = 0; ServoInterp_Busy(&g) && ticks < 5000; ticks++){
+        check_tick(ax, CHECK_INTERP_AXES);
+        const double x = check_target(&ax[0]) - cx, y = check_target(&ax[1]) - cy;
+        const int32_t e = (int32_t)lrint(fabs(sqrt(x*x + y*y) - 10000.0));
+        if (e > rerr) rerr = e;
+        if (check_target(&ax[0]) < xmin) xmin = check_target(&ax[0]);
+        CHECK(check_target(&ax[2]) == tgt[2], "lane 2 moved on a planar arc");
+    }
+    CHECK(!ServoInterp_Busy(&g) && rerr <= 2, "arc: %d counts off the radius", rerr);
+    CHECK(check_abs(xmin - (cx - 10000)) <= 2, "arc never reached the far side (x min %d)", xmin);
+    for (int i = 0; i < CHECK_INTERP_AXES; i++)
+        CHECK(check_abs(check_target(&ax[i]) - tgt[i]) <= 1, "lane %d ended at %d, want %d", i, check_target(&ax[i]), tgt[i]);
+
+    /* gantry: lane 2 copies lane 0 plus their offset at move start */
+    CHECK(ServoInterp_Gantry(&g, 2, 0) == 0 && ServoInterp_Gantry(&g, 0, 2) == -1, "gantry setup");
+    const int32_t goff = ax[2].pos_tgt - ax[0].pos_tgt;
+    int32_t move[CHECK_INTERP_AXES] = { ax[0].pos_tgt - 20000, ax[1].pos_tgt, 0 };
+    CHECK(ServoInterp_Linear(&g, move, feed, 0, 0) == 0, "gantry move refused");
+    int slip = 0;
+    for (ticks = 0; ServoInterp_Busy(&g) && ticks < 5000; ticks++){
+        check_tick(ax, CHECK_INTERP_AXES);
+        if (check_target(&ax[2]) - check_target(&ax[0]) != goff) slip++;
+    }
+    CHECK(slip == 0 && check_target(&ax[0]) == move[0], "gantry: %d ticks off the offset, lane 0 at %d", slip,
+          check_target(&ax[0]));
+
+    /* a member faults mid-move: the move aborts, the others hold */
+    move[0] = ax[0].pos_tgt + 20000;
+    CHECK(ServoInterp_Linear(&g, move, feed, 0, 0) == 0, "move refused");
+    for (int k = 0; k < 50; k++) check_tick(ax, CHECK_INTERP_AXES);
+    ServoSim_InjectFault(1, 0x7500);
+    for (int k = 0; k < 5; k++) check_tick(ax, CHECK_INTERP_AXES);
+    CHECK(!ServoInterp_Busy(&g) && g.aborts == 1, "not aborted (aborts %llu)", (unsigned long long)g.aborts);
+    const int32_t held = check_target(&ax[0]);
+    for (int k = 0; k < 100; k++) check_tick(ax, CHECK_INTERP_AXES);
+    CHECK(check_target(&ax[0]) == held && check_target(&ax[2]) == held + goff, "lane 0 moved after the abort");
+    CHECK(ServoInterp_Linear(&g, move, feed, 0, 0) == -1, "move accepted with a member faulted");
+}
+
+/* ---- traj ---- */
+static void check_traj(void)
+{
+    static Servo_Axis ax;
+    static Servo_Traj tr;
+    ServoSim_UseVirtualClock(1);
+    CHECK(ServoAxis_Init(&ax, NULL, 0, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init");
+    CHECK(ServoTraj_Attach(&ax, &tr, 0, 0, 0) == 0, "attach");
+    CHECK(ServoTraj_Service(&tr) == 0, "samples generated before the first enable");
+
+    const double dt = LOOP_PERIOD_US * 1e-6;
+    const int32_t vstep = (int32_t)ceil(TRAJ_VMAX * dt) + 1, astep = (int32_t)ceil(TRAJ_AMAX * dt * dt) + 2;
+    int32_t prev = 0, dprev = 0, vmax = 0, amax = 0, hi = INT32_MIN, lo = INT32_MAX;
+    int run = 0;
+    for (int k = 0; k < 8000; k++){
+        (void)ServoTraj_Service(&tr);
+        const int was = ax.st;
+        check_tick(&ax, 1);
+        const int32_t t = check_target(&ax), dv = t - prev;
+        if (was == CSP_ST_RUN && ax.st == CSP_ST_RUN){
+            if (check_abs(dv) > vmax) vmax = check_abs(dv);
+            if (run++ && check_abs(dv - dprev) > amax) amax = check_abs(dv - dprev);
+            if (t > hi) hi = t;
+            if (t < lo) lo = t;
+        }
+        prev = t; dprev = dv;
+    }
+    CHECK(vmax <= vstep && vmax >= vstep - 2, "speed %d counts/tick, limit %d", vmax, vstep);
+    CHECK(amax <= astep, "acceleration %d counts/tick², limit %d", amax, astep);
+    CHECK(hi == LIMIT_POS && lo == -LIMIT_POS, "moved %d..%d, want ±%d", lo, hi, LIMIT_POS);
+    CHECK(atomic_load(&tr.underruns) <= 3, "%llu underruns with the service every tick",
+          (unsigned long long)atomic_load(&tr.underruns));
+
+    /* fault mid-move: the generator restarts from where the axis re-enabled */
+    for (int k = 0; k < 300; k++){ (void)ServoTraj_Service(&tr); check_tick(&ax, 1); }
+    ServoSim_InjectFault(0, 0x7500);
+    int back_off = -1, jump = 0;
+    prev = check_target(&ax);
+    for (int k = 0; k < CSP_MS_TO_TICKS(FAULT_COOLDOWN_MS) + 3000; k++){
+        (void)ServoTraj_Service(&tr);
+        const int was = ax.st;
+        check_tick(&ax, 1);
+        const int32_t t = check_target(&ax);
+        if (was != CSP_ST_RUN && ax.st == CSP_ST_RUN)
+            back_off = check_abs(t - (int32_t)PDO_GET32(&ax, position_actual_value));
+        else if (was == CSP_ST_RUN && ax.st == CSP_ST_RUN && check_abs(t - prev) > jump) jump = check_abs(t - prev);
+        prev = t;
+    }
+    CHECK(ax.s402.recoveries == 1 && atomic_load(&tr.reset_req) == 2, "recoveries %u, restarts %u",
+          ax.s402.recoveries, (unsigned)atomic_load(&tr.reset_req));
+    CHECK(back_off >= 0 && back_off <= vstep, "re-enabled %d counts from 6064", back_off);
+    CHECK(jump <= vstep, "target stepped %d counts after the restart", jump);
+
+    /* the service thread (section 9) fills the ring ahead of the tick */
+    static Servo_TrajService svc;
+    CHECK(ServoTraj_StartService(&svc, &ax, 1, 200) == 0, "service thread");
+    int waited = 0;
+    while (servo_ring_level(&tr.ring) < SETPOINT_RING && waited++ < 10000){
+        const struct timespec ts = { 0, 100000 };
+        nanosleep(&ts, NULL);
+    }
+    CHECK(servo_ring_level(&tr.ring) == SETPOINT_RING, "ring at %u of %d", servo_ring_level(&tr.ring), SETPOINT_RING);
+    const uint64_t u0 = atomic_load(&tr.underruns);
+    for (int k = 0; k < SETPOINT_RING / 2; k++) check_tick(&ax, 1);
+    ServoTraj_StopService(&svc);
+    CHECK(atomic_load(&tr.underruns) == u0, "%llu underruns with a full ring",
+          (unsigned long long)(atomic_load(&tr.underruns) - u0));
+}
+
+/* ---- shards ---- */
+#define CHECK_SHARD_AXES 5
+
+static void check_shards(void)
+{
+    enum { SHARDS = 3, TICKS = 1500 };
+    static Servo_Axis ax[CHECK_SHARD_AXES];
+    static Servo_ShardSet set;
+    static Servo_Interp g;
+    for (int i = 0; i < CHECK_SHARD_AXES; i++)
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+
+    CHECK(ServoShards_Init(&set, ax, CHECK_SHARD_AXES, CHECK_SHARD_AXES + 1, NULL, 0) == -1, "more shards than axes");
+    Servo_Axis *pair[2] = { &ax[1], &ax[2] };      /* slices 2/2/1: axes 1 and 2 land apart */
+    CHECK(ServoInterp_Init(&g, pair, 2) == 0, "group");
+    CHECK(ServoShards_Init(&set, ax, CHECK_SHARD_AXES, SHARDS, NULL, 0) == -1, "group across shards accepted");
+    ax[1].interp = ax[2].interp = NULL;
+
+    CHECK(ServoShards_Init(&set, ax, CHECK_SHARD_AXES, SHARDS, NULL, 0) == 0, "init shards");
+    CHECK(set.shard[0].n == 2 && set.shard[1].n == 2 && set.shard[2].n == 1 && set.shard[1].ctx == &ax[2] &&
+          set.shard[2].ctx == &ax[4], "slices %zu/%zu/%zu", set.shard[0].n, set.shard[1].n, set.shard[2].n);
+    if (ServoShards_Start(&set) != 0){ CHECK(0, "start"); return; }
+    const int64_t P = set.period_ns;
+    CHECK(ServoShards_SlotAt(&set, set.start_ns - 1) == set.start_ns - P &&
+          ServoShards_SlotAt(&set, set.start_ns + 5 * P / 2) == set.start_ns + 2 * P, "SlotAt");
+
+    /* the frame thread: collect each slot, then run the bus cycle before the next one */
+    uint64_t late = 0;
+    for (int k = 0; k < TICKS; k++){
+        const int64_t slot = set.start_ns + k * P;
+        if (ServoShards_Wait(&set, slot, slot + P / 2)) late++;
+        ServoSim_Exchange();
+    }
+    ServoShards_Stop(&set);
+    CHECK(atomic_load(&set.frames) == TICKS && atomic_load(&set.late_frames) == late, "frames %llu late %llu",
+          (unsigned long long)atomic_load(&set.frames), (unsigned long long)atomic_load(&set.late_frames));
+    CHECK(late <= TICKS / 10, "%llu of %d frames gave up on a shard", (unsigned long long)late, TICKS);
+    for (int k = 0; k < SHARDS; k++){
+        CHECK(!(atomic_load(&set.shard[k].seq) & 1u) && set.shard[k].copy_out, "shard %d: seq %u", k,
+              (unsigned)atomic_load(&set.shard[k].seq));
+        CHECK(atomic_load(&set.shard[k].done_slot) >= set.start_ns + (TICKS - 1) * P, "shard %d behind", k);
+    }
+    for (int i = 0; i < CHECK_SHARD_AXES; i++) CHECK(ax[i].st == CSP_ST_RUN, "axis %d in state %d", i, ax[i].st);
+}
+
+/* ---- ff ---- */
+static void check_ff(void)
+{
+#if CSP_FF_MAPPED
+    static Servo_Axis ax[2];
+    static Servo_Traj tr;
+    ServoSim_UseVirtualClock(1);
+    for (int i = 0; i < 2; i++)
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+    ServoTraj_Attach(&ax[1], &tr, 0, 0, 0);        /* axis 1: S-curve, axis 0: triangle */
+    for (int k = 0; k < 500; k++){ (void)ServoTraj_Service(&tr); check_tick(ax, 2); }
+    CHECK(ax[0].st == CSP_ST_RUN && ax[1].st == CSP_ST_RUN, "not Running");
+    CHECK(PDO_OUT32(&ax[0], velocity_offset) == 0 && PDO_OUT16(&ax[0], torque_offset) == 0, "offsets without gains");
+
+    const float kv = 1.0f, ka = 1e-4f;
+    for (int i = 0; i < 2; i++) ServoAxis_SetFeedForward(&ax[i], kv, ka);
+    int32_t prev = check_target(&ax[0]), vprev = 0;
+    int bad_v = 0, bad_a = 0, bad_s = 0, moving = 0;
+    for (int k = 0; k < 3000; k++){
+        (void)ServoTraj_Service(&tr);
+        check_tick(ax, 2);
+        const int32_t t = check_target(&ax[0]);
+        /* the tick that lands on a limit is clamped: no offsets, as when standing there */
+        const int32_t v = check_abs(t) == LIMIT_POS ? 0 : (int32_t)((int64_t)(t - prev) * 1000000 / LOOP_PERIOD_US);
+        const int32_t a = check_abs(t) == LIMIT_POS ? 0 : (int32_t)((int64_t)(v - vprev) * 1000000 / LOOP_PERIOD_US);
+        if (k > 0){
+            if ((int32_t)PDO_OUT32(&ax[0], velocity_offset) != (int32_t)(kv * (float)v)) bad_v++;
+            if ((int16_t)PDO_OUT16(&ax[0], torque_offset) != csp_sat16(ka * (float)a)) bad_a++;
+        }
+        if ((int32_t)PDO_OUT32(&ax[1], velocity_offset) != (int32_t)(kv * (float)ax[1].sp.vel) ||
+            (int16_t)PDO_OUT16(&ax[1], torque_offset) != csp_sat16(ka * (float)ax[1].sp.acc)) bad_s++;
+        moving += ax[1].sp.vel != 0;
+        prev = t; vprev = v;
+    }
+    CHECK(bad_v == 0 && bad_a == 0, "triangle: %d velocity / %d torque offsets wrong", bad_v, bad_a);
+    CHECK(bad_s == 0 && moving > 1000, "S-curve: %d offsets wrong, %d moving ticks", bad_s, moving);
+
+    ServoSim_InjectFault(0, 0x7500);
+    for (int k = 0; k < 10; k++){ (void)ServoTraj_Service(&tr); check_tick(ax, 2); }
+    CHECK(ax[0].st != CSP_ST_RUN && PDO_OUT32(&ax[0], velocity_offset) == 0 && PDO_OUT16(&ax[0], torque_offset) == 0,
+          "offsets on a faulted axis (state %d)", ax[0].st);
+#else
+    fprintf(stderr, "ff: no feed-forward objects mapped in this build (CSP_FEED_FORWARD=1)\n");
+#endif
+}
+
+/* ---- dt ---- */
+static void check_dt(void)
+{
+#if CSP_DEADTIME_RING && CSP_FE_STATS
+    /* sim target delay 2 + one cycle for the inputs to come back: the drive's 60F4 is
+       the target sent 3 ticks ago − actual */
+    enum { DELAY = 2, MATCH = DELAY + 1 };
+    Servo_SimParams p;
+    ServoSim_Defaults(&p);
+    p.noise = 0;
+    p.delay_ticks = DELAY;
+    ServoSim_Configure(-1, &p);
+    ServoSim_UseVirtualClock(1);
+    static Servo_Axis ax[3];
+    for (int i = 0; i < 3; i++)
+        CHECK(ServoAxis_Init(&ax[i], NULL, i, DRIVE_INPUTS_BITS, DRIVE_OUTPUTS_BITS, 0, 0) == 0, "init %d", i);
+    ServoAxis_SetDeadTime(&ax[1], MATCH, 0);       /* axis 0: 60F4, 1: right delay, 2: wrong one */
+    ServoAxis_SetDeadTime(&ax[2], 1, 0);
+    CHECK(check_run_all(ax, 3, 5000) == 0, "not all Running");
+
+    for (int k = 0; k < 3000; k++) check_tick(ax, 3);
+    /* the ramp moves every axis the same way: same FE as the drive's with the right delay */
+    const Servo_FeStats *f0 = &ax[0].fe_stats, *f1 = &ax[1].fe_stats, *f2 = &ax[2].fe_stats;
+    CHECK(f0->windows >= 2 && f1->windows == f0->windows && f0->max > 0, "windows %llu/%llu, FE max %d",
+          (unsigned long long)f0->windows, (unsigned long long)f1->windows, f0->max);
+    CHECK(f1->min == f0->min && f1->max == f0->max && f1->mean == f0->mean && f1->rms == f0->rms,
+          "delay %d: FE %d..%d rms %d, 60F4 %d..%d rms %d", MATCH, f1->min, f1->max, f1->rms, f0->min, f0->max, f0->rms);
+    CHECK(f2->rms > f0->rms + INC_STEP, "delay 1: rms %d vs 60F4 rms %d", f2->rms, f0->rms);
+
+    /* prediction: act_pred = actual + (actual − previous actual)·d, tick after tick */
+    ServoAxis_SetDeadTime(&ax[1], MATCH, 1);
+    int bad_pred = 0;
+    int32_t act_prev = (int32_t)PDO_GET32(&ax[1], position_actual_value);
+    for (int k = 0; k < 500; k++){
+        ServoTemplate_RunBatch(ax, 3);
+        const int32_t act = (int32_t)PDO_GET32(&ax[1], position_actual_value);
+        if (ax[1].act_pred != act + (act - act_prev) * MATCH) bad_pred++;
+        act_prev = act;
+        ServoSim_Exchange();
+    }
+    CHECK(bad_pred == 0, "%d ticks with act_pred off actual + v·d", bad_pred);
+    ServoAxis_SetDeadTime(&ax[2], 1000, 1);
+    CHECK(ax[2].dt_ticks == CSP_DEADTIME_RING - 1 && ax[2].dt_predict == 1, "delay not clamped (%u)", ax[2].dt_ticks);
+#else
+    fprintf(stderr, "dt: CSP_DEADTIME_RING or CSP_FE_STATS off in this build\n");
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2){
+        fprintf(stderr, "usage: %s <402|ring|lut|cfg|fe|dc|replay|trace|sdo|sdoq|bus|telem|interp|traj|shards|ff|dt> [dir]\n",
+                argv[0]);
+        return 2;
+    }
+    const char *w = argv[1];
+    if      (!strcmp(w, "402"))    check_402();
+    else if (!strcmp(w, "ring"))   check_ring();
+    else if (!strcmp(w, "lut"))    check_lut();
+    else if (!strcmp(w, "cfg"))    check_cfg();
+    else if (!strcmp(w, "fe"))     check_fe();
+    else if (!strcmp(w, "dc"))     check_dc();
+    else if (!strcmp(w, "replay")) check_replay(argc > 2 ? argv[2] : ".");
+    else if (!strcmp(w, "trace"))  check_trace(argc > 2 ? argv[2] : ".");
+    else if (!strcmp(w, "sdo"))    check_sdo();
+    else if (!strcmp(w, "sdoq"))   check_sdoq();
+    else if (!strcmp(w, "bus"))    check_bus();
+    else if (!strcmp(w, "telem"))  check_telem();
+    else if (!strcmp(w, "interp")) check_interp();
+    else if (!strcmp(w, "traj"))   check_traj();
+    else if (!strcmp(w, "shards")) check_shards();
+    else if (!strcmp(w, "ff"))     check_ff();
+    else if (!strcmp(w, "dt"))     check_dt();
+    else { fprintf(stderr, "unknown check '%s'\n", w); return 2; }
+#if CSP_LOG_DEFERRED
+    (void)ServoLog_Drain(stdout);
+#endif
+    printf("check %s: %s\n", w, g_fail ? "FAILED" : "ok");
+    return g_fail;
+}
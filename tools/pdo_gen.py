@@ -0,0 +1,304 @@
+#!/usr/bin/env python3
+"""
+pdo_gen.py — generate the template's PDO layout header from an ENI or ESI file.
+
+WHAT: reads the PDO mapping of one drive (ENI: as configured on the bus; ESI: the
+default assignment, or --pdo) and writes a header with packed Drive_Inputs /
+Drive_Outputs in *exactly* that order, constant offsets, static asserts and the
+per-field alignment flags and multi-byte field lists the template's accessors
+and big-endian batch swap use, plus CSP_PDO_HAS_<field> for each named field (the
+template enables optional features — 603F in the trace, 60B1/60B2 feed-forward —
+only when the mapping has them).
+WHY: the hand-written structs in section 3 only match one mapping; a generated
+layout cannot drift from the ENI, and a size mismatch fails the build instead of
+reaching OP.
+
+Usage:
+  tools/pdo_gen.py bus.xml -o pdo_layout.h                 # ENI, first CiA-402 drive
+  tools/pdo_gen.py bus.xml --slave 2 -o pdo_layout.h       # ENI, 3rd slave on the bus
+  tools/pdo_gen.py drive_esi.xml --pdo 0x1701,0x1B01 -o pdo_layout.h
+Then build the template with -DCSP_PDO_LAYOUT_HEADER='"pdo_layout.h"' and pass
+CSP_PDO_IN_BITS / CSP_PDO_OUT_BITS (and the offsets from CSP_PDO_SLAVE_TABLE) to
+ServoAxis_Init().
+
+Only the Python standard library is used.
+"""
+import argparse
+import sys
+import xml.etree.ElementTree as ET
+
+# Objects the template reads/writes, by (index, subindex) → struct field name.
+REQUIRED_IN = {
+    (0x6041, 0): "status_word",
+    (0x6064, 0): "position_actual_value",
+    (0x60F4, 0): "following_error_actual",
+}
+REQUIRED_OUT = {
+    (0x6040, 0): "control_word",
+    (0x607A, 0): "target_position",
+}
+# Other common CiA-402 objects get readable names; anything else is obj_XXXX_SS.
+KNOWN = {
+    (0x603F, 0): "error_code",
+    (0x6060, 0): "modes_of_operation",
+    (0x6061, 0): "modes_of_operation_display",
+    (0x606C, 0): "velocity_actual_value",
+    (0x6077, 0): "torque_actual_value",
+    (0x60B1, 0): "velocity_offset",
+    (0x60B2, 0): "torque_offset",
+    (0x60B8, 0): "touch_probe_function",
+    (0x60B9, 0): "touch_probe_status",
+    (0x60BA, 0): "touch_probe_pos1_pos_value",
+    (0x60BC, 0): "touch_probe_pos2_pos_value",
+    (0x60FD, 0): "digital_inputs",
+    (0x60FE, 1): "physical_outputs",
+    (0x60FE, 2): "physical_outputs_mask",
+}
+CTYPES = {8: "int8_t", 16: "int16_t", 32: "int32_t", 64: "int64_t"}
+SIGNED = {"SINT", "INT", "DINT", "LINT", "INTEGER8", "INTEGER16", "INTEGER32", "INTEGER64"}
+
+
+def num(text):
+    """ENI/ESI numbers: '#x6040', '0x6040' or decimal."""
+    t = (text or "0").strip()
+    if t[:2] in ("#x", "#X", "0x", "0X"):
+        return int(t[2:], 16)
+    return int(t)
+
+
+def entries_of(pdo):
+    out = []
+    for e in pdo.findall("Entry"):
+        out.append({
+            "index": num(e.findtext("Index")),
+            "sub": num(e.findtext("SubIndex")),
+            "bits": num(e.findtext("BitLen")),
+            "name": (e.findtext("Name") or "").strip(),
+            "type": (e.findtext("DataType") or "").strip().upper(),
+        })
+    return out
+
+
+def collect(pdos):
+    ents = []
+    for p in pdos:
+        ents += entries_of(p)
+    return ents
+
+
+def is_cia402(slave):
+    return any(num(e.findtext("Index")) == 0x6041 for e in slave.iter("Entry"))
+
+
+def from_eni(root, args):
+    slaves = root.findall("./Config/Slave")
+    if not slaves:
+        return None
+    if args.slave is None:
+        pick = next((i for i, s in enumerate(slaves) if is_cia402(s)), None)
+        if pick is None:
+            sys.exit("pdo_gen: no slave with 0x6041 in the ENI; use --slave")
+    else:
+        pick = args.slave
+        if not 0 <= pick < len(slaves):
+            sys.exit("pdo_gen: --slave %d out of range (0..%d)" % (pick, len(slaves) - 1))
+
+    def layout(s):
+        pd = s.find("ProcessData")
+        if pd is None:
+            return None
+        return {
+            "name": (s.findtext("Info/Name") or "slave").strip(),
+            "vendor": num(s.findtext("Info/VendorId")),
+            "product": num(s.findtext("Info/ProductCode")),
+            "tx": collect(pd.findall("TxPdo")),      # drive → master (inputs)
+            "rx": collect(pd.findall("RxPdo")),      # master → drive (outputs)
+            "in_off": num(pd.findtext("Recv/BitStart")),
+            "in_len": num(pd.findtext("Recv/BitLength")),
+            "out_off": num(pd.findtext("Send/BitStart")),
+            "out_len": num(pd.findtext("Send/BitLength")),
+        }
+
+    ref = layout(slaves[pick])
+    if ref is None:
+        sys.exit("pdo_gen: slave %d has no ProcessData" % pick)
+    ref["pos"] = pick
+    # Every slave with the same mapping can use the same header: list their offsets.
+    same = []
+    for i, s in enumerate(slaves):
+        lo = layout(s)
+        if lo and (lo["vendor"], lo["product"], lo["tx"], lo["rx"]) == \
+                  (ref["vendor"], ref["product"], ref["tx"], ref["rx"]):
+            same.append((i, lo["in_off"], lo["out_off"]))
+    ref["same"] = same
+    return ref
+
+
+def from_esi(root, args):
+    dev = root.find("./Descriptions/Devices/Device")
+    if dev is None:
+        return None
+    wanted = None
+    if args.pdo:
+        wanted = {num(x) for x in args.pdo.split(",")}
+
+    def pick(tag):
+        out = []
+        for p in dev.findall(tag):
+            idx = num(p.findtext("Index"))
+            if (wanted is not None and idx in wanted) or (wanted is None and "Sm" in p.attrib):
+                out.append(p)
+        return out
+
+    t = dev.find("Type")
+    name = (t.text if t is not None and t.text else "device").strip()
+    vendor = num(root.findtext("./Vendor/Id"))
+    product = num(t.get("ProductCode")) if t is not None else 0
+    tx, rx = collect(pick("TxPdo")), collect(pick("RxPdo"))
+    off_in, off_out = args.in_off, args.out_off
+    return {
+        "name": name, "vendor": vendor, "product": product, "tx": tx, "rx": rx,
+        "in_off": off_in, "out_off": off_out,
+        "in_len": sum(e["bits"] for e in tx), "out_len": sum(e["bits"] for e in rx),
+        "pos": 0, "same": [(0, off_in, off_out)],
+    }
+
+
+def fields(ents, required, what):
+    """Entries → struct members; sub-byte entries are packed into uint8_t runs."""
+    members, seen, bit, run = [], set(), 0, []
+
+    def flush_run():
+        nonlocal run
+        if not run:
+            return
+        nb = sum(e["bits"] for e in run)
+        if nb % 8:
+            sys.exit("pdo_gen: %s: bit entries end off a byte boundary at bit %d" % (what, bit))
+        desc = ", ".join("%s:%d" % (e["name"] or "pad", e["bits"]) for e in run)
+        members.append(("uint8_t", "bits_%d[%d]" % ((bit - nb) // 8, nb // 8), (bit - nb) // 8,
+                        nb // 8, "bit entries: " + desc))
+        run = []
+
+    for e in ents:
+        key = (e["index"], e["sub"])
+        if e["bits"] % 8 or bit % 8:
+            run.append(e)
+            bit += e["bits"]
+            if bit % 8 == 0:
+                flush_run()
+            continue
+        nbytes = e["bits"] // 8
+        if e["index"] == 0:                          # padding entry
+            members.append(("uint8_t", "pad_%d[%d]" % (bit // 8, nbytes), bit // 8, nbytes, "padding"))
+        else:
+            name = required.get(key) or KNOWN.get(key) or "obj_%04X_%02X" % key
+            if name in seen:
+                name += "_%d" % (bit // 8)
+            seen.add(name)
+            if e["bits"] in CTYPES:
+                ctype = CTYPES[e["bits"]]
+                if e["type"] not in SIGNED:
+                    ctype = "u" + ctype
+                members.append((ctype, name, bit // 8, nbytes,
+                                "0x%04X:%d %s" % (e["index"], e["sub"], e["name"])))
+            else:
+                members.append(("uint8_t", "%s[%d]" % (name, nbytes), bit // 8, nbytes,
+                                "0x%04X:%d %s" % (e["index"], e["sub"], e["name"])))
+        bit += e["bits"]
+    flush_run()
+    names = {m[1] for m in members}
+    missing = [n for n in required.values() if n not in names]
+    if missing:
+        sys.exit("pdo_gen: %s mapping lacks %s (the template needs it)" % (what, ", ".join(missing)))
+    return members, bit
+
+
+def emit(lo, args, out):
+    ins, in_bits = fields(lo["tx"], REQUIRED_IN, "TxPdo (inputs)")
+    outs, out_bits = fields(lo["rx"], REQUIRED_OUT, "RxPdo (outputs)")
+    if lo["in_len"] and lo["in_len"] != in_bits:
+        sys.exit("pdo_gen: inputs: entries sum to %d bits, ProcessData says %d" % (in_bits, lo["in_len"]))
+    if lo["out_len"] and lo["out_len"] != out_bits:
+        sys.exit("pdo_gen: outputs: entries sum to %d bits, ProcessData says %d" % (out_bits, lo["out_len"]))
+
+    def aligned(m, base_bits):
+        """(struct-relative, image-relative) natural alignment of a scalar member."""
+        ctype, name, off, size = m[0], m[1], m[2], m[3]
+        if "[" in name or size not in (2, 4, 8):
+            return None
+        img = all(((b // 8) + off) % size == 0 and b % 8 == 0 and args.image_align % size == 0
+                  for b in base_bits)
+        return (off % size == 0, img)
+
+    w = out.write
+    w("/* Generated by tools/pdo_gen.py from %s — do not edit.\n" % args.source)
+    w("   Drive: %s (vendor 0x%08X, product 0x%08X), bus position %d.\n"
+      % (lo["name"], lo["vendor"], lo["product"], lo["pos"]))
+    w("   Image base alignment assumed: %d byte(s) (--image-align). */\n" % args.image_align)
+    w("#ifndef CSP_PDO_LAYOUT_GENERATED\n#define CSP_PDO_LAYOUT_GENERATED 1\n\n")
+    w("#define CSP_PDO_VENDOR_ID      0x%08Xu\n" % lo["vendor"])
+    w("#define CSP_PDO_PRODUCT_ID     0x%08Xu\n" % lo["product"])
+    w("#define CSP_PDO_IN_BITS        %du\n" % in_bits)
+    w("#define CSP_PDO_OUT_BITS       %du\n" % out_bits)
+    w("#define CSP_PDO_IN_OFF_BITS    %du\n" % lo["in_off"])
+    w("#define CSP_PDO_OUT_OFF_BITS   %du\n\n" % lo["out_off"])
+    w("/* Slaves with this exact mapping: { bus position, in offset bits, out offset bits } */\n")
+    w("#define CSP_PDO_SLAVE_COUNT    %d\n" % len(lo["same"]))
+    w("#define CSP_PDO_SLAVE_TABLE    { %s }\n\n"
+      % ", ".join("{ %d, %d, %d }" % s for s in lo["same"]))
+
+    for tag, members, bits, offs in (("Drive_Inputs", ins, in_bits, [s[1] for s in lo["same"]]),
+                                     ("Drive_Outputs", outs, out_bits, [s[2] for s in lo["same"]])):
+        w("#pragma pack(push,1)\ntypedef struct {\n")
+        for ctype, name, off, size, comment in members:
+            w("    %-9s %-28s /* @%-3d %s */\n" % (ctype, name + ";", off, comment))
+        w("} %s;\n#pragma pack(pop)\n" % tag)
+        w("_Static_assert(sizeof(%s) * 8u == %du, \"%s size != ENI\");\n" % (tag, bits, tag))
+        for m in members:
+            if "[" in m[1]:
+                continue
+            w("_Static_assert(offsetof(%s, %s) == %d, \"%s.%s offset\");\n" % (tag, m[1], m[2], tag, m[1]))
+        xs = " ".join("X(%s, %d)" % (m[1], m[3]) for m in members
+                      if "[" not in m[1] and m[3] in (2, 4, 8))
+        w("#define CSP_PDO_%s_FIELDS(X) %s\n" % ("IN" if tag == "Drive_Inputs" else "OUT", xs or "/* none */"))
+        for m in members:
+            if "[" not in m[1] and not m[1].startswith(("pad_", "obj_")):
+                w("#define CSP_PDO_HAS_%s 1\n" % m[1])
+        for m in members:
+            al = aligned(m, offs)
+            if al is not None:
+                w("#define CSP_PDO_ALIGNED_%s %d\n" % (m[1], int(al[0])))
+                w("#define CSP_PDO_IMG_ALIGNED_%s %d\n" % (m[1], int(al[1])))
+        w("\n")
+    w("#endif /* CSP_PDO_LAYOUT_GENERATED */\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("source", help="ENI (EtherCATConfig) or ESI (EtherCATInfo) XML")
+    ap.add_argument("-o", "--output", help="header to write (default stdout)")
+    ap.add_argument("--slave", type=int, help="ENI: 0-based slave position (default: first drive)")
+    ap.add_argument("--pdo", help="ESI: comma-separated PDO indices (default: those with Sm=)")
+    ap.add_argument("--in-off", type=int, default=0, help="ESI: input bit offset in the image")
+    ap.add_argument("--out-off", type=int, default=0, help="ESI: output bit offset in the image")
+    ap.add_argument("--image-align", type=int, default=1,
+                    help="alignment the master guarantees for the image base (bytes)")
+    args = ap.parse_args()
+
+    root = ET.parse(args.source).getroot()
+    lo = from_eni(root, args) if root.tag == "EtherCATConfig" else \
+         from_esi(root, args) if root.tag == "EtherCATInfo" else None
+    if lo is None:
+        sys.exit("pdo_gen: %s is neither an ENI nor an ESI with PDOs" % args.source)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            emit(lo, args, f)
+    else:
+        emit(lo, args, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
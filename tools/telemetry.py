@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+telemetry.py — read the template's shared-memory telemetry segment (section 4e).
+
+WHAT: attaches read-only to /dev/shm/<name>, takes a consistent snapshot through the
+segment's seqlock (retry while the sequence is odd or moved) and prints it as a table
+or in the Prometheus text exposition format.
+WHY: a reference reader for HMIs and exporters; it never blocks the cyclic thread.
+It follows the offsets and strides in the header, so it keeps working when later
+layout versions append fields.
+
+Usage:
+  tools/telemetry.py csp_cell0                  # one table
+  tools/telemetry.py csp_cell0 --watch 0.5      # refresh every 0.5 s
+  tools/telemetry.py csp_cell0 --prom           # Prometheus text format (node_exporter textfile, …)
+
+Only the Python standard library is used.
+"""
+import argparse
+import mmap
+import os
+import struct
+import sys
+import time
+
+# Mirrors Servo_TelemetryHeader (prefix), Servo_TelemetryCycle, Servo_TelemetryAxis.
+HEADER = struct.Struct("<8s11I4xq")
+SUMMARY = struct.Struct("<Q6q")
+CYCLE = struct.Struct("<Qq")
+CYCLE_DC = struct.Struct("<qqiI")              # v3: DC lock, right after the two SUMMARYs
+AXIS = struct.Struct("<IiHHHBBiiiiQQQq")
+AXIS_FE = struct.Struct("<Q8iIii")             # v2: FE window statistics, right after AXIS
+VERSION = 1
+AXES_LIVE_OFF = 36                     # Servo_TelemetryHeader.axes_live
+DC_ACTIVE, DC_LOCKED = 1, 2
+STATES = {0: "Shutdown", 1: "SwitchOn", 2: "Enabling", 3: "Running", 4: "FaultReset", 5: "Cooldown",
+          6: "Locked"}
+
+
+def attach(name):
+    path = "/dev/shm/" + name.lstrip("/")
+    fd = os.open(path, os.O_RDONLY)
+    try:
+        return mmap.mmap(fd, 0, prot=mmap.PROT_READ)
+    finally:
+        os.close(fd)
+
+
+def header(m):
+    (magic, version, header_size, cycle_off, cycle_size, axes_off, axis_size, axes_cap,
+     axes_live, period_us, pid, seq_off, t_open_ns) = HEADER.unpack_from(m, 0)
+    if magic != b"CSPTELEM":
+        sys.exit("telemetry: segment not initialized (bad magic)")
+    if version < VERSION or axis_size < AXIS.size:
+        sys.exit("telemetry: unsupported layout version %d" % version)
+    return {"version": version, "cycle_off": cycle_off, "axes_off": axes_off, "axis_size": axis_size,
+            "axes_cap": axes_cap, "period_us": period_us, "pid": pid, "seq_off": seq_off}
+
+
+def axis_fields(raw):
+    """AXIS tuple + FE stats dict (empty before v2 or before the first window)."""
+    base = AXIS.unpack_from(raw, 0)
+    fe = {}
+    if len(raw) >= AXIS.size + AXIS_FE.size:
+        v = AXIS_FE.unpack_from(raw, AXIS.size)
+        if v[0]:
+            fe = dict(zip(("windows", "min", "max", "mean", "rms", "p50", "p90", "p99", "p999",
+                           "cur_n", "cur_min", "cur_max"), v))
+    return base + (fe,)
+
+
+def snapshot(m, h, tries=1000):
+    seq = struct.Struct("<I")
+    for _ in range(tries):
+        s0 = seq.unpack_from(m, h["seq_off"])[0]
+        if s0 & 1:
+            continue
+        live = min(struct.unpack_from("<I", m, AXES_LIVE_OFF)[0], h["axes_cap"])
+        csize = CYCLE.size + 2 * SUMMARY.size + (CYCLE_DC.size if h["version"] >= 3 else 0)
+        cyc = m[h["cycle_off"]:h["cycle_off"] + csize]
+        size = AXIS.size + (AXIS_FE.size if h["version"] >= 2 else 0)
+        axes = [m[h["axes_off"] + i * h["axis_size"]:h["axes_off"] + i * h["axis_size"] + size]
+                for i in range(live)]
+        if seq.unpack_from(m, h["seq_off"])[0] == s0:
+            tick, t_ns = CYCLE.unpack_from(cyc, 0)
+            exec_ = SUMMARY.unpack_from(cyc, CYCLE.size)
+            late = SUMMARY.unpack_from(cyc, CYCLE.size + SUMMARY.size)
+            dc = {}
+            if len(cyc) >= CYCLE.size + 2 * SUMMARY.size + CYCLE_DC.size:
+                v = CYCLE_DC.unpack_from(cyc, CYCLE.size + 2 * SUMMARY.size)
+                if v[3] & DC_ACTIVE:
+                    dc = dict(zip(("offset_ns", "shift_ns", "drift_ppb", "flags"), v))
+            return tick, exec_, late, dc, [axis_fields(a) for a in axes]
+    sys.exit("telemetry: no consistent snapshot after %d tries" % tries)
+
+
+def show(tick, exec_, late, dc, axes):
+    print("tick %d  exec p50/p99/max %d/%d/%d ns  late p99/max %d/%d ns"
+          % (tick, exec_[4], exec_[5], exec_[2], late[5], late[2]))
+    if dc:
+        print("DC %s  offset %d ns  shift %d ns  drift %d ppb"
+              % ("locked" if dc["flags"] & DC_LOCKED else "unlocked", dc["offset_ns"], dc["shift_ns"],
+                 dc["drift_ppb"]))
+    print("%5s %-9s %6s %6s %6s %11s %11s %8s %4s %7s  %s" %
+          ("slave", "state", "SW", "CW", "603F", "target", "actual", "FE", "warn", "overrun",
+           "FE window: min/max mean rms p50/p99/p99.9"))
+    for a in axes:
+        (slave, st, sw, cw, err, fe_warn, mapped, target, actual, fe, _r, ev, _mi, _dr, _wl, fs) = a
+        if not mapped:
+            print("%5d %-9s" % (slave, "unmapped"))
+            continue
+        win = ("%d/%d %d %d %d/%d/%d" % (fs["min"], fs["max"], fs["mean"], fs["rms"],
+                                          fs["p50"], fs["p99"], fs["p999"])) if fs else "-"
+        print("%5d %-9s 0x%04X 0x%04X 0x%04X %11d %11d %8d %4d %7d  %s" %
+              (slave, STATES.get(st, str(st)), sw, cw, err, target, actual, fe, fe_warn, ev, win))
+
+
+def prom(tick, exec_, late, dc, axes):
+    out = ["csp_ticks_total %d" % tick]
+    for name, s in (("exec", exec_), ("late", late)):
+        for q, v in (("0.5", s[4]), ("0.99", s[5]), ("0.999", s[6])):
+            out.append('csp_cycle_%s_ns{quantile="%s"} %d' % (name, q, v))
+        out.append("csp_cycle_%s_ns_max %d" % (name, s[2]))
+    if dc:
+        out += ["csp_dc_offset_ns %d" % dc["offset_ns"], "csp_dc_shift_ns %d" % dc["shift_ns"],
+                "csp_dc_drift_ppb %d" % dc["drift_ppb"], "csp_dc_locked %d" % bool(dc["flags"] & DC_LOCKED)]
+    for a in axes:
+        (slave, st, sw, cw, err, fe_warn, mapped, target, actual, fe, _r, ev, mi, dr, wl, fs) = a
+        if not mapped:
+            continue
+        lbl = '{slave="%d"}' % slave
+        out += ["csp_axis_state%s %d" % (lbl, st), "csp_axis_statusword%s %d" % (lbl, sw),
+                "csp_axis_error_code%s %d" % (lbl, err), "csp_axis_target%s %d" % (lbl, target),
+                "csp_axis_actual%s %d" % (lbl, actual), "csp_axis_following_error%s %d" % (lbl, fe),
+                "csp_axis_fe_warn%s %d" % (lbl, fe_warn), "csp_axis_overrun_events_total%s %d" % (lbl, ev),
+                "csp_axis_missed_periods_total%s %d" % (lbl, mi)]
+        if fs:
+            out += ["csp_axis_fe_window_%s%s %d" % (k, lbl, fs[k])
+                    for k in ("min", "max", "mean", "rms")]
+            out += ['csp_axis_fe_abs{slave="%d",quantile="%s"} %d' % (slave, q, fs[k])
+                    for q, k in (("0.5", "p50"), ("0.9", "p90"), ("0.99", "p99"), ("0.999", "p999"))]
+            out.append("csp_axis_fe_windows_total%s %d" % (lbl, fs["windows"]))
+    print("\n".join(out))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("name", help="segment name given to ServoTelemetry_Open (with or without '/')")
+    ap.add_argument("--prom", action="store_true", help="Prometheus text format")
+    ap.add_argument("--watch", type=float, metavar="S", help="repeat every S seconds")
+    args = ap.parse_args()
+
+    m = attach(args.name)
+    h = header(m)
+    while True:
+        snap = snapshot(m, h)
+        (prom if args.prom else show)(*snap)
+        if not args.watch:
+            break
+        time.sleep(args.watch)
+        print()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+trace2csv.py — decode the template's binary per-tick trace (section 4d) to CSV.
+
+WHAT: reads the memory-mapped ring file written by ServoTrace_Open/Start (a header
+page, then fixed 32-byte records) and prints the records oldest first, one row per
+axis per tick. Works on a live file too: it decodes what the header says is written.
+WHY: the trace is binary so the cyclic thread only copies a record; this is the
+other half, for spreadsheets, pandas or gnuplot.
+
+Usage:
+  tools/trace2csv.py axis.trace > axis.csv
+  tools/trace2csv.py axis.trace --around 2000 -o fault.csv   # ±2000 records around the trigger
+  tools/trace2csv.py axis.trace --info                       # header only
+
+Only the Python standard library is used.
+"""
+import argparse
+import struct
+import sys
+
+# Mirrors Servo_TraceFileHeader / Servo_TraceRecord (little-endian host layout).
+HEADER = struct.Struct("<8sIIQIIqQIIQQ")
+RECORD = struct.Struct("<IHBBHHHHiiii")
+DATA_OFF = 4096
+VERSION = 1
+F_FAULT, F_FE_WARN, F_TRIGGER = 1, 2, 4
+COLUMNS = ("seq", "tick", "t_ms", "axis", "st", "sw", "cw", "err",
+           "target", "actual", "fe", "late_ns", "fault", "fe_warn", "trigger")
+
+
+def read_header(buf):
+    (magic, version, rec_size, capacity, period_us, axes, t_open_ns, written,
+     frozen, trig_flags, trig_seq, dropped) = HEADER.unpack_from(buf, 0)
+    if magic != b"CSPTRACE":
+        sys.exit("trace2csv: not a trace file (bad magic)")
+    if version != VERSION or rec_size != RECORD.size:
+        sys.exit("trace2csv: unsupported trace version %d / record size %d" % (version, rec_size))
+    return {"capacity": capacity, "period_us": period_us, "axes": axes, "t_open_ns": t_open_ns,
+            "written": written, "frozen": frozen, "trig_flags": trig_flags,
+            "trig_seq": trig_seq, "dropped": dropped}
+
+
+def find_trigger(buf, first, written, cap):
+    """Newest record flagged F_TRIGGER, for files whose header has no trigger (written by
+    an older template, or the process died between the push and the next flush)."""
+    for seq in range(written - 1, first - 1, -1):
+        flags = buf[DATA_OFF + (seq % cap) * RECORD.size + 7]
+        if flags & F_TRIGGER:
+            return seq
+    return None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[1],
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("trace", help="trace file written by ServoTrace_Open")
+    ap.add_argument("-o", "--output", help="CSV to write (default stdout)")
+    ap.add_argument("--around", type=int, metavar="N",
+                    help="only N records before and after the trigger record")
+    ap.add_argument("--axis", type=int, help="only this slave index")
+    ap.add_argument("--info", action="store_true", help="print the header and exit")
+    args = ap.parse_args()
+
+    with open(args.trace, "rb") as f:
+        buf = f.read()
+    h = read_header(buf)
+    written, cap = h["written"], h["capacity"]
+    first = written - min(written, cap)
+    if args.info:
+        for k in sorted(h):
+            print("%-10s %s" % (k, h[k]))
+        print("%-10s %d..%d" % ("records", first, written))
+        return
+
+    lo, hi = first, written
+    if args.around is not None:
+        trig = h["trig_seq"] if h["trig_flags"] else find_trigger(buf, first, written, cap)
+        if trig is None:
+            sys.exit("trace2csv: no trigger in this trace")
+        lo = max(first, trig - args.around)
+        hi = min(written, trig + args.around + 1)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    out.write(",".join(COLUMNS) + "\n")
+    for seq in range(lo, hi):
+        (tick, axis, st, flags, sw, cw, err, _res,
+         target, actual, fe, late) = RECORD.unpack_from(buf, DATA_OFF + (seq % cap) * RECORD.size)
+        if args.axis is not None and axis != args.axis:
+            continue
+        out.write("%d,%d,%.3f,%d,%d,0x%04X,0x%04X,0x%04X,%d,%d,%d,%d,%d,%d,%d\n" % (
+            seq, tick, tick * h["period_us"] / 1000.0, axis, st, sw, cw, err,
+            target, actual, fe, late,
+            bool(flags & F_FAULT), bool(flags & F_FE_WARN), bool(flags & F_TRIGGER)))
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()